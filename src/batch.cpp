@@ -0,0 +1,624 @@
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "batch.h"
+
+#include <string.h>
+
+#include "difficulty.h"
+
+static const char MAGIC[] = "XNYBATCH";
+
+static void putU16(unsigned char* p, unsigned int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void putU32(unsigned char* p, unsigned int v)
+{
+    putU16(p, v & 0xFFFF);
+    putU16(p+2, v >> 16);
+}
+
+static void putU64(unsigned char* p, unsigned long long v)
+{
+    putU32(p, (unsigned int)v);
+    putU32(p+4, (unsigned int)(v >> 32));
+}
+
+static unsigned int getU16(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int getU32(const unsigned char* p)
+{
+    return getU16(p) | (getU16(p+2) << 16);
+}
+
+static unsigned long long getU64(const unsigned char* p)
+{
+    return getU32(p) | ((unsigned long long)getU32(p+4) << 32);
+}
+
+static bool seekTo(FILE* f, unsigned long long offset)
+{
+#ifdef _WIN32
+    return _fseeki64(f, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static unsigned int saturate(double v)
+{
+    return v < 4294967295.0 ? (unsigned int)v : 0xFFFFFFFFu;
+}
+
+static void encodeRecord(const BatchAnalysis::Record& record, unsigned char* p)
+{
+    p[0] = (unsigned char)record.status;
+    p[1] = 0;
+    putU16(p+2, (unsigned int)record.moves);
+    putU32(p+4, record.nodes);
+    putU32(p+8, record.micros);
+}
+
+static void decodeRecord(const unsigned char* p, BatchAnalysis::Record* record)
+{
+    record->status = p[0];
+    record->moves = (int)getU16(p+2);
+    record->nodes = getU32(p+4);
+    record->micros = getU32(p+8);
+}
+
+static void countRecord(BatchAnalysis::Stats& stats, const BatchAnalysis::Record& record)
+{
+    stats.done++;
+    if (record.status == BatchAnalysis::STATUS_SOLVED) {
+        stats.solved++;
+    } else if (record.status == BatchAnalysis::STATUS_UNSOLVABLE) {
+        stats.unsolvable++;
+    } else {
+        stats.aborted++;
+    }
+}
+
+BatchAnalysis::Record::Record()
+    : status(STATUS_NONE)
+    , moves(0)
+    , nodes(0)
+    , micros(0)
+{
+}
+
+BatchAnalysis::Stats::Stats()
+    : total(0)
+    , done(0)
+    , solved(0)
+    , unsolvable(0)
+    , aborted(0)
+    , steals(0)
+    , seconds(0.0)
+{
+}
+
+BatchAnalysis::Worker::Worker()
+    : owner(NULL_PTR)
+    , next(0)
+    , end(0)
+    , gameState(NULL_PTR)
+    , bufferStart(0)
+    , bufferCount(0)
+    , finished(false)
+{
+}
+
+BatchAnalysis::Worker::~Worker()
+{
+    delete gameState;
+}
+
+BatchAnalysis::BatchAnalysis()
+    : maxNodes(0)
+    , hashSizeMb(0)
+    , threadCount(1)
+    , file(NULL_PTR)
+    , firstSeed(0)
+    , count(0)
+    , doneBits(NULL_PTR)
+    , workers(NULL_PTR)
+    , runSeconds(0.0)
+{
+}
+
+BatchAnalysis::~BatchAnalysis()
+{
+    close();
+}
+
+void BatchAnalysis::init(long long aMaxNodes, int aHashSizeMb, int aThreadCount)
+{
+    maxNodes = aMaxNodes;
+    hashSizeMb = aHashSizeMb;
+    threadCount = aThreadCount > 0 ? aThreadCount : Platform_GetCpuCount();
+}
+
+bool BatchAnalysis::open(const char* path, unsigned long long aFirstSeed, unsigned long long lastSeed)
+{
+    close();
+    if (lastSeed < aFirstSeed) {
+        return false;
+    }
+
+    firstSeed = aFirstSeed;
+    count = lastSeed - aFirstSeed + 1;
+    doneBits = new unsigned char[(size_t)((count + 7) / 8)];
+    memset(doneBits, 0, (size_t)((count + 7) / 8));
+    resumed = Stats();
+
+    // Step #1: continue an existing run of the same range
+    file = fopen(path, "r+b");
+    if (file != NULL_PTR)
+    {
+        unsigned long long fileFirstSeed, fileCount;
+        if (ReadHeader(file, &fileFirstSeed, &fileCount) == false || fileFirstSeed != firstSeed || fileCount != count)
+        {
+            close();
+            return false;
+        }
+
+        unsigned char chunk[RECORD_SIZE * 1024];
+        unsigned long long n = 0;
+        while (n < count)
+        {
+            size_t read = fread(chunk, RECORD_SIZE, sizeof(chunk) / RECORD_SIZE, file);
+            if (read == 0) {
+                break;
+            }
+            for (size_t i=0; i<read && n<count; i++, n++)
+            {
+                Record record;
+                decodeRecord(chunk + i*RECORD_SIZE, &record);
+                if (record.status != STATUS_NONE)
+                {
+                    doneBits[n / 8] |= (unsigned char)(1 << (n % 8));
+                    countRecord(resumed, record);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Step #2: start a new one, records of seeds not analysed yet stay zero
+    file = fopen(path, "w+b");
+    if (file == NULL_PTR)
+    {
+        close();
+        return false;
+    }
+
+    unsigned char header[HEADER_SIZE] = {0};
+    memcpy(header, MAGIC, 8);
+    putU32(header+8, VERSION);
+    putU32(header+12, RECORD_SIZE);
+    putU64(header+16, firstSeed);
+    putU64(header+24, count);
+
+    unsigned char zero = 0;
+    bool ok = fwrite(header, HEADER_SIZE, 1, file) == 1
+        && seekTo(file, HEADER_SIZE + count*RECORD_SIZE - 1)
+        && fwrite(&zero, 1, 1, file) == 1
+        && fflush(file) == 0;
+    if (ok == false) {
+        close();
+    }
+    return ok;
+}
+
+void BatchAnalysis::run(bool printProgress)
+{
+    if (file == NULL_PTR) {
+        return;
+    }
+
+    // Step #1: give every thread an equal share of the range
+    delete[] workers;
+    workers = new Worker[threadCount];
+    unsigned long long share = count / threadCount;
+    unsigned long long extra = count % threadCount;
+    for (int i=0; i<threadCount; i++)
+    {
+        Worker& worker = workers[i];
+        worker.owner = this;
+        worker.next = share*i + (i < (int)extra ? i : extra);
+        worker.end = worker.next + share + (i < (int)extra ? 1 : 0);
+        worker.gameState = new GameState();
+        worker.solver.init(maxNodes, hashSizeMb);
+    }
+
+    double start = Platform_GetTime();
+    for (int i=0; i<threadCount; i++) {
+        workers[i].thread.start(workerMain, &workers[i]);
+    }
+
+    // Step #2: flush the file every now and then, so that an interrupted
+    // run loses only the records that are still buffered by the threads
+    double lastCheckpoint = start;
+    bool finished = false;
+    while (finished == false)
+    {
+        Platform_Sleep(100);
+        runSeconds = Platform_GetTime() - start;
+
+        finished = true;
+        for (int i=0; i<threadCount; i++) {
+            finished = finished && workers[i].finished;
+        }
+
+        if (finished || Platform_GetTime() - lastCheckpoint >= CHECKPOINT_MS / 1000.0)
+        {
+            {
+                ScopedLock lock(fileMutex);
+                fflush(file);
+            }
+            lastCheckpoint = Platform_GetTime();
+
+            if (printProgress)
+            {
+                Stats stats = getStats();
+                fprintf(stderr, "\r%lld/%lld seeds, %.0f seeds/s   ",
+                    stats.done,
+                    stats.total,
+                    runSeconds > 0.0 ? (stats.done - resumed.done) / runSeconds : 0.0);
+            }
+        }
+    }
+
+    for (int i=0; i<threadCount; i++) {
+        workers[i].thread.join();
+    }
+    if (printProgress) {
+        fputc('\n', stderr);
+    }
+}
+
+void BatchAnalysis::close()
+{
+    delete[] workers;
+    workers = NULL_PTR;
+
+    if (file != NULL_PTR)
+    {
+        fclose(file);
+        file = NULL_PTR;
+    }
+
+    delete[] doneBits;
+    doneBits = NULL_PTR;
+}
+
+BatchAnalysis::Stats BatchAnalysis::getStats()
+{
+    Stats stats = resumed;
+    stats.total = (long long)count;
+    stats.seconds = runSeconds;
+
+    if (workers != NULL_PTR)
+    {
+        for (int i=0; i<threadCount; i++)
+        {
+            ScopedLock lock(workers[i].mutex);
+            const Stats& w = workers[i].stats;
+            stats.done += w.done;
+            stats.solved += w.solved;
+            stats.unsolvable += w.unsolvable;
+            stats.aborted += w.aborted;
+            stats.steals += w.steals;
+        }
+    }
+    return stats;
+}
+
+bool BatchAnalysis::ReadRecords(const char* path, RecordFunc func, void* arg)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == NULL_PTR) {
+        return false;
+    }
+
+    unsigned long long seed, count;
+    if (ReadHeader(f, &seed, &count) == false)
+    {
+        fclose(f);
+        return false;
+    }
+
+    unsigned char chunk[RECORD_SIZE * 1024];
+    unsigned long long n = 0;
+    while (n < count)
+    {
+        size_t read = fread(chunk, RECORD_SIZE, sizeof(chunk) / RECORD_SIZE, f);
+        if (read == 0) {
+            break;
+        }
+        for (size_t i=0; i<read && n<count; i++, n++)
+        {
+            Record record;
+            decodeRecord(chunk + i*RECORD_SIZE, &record);
+            if (record.status == STATUS_NONE || record.status > STATUS_ABORTED) {
+                continue;
+            }
+            func(seed + n, record, arg);
+        }
+    }
+
+    fclose(f);
+    return n == count;
+}
+
+static void printCsvRecord(unsigned long long seed, const BatchAnalysis::Record& record, void* arg)
+{
+    static const char* STATUS_NAMES[] = {"", "solved", "unsolvable", "aborted"};
+    fprintf((FILE*)arg, "%llu,%s,%d,%u,%u\n",
+        seed,
+        STATUS_NAMES[record.status],
+        record.moves,
+        record.nodes,
+        record.micros);
+}
+
+bool BatchAnalysis::ExportCsv(const char* path, FILE* out)
+{
+    fprintf(out, "seed,result,moves,nodes,micros\n");
+    return ReadRecords(path, printCsvRecord, out);
+}
+
+namespace {
+
+struct IndexWriter
+{
+    static const int BUFFER_RECORDS = 4096;
+
+    FILE* out;
+    bool anySeed;
+    unsigned long long firstSeed;
+    unsigned long long lastSeed;
+    unsigned long long counts[DifficultyIndex::TIER_COUNT];
+    unsigned long long written[DifficultyIndex::TIER_COUNT];
+    unsigned char buffers[DifficultyIndex::TIER_COUNT][DifficultyIndex::RECORD_SIZE * BUFFER_RECORDS];
+    int buffered[DifficultyIndex::TIER_COUNT];
+    bool ok;
+};
+
+void countTier(unsigned long long seed, const BatchAnalysis::Record& record, void* arg)
+{
+    IndexWriter* writer = (IndexWriter*)arg;
+    if (record.status == BatchAnalysis::STATUS_SOLVED)
+    {
+        if (writer->anySeed == false)
+        {
+            writer->firstSeed = seed;
+            writer->anySeed = true;
+        }
+        writer->lastSeed = seed;
+        writer->counts[DifficultyIndex::Classify(record.nodes)]++;
+    }
+}
+
+void flushTier(IndexWriter* writer, int tier)
+{
+    // Tiers follow each other in the file, every one in seed order
+    unsigned long long n = writer->written[tier];
+    for (int i=0; i<tier; i++) {
+        n += writer->counts[i];
+    }
+
+    int count = writer->buffered[tier];
+    writer->ok = writer->ok
+        && seekTo(writer->out, DifficultyIndex::HEADER_SIZE + n * DifficultyIndex::RECORD_SIZE)
+        && fwrite(writer->buffers[tier], DifficultyIndex::RECORD_SIZE, count, writer->out) == (size_t)count;
+    writer->written[tier] += count;
+    writer->buffered[tier] = 0;
+}
+
+void writeTier(unsigned long long seed, const BatchAnalysis::Record& record, void* arg)
+{
+    IndexWriter* writer = (IndexWriter*)arg;
+    if (record.status != BatchAnalysis::STATUS_SOLVED) {
+        return;
+    }
+
+    DifficultyIndex::Entry entry;
+    entry.seed = seed;
+    entry.nodes = record.nodes;
+    entry.moves = record.moves;
+    entry.tier = DifficultyIndex::Classify(record.nodes);
+
+    int& buffered = writer->buffered[entry.tier];
+    DifficultyIndex::EncodeEntry(entry, writer->firstSeed, writer->buffers[entry.tier] + buffered * DifficultyIndex::RECORD_SIZE);
+    if (++buffered == IndexWriter::BUFFER_RECORDS) {
+        flushTier(writer, entry.tier);
+    }
+}
+
+}  // anonymous namespace
+
+bool BatchAnalysis::ExportIndex(const char* path, const char* indexPath, unsigned long long* tierCounts)
+{
+    IndexWriter* writer = new IndexWriter();
+    memset(writer, 0, sizeof(IndexWriter));
+    writer->ok = true;
+
+    // Step #1: count the seeds of every tier to know where they go
+    bool ok = ReadRecords(path, countTier, writer);
+
+    ok = ok && writer->lastSeed - writer->firstSeed < DifficultyIndex::MAX_SEEDS;
+    FILE* out = ok ? fopen(indexPath, "wb") : NULL_PTR;
+    if (out == NULL_PTR)
+    {
+        delete writer;
+        return false;
+    }
+
+    // Step #2: write the records of each tier to its own part of the file
+
+    unsigned char header[DifficultyIndex::HEADER_SIZE];
+    DifficultyIndex::EncodeHeader(writer->firstSeed, writer->counts, header);
+    writer->out = out;
+    writer->ok = fwrite(header, sizeof(header), 1, out) == 1;
+
+    ok = ReadRecords(path, writeTier, writer);
+    for (int i=0; i<DifficultyIndex::TIER_COUNT; i++)
+    {
+        flushTier(writer, i);
+        ok = ok && writer->written[i] == writer->counts[i];
+        tierCounts[i] = writer->counts[i];
+    }
+
+    ok = fclose(out) == 0 && ok && writer->ok;
+    delete writer;
+    return ok;
+}
+
+void BatchAnalysis::workerMain(void* arg)
+{
+    Worker* worker = (Worker*)arg;
+    worker->owner->runWorker(*worker);
+}
+
+void BatchAnalysis::runWorker(Worker& worker)
+{
+    while (true)
+    {
+        unsigned long long n;
+        if (takeSeed(worker, &n) == false)
+        {
+            if (stealSeeds(worker)) {
+                continue;
+            }
+            break;
+        }
+        if (isDone(n)) {
+            continue;
+        }
+
+        worker.gameState->init(GameDeal::FromSeed(firstSeed + n));
+        double start = Platform_GetTime();
+        Solver::Result result = worker.solver.solve(*worker.gameState);
+        double seconds = Platform_GetTime() - start;
+
+        Record record;
+        record.status = STATUS_SOLVED + result;
+        record.moves = result == Solver::RESULT_SOLVED ? worker.solver.getSolutionLength() : 0;
+        record.nodes = saturate((double)worker.solver.getStats().nodes);
+        record.micros = saturate(seconds * 1000000.0);
+
+        if (worker.bufferCount == BUFFER_RECORDS || (worker.bufferCount > 0 && worker.bufferStart + worker.bufferCount != n)) {
+            flushRecords(worker);
+        }
+        if (worker.bufferCount == 0) {
+            worker.bufferStart = n;
+        }
+        worker.buffer[worker.bufferCount++] = record;
+
+        ScopedLock lock(worker.mutex);
+        countRecord(worker.stats, record);
+    }
+
+    flushRecords(worker);
+    worker.finished = true;
+}
+
+bool BatchAnalysis::takeSeed(Worker& worker, unsigned long long* n)
+{
+    ScopedLock lock(worker.mutex);
+    if (worker.next == worker.end) {
+        return false;
+    }
+
+    *n = worker.next++;
+    return true;
+}
+
+bool BatchAnalysis::stealSeeds(Worker& worker)
+{
+    // Step #1: find the thread with the most seeds left
+    Worker* victim = NULL_PTR;
+    unsigned long long most = 0;
+    for (int i=0; i<threadCount; i++)
+    {
+        Worker& other = workers[i];
+        if (&other == &worker) {
+            continue;
+        }
+
+        ScopedLock lock(other.mutex);
+        if (other.end - other.next > most)
+        {
+            most = other.end - other.next;
+            victim = &other;
+        }
+    }
+
+    if (victim == NULL_PTR) {
+        return false;
+    }
+
+    // Step #2: take the upper half of what it has left by now
+    unsigned long long next, end;
+    {
+        ScopedLock lock(victim->mutex);
+        next = victim->next + (victim->end - victim->next) / 2;
+        end = victim->end;
+        victim->end = next;
+    }
+
+    ScopedLock lock(worker.mutex);
+    worker.next = next;
+    worker.end = end;
+    worker.stats.steals++;
+    return true;
+}
+
+void BatchAnalysis::flushRecords(Worker& worker)
+{
+    if (worker.bufferCount == 0) {
+        return;
+    }
+
+    unsigned char data[RECORD_SIZE * BUFFER_RECORDS];
+    for (int i=0; i<worker.bufferCount; i++) {
+        encodeRecord(worker.buffer[i], data + i*RECORD_SIZE);
+    }
+
+    {
+        ScopedLock lock(fileMutex);
+        if (seekTo(file, HEADER_SIZE + worker.bufferStart*RECORD_SIZE)) {
+            fwrite(data, RECORD_SIZE, worker.bufferCount, file);
+        }
+    }
+    worker.bufferCount = 0;
+}
+
+bool BatchAnalysis::isDone(unsigned long long n) const
+{
+    return (doneBits[n / 8] & (1 << (n % 8))) != 0;
+}
+
+bool BatchAnalysis::ReadHeader(FILE* f, unsigned long long* firstSeed, unsigned long long* count)
+{
+    unsigned char header[HEADER_SIZE];
+    if (seekTo(f, 0) == false || fread(header, HEADER_SIZE, 1, f) != 1) {
+        return false;
+    }
+    if (memcmp(header, MAGIC, 8) != 0 || getU32(header+8) != (unsigned int)VERSION || getU32(header+12) != (unsigned int)RECORD_SIZE) {
+        return false;
+    }
+
+    *firstSeed = getU64(header+16);
+    *count = getU64(header+24);
+    return true;
+}
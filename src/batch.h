@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "model.h"
+#include "platform.h"
+#include "solver.h"
+
+// Solves every deal of a seed range (see GameDeal::FromSeed) on all cores.
+// Results go to a file of fixed size records, one per seed, which doubles as
+// a checkpoint: opening an existing file for the same range continues with
+// the seeds that have no result yet.
+//
+// Every thread starts with an equal share of the range. A thread that runs
+// out of seeds takes the upper half of the largest remaining share, so a
+// few hard deals never keep the other threads waiting.
+class BatchAnalysis
+{
+public:
+    enum Status
+    {
+        STATUS_NONE = 0,
+        STATUS_SOLVED,
+        STATUS_UNSOLVABLE,
+        STATUS_ABORTED,
+    };
+
+    struct Record
+    {
+        int status;
+        int moves;
+        unsigned int nodes;
+        unsigned int micros;
+
+        Record();
+    };
+
+    struct Stats
+    {
+        long long total;
+        long long done;
+        long long solved;
+        long long unsolvable;
+        long long aborted;
+        long long steals;
+        double seconds;
+
+        Stats();
+    };
+
+    BatchAnalysis();
+    ~BatchAnalysis();
+
+    void init(long long maxNodes, int hashSizeMb, int threadCount);
+    bool open(const char* path, unsigned long long firstSeed, unsigned long long lastSeed);
+    void run(bool printProgress);
+    void close();
+
+    Stats getStats();
+
+    // Calls func for every analysed seed of a batch file in seed order
+    typedef void (*RecordFunc)(unsigned long long seed, const Record& record, void* arg);
+    static bool ReadRecords(const char* path, RecordFunc func, void* arg);
+
+    // Prints "seed,result,moves,nodes,micros" lines for all analysed seeds
+    static bool ExportCsv(const char* path, FILE* out);
+
+    // Writes the solved seeds to a DifficultyIndex file, tierCounts gets the
+    // number of seeds in every tier
+    static bool ExportIndex(const char* path, const char* indexPath, unsigned long long* tierCounts);
+
+private:
+    static const int HEADER_SIZE = 32;
+    static const int RECORD_SIZE = 12;
+    static const int VERSION = 1;
+    static const int BUFFER_RECORDS = 64;
+    static const int CHECKPOINT_MS = 2000;
+
+    struct Worker
+    {
+        BatchAnalysis* owner;
+        Thread thread;
+
+        // Seeds [next, end) relative to firstSeed are still to be taken
+        Mutex mutex;
+        unsigned long long next;
+        unsigned long long end;
+
+        GameState* gameState;
+        Solver solver;
+
+        Record buffer[BUFFER_RECORDS];
+        unsigned long long bufferStart;
+        int bufferCount;
+
+        Stats stats;
+        volatile bool finished;
+
+        Worker();
+        ~Worker();
+    };
+
+    static void workerMain(void* arg);
+    void runWorker(Worker& worker);
+    bool takeSeed(Worker& worker, unsigned long long* n);
+    bool stealSeeds(Worker& worker);
+    void flushRecords(Worker& worker);
+
+    bool isDone(unsigned long long n) const;
+    static bool ReadHeader(FILE* f, unsigned long long* firstSeed, unsigned long long* count);
+
+    long long maxNodes;
+    int hashSizeMb;
+    int threadCount;
+
+    FILE* file;
+    Mutex fileMutex;
+    unsigned long long firstSeed;
+    unsigned long long count;
+    unsigned char* doneBits;
+    Stats resumed;
+
+    Worker* workers;
+    double runSeconds;
+
+    BatchAnalysis(const BatchAnalysis&);
+    BatchAnalysis& operator=(const BatchAnalysis&);
+};
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "controller.h"
 
 static float getDistSqr(float x1, float y1, float x2, float y2)
@@ -299,6 +301,7 @@ void Input::init(SysAPI* aSys)
     right.reset();
     back.reset();
     fwrd.reset();
+    middle.reset();
 
     x = y = 0.f;
     dragStart = dragActive = dragEnd = false;
@@ -320,6 +323,7 @@ void Input::update()
     right.update((mbs & MOUSE_BUTTON_RIGHT)!= 0, x, y);
     back.update( (mbs & MOUSE_BUTTON_BACK) != 0, x, y);
     fwrd.update( (mbs & MOUSE_BUTTON_FWRD) != 0, x, y);
+    middle.update((mbs & MOUSE_BUTTON_MIDDLE) != 0, x, y);
 
     dragEnd = left.pressed == false && dragActive;
     dragStart = left.pressed 
@@ -337,6 +341,15 @@ void Input::update()
     oldY = y;
 }
 
+int Input::getButtons() const
+{
+    return (left.pressed ? MOUSE_BUTTON_LEFT : 0)
+        | (right.pressed ? MOUSE_BUTTON_RIGHT : 0)
+        | (back.pressed ? MOUSE_BUTTON_BACK : 0)
+        | (fwrd.pressed ? MOUSE_BUTTON_FWRD : 0)
+        | (middle.pressed ? MOUSE_BUTTON_MIDDLE : 0);
+}
+
 CardDesc::CardDesc(): id(-1), z(0), opened(false)
 {
 }
@@ -430,6 +443,56 @@ CardDesc& GameLayout::getOrderedCard(int ordinal)
     return cardDescs[orderedIds[ordinal]];
 }
 
+void GameLayout::save(SnapshotBuffer* buffer) const
+{
+    for (int i=0; i<CARDS_TOTAL; i++)
+    {
+        const CardDesc& cd = cardDescs[i];
+        buffer->putInt(cd.z);
+        buffer->putInt(cd.opened ? 1 : 0);
+        buffer->putFloat(cd.screenRect.x);
+        buffer->putFloat(cd.screenRect.y);
+        buffer->putFloat(cd.screenRect.w);
+        buffer->putFloat(cd.screenRect.h);
+    }
+    buffer->putBytes(orderedIds, sizeof(orderedIds));
+    buffer->putInt(curZ);
+    buffer->putInt(normalized ? 1 : 0);
+    buffer->putFloat(oldX);
+    buffer->putFloat(oldY);
+}
+
+bool GameLayout::load(SnapshotBuffer* buffer)
+{
+    bool ok = true;
+    for (int i=0; i<CARDS_TOTAL; i++)
+    {
+        CardDesc& cd = cardDescs[i];
+        cd.id = i;
+        cd.z = buffer->getInt();
+        cd.opened = buffer->getInt() != 0;
+        cd.screenRect.x = buffer->getFloat();
+        cd.screenRect.y = buffer->getFloat();
+        cd.screenRect.w = buffer->getFloat();
+        cd.screenRect.h = buffer->getFloat();
+        ok = ok && cd.z >= 0 && cd.z < MAX_Z;
+    }
+    buffer->getBytes(orderedIds, sizeof(orderedIds));
+    curZ = buffer->getInt();
+    normalized = buffer->getInt() != 0;
+    oldX = buffer->getFloat();
+    oldY = buffer->getFloat();
+
+    ok = ok && curZ >= 0 && curZ < MAX_Z;
+    for (int i=0; ok && i<CARDS_TOTAL; i++) {
+        ok = orderedIds[i] >= 0 && orderedIds[i] < CARDS_TOTAL;
+    }
+    if (ok == false) {
+        buffer->fail();
+    }
+    return buffer->failed() == false;
+}
+
 void GameLayout::init(GameState& aGameState, Layout& aLayout)
 {
     layout = &aLayout;
@@ -531,6 +594,26 @@ Event::Type Event::getType()
     return type;
 }
 
+void Event::save(SnapshotBuffer* buffer) const
+{
+    buffer->putInt(type);
+    buffer->putInt(delayLeft);
+    buffer->putInt(arg);
+}
+
+bool Event::load(SnapshotBuffer* buffer)
+{
+    type = (Type)buffer->getInt();
+    delayLeft = buffer->getInt();
+    arg = buffer->getInt();
+
+    bool hasCard = type == Event::RAISE_Z || type == Event::TURN_CARD;
+    if (type < Event::RAISE_Z || type > Event::DO_START_ANIMATION || (hasCard && (arg < 0 || arg >= CARDS_TOTAL))) {
+        buffer->fail();
+    }
+    return buffer->failed() == false;
+}
+
 Tween::Tween(): receiver(NULL_PTR), ticksLeft(0), backTicksLeft(0), delayLeft(0)
 {
 }
@@ -577,6 +660,40 @@ bool Tween::finished()
     return ticksLeft == 0 && delayLeft == 0 && backTicksLeft == 0;
 }
 
+void Tween::save(SnapshotBuffer* buffer, const void* base) const
+{
+    buffer->putInt(curveType);
+    buffer->putInt(ticksLeft);
+    buffer->putInt(backTicksLeft);
+    buffer->putInt(delayLeft);
+    buffer->putInt((int)((const char*)receiver - (const char*)base));
+    buffer->putFloat(delta);
+    buffer->putFloat(step);
+    buffer->putFloat(accumulatedStep);
+    buffer->putFloat(lastValue);
+}
+
+bool Tween::load(SnapshotBuffer* buffer, void* base, int baseSize)
+{
+    curveType = (CurveType)buffer->getInt();
+    ticksLeft = buffer->getInt();
+    backTicksLeft = buffer->getInt();
+    delayLeft = buffer->getInt();
+    int offset = buffer->getInt();
+    delta = buffer->getFloat();
+    step = buffer->getFloat();
+    accumulatedStep = buffer->getFloat();
+    lastValue = buffer->getFloat();
+
+    bool ok = curveType >= Tween::CURVE_LINEAR && curveType <= Tween::CURVE_SMOOTH2
+        && offset >= 0 && offset <= baseSize - (int)sizeof(float) && offset % sizeof(float) == 0;
+    if (ok == false) {
+        buffer->fail();
+    }
+    receiver = ok ? (float*)((char*)base + offset) : NULL_PTR;
+    return buffer->failed() == false;
+}
+
 float Tween::curve(Tween::CurveType type, float x)
 {
     switch (type)
@@ -662,6 +779,25 @@ void ButtonDesc::setState(ButtonDesc::ButtonState aState)
     state = aState;
 }
 
+void ButtonDesc::save(SnapshotBuffer* buffer) const
+{
+    buffer->putInt(state);
+    buffer->putInt((isVisible ? 1 : 0) | (isEnabled ? 2 : 0));
+}
+
+bool ButtonDesc::load(SnapshotBuffer* buffer)
+{
+    state = (ButtonState)buffer->getInt();
+    int flags = buffer->getInt();
+    isVisible = (flags & 1) != 0;
+    isEnabled = (flags & 2) != 0;
+
+    if (state < ButtonDesc::STATE_NORMAL || state > ButtonDesc::STATE_DISABLED) {
+        buffer->fail();
+    }
+    return buffer->failed() == false;
+}
+
 WidgetLayout::WidgetLayout()
 {
 }
@@ -712,13 +848,200 @@ WidgetLayout::ButtonType WidgetLayout::probe(float x, float y)
     return BUTTON_MAX;
 }
 
-Commander::Commander(): gameState(NULL_PTR)
+Commander::Commander()
+    : gameState(NULL_PTR)
+    , dealQueue(NULL_PTR)
+    , dealSource(NULL_PTR)
+    , dealSourceArg(NULL_PTR)
+    , hintEngine(NULL_PTR)
+    , hintWanted(false)
+    , hintHash(0)
+    , sessionPath(NULL_PTR)
+    , journalPath(NULL_PTR)
+{
+}
+
+bool Commander::recordReplays(const char* path)
+{
+    return replayWriter.open(path);
+}
+
+static const char SESSION_MAGIC[8] = "XNYSESS";
+static const int SESSION_VERSION = 2;
+
+void Commander::saveSession(SnapshotBuffer* buffer)
+{
+    buffer->clear();
+    buffer->putBytes(SESSION_MAGIC, sizeof(SESSION_MAGIC));
+    buffer->putInt(SESSION_VERSION);
+    gameState->save(buffer);
+
+    // Layout at the size it was, a resize after loading moves it on
+    buffer->putFloat(layout.getGameWidth());
+    buffer->putFloat(layout.getGameHeight());
+    gameLayout.save(buffer);
+    for (int i=0; i<WidgetLayout::BUTTON_MAX; i++) {
+        widgetLayout.buttons[i].save(buffer);
+    }
+
+    buffer->putInt(startMoveOn ? 1 : 0);
+    buffer->putInt(startAnimationOn ? 1 : 0);
+    buffer->putInt(autoPlayOn ? 1 : 0);
+    buffer->putInt(autoCollectOn ? 1 : 0);
+    buffer->putInt(stockLock ? 1 : 0);
+    buffer->putBytes(cardLock, sizeof(cardLock));
+
+    buffer->putInt(tweens.size());
+    for (int i=0; i<tweens.size(); i++) {
+        tweens[i].save(buffer, &gameLayout);
+    }
+    buffer->putInt(events.size());
+    for (int i=0; i<events.size(); i++) {
+        events[i].save(buffer);
+    }
+    buffer->putChecksum();
+}
+
+bool Commander::loadSession(SnapshotBuffer* buffer)
+{
+    cancelHint();
+    buffer->rewind();
+
+    // Step #1: the game, from a file that is whole
+
+    char magic[sizeof(SESSION_MAGIC)];
+    buffer->getBytes(magic, sizeof(magic));
+    if (buffer->checksumMatches() == false || memcmp(magic, SESSION_MAGIC, sizeof(magic)) != 0 || buffer->getInt() != SESSION_VERSION
+        || gameState->load(buffer) == false)
+    {
+        cmdNew();
+        return false;
+    }
+
+    // Step #2: the screen as it was
+
+    int width = (int)buffer->getFloat();
+    int height = (int)buffer->getFloat();
+    layout.setGameSize(width, height);
+    widgetLayout.init(layout);
+    gameLayout.load(buffer);
+    for (int i=0; i<WidgetLayout::BUTTON_MAX; i++) {
+        widgetLayout.buttons[i].load(buffer);
+    }
+
+    startMoveOn = buffer->getInt() != 0;
+    startAnimationOn = buffer->getInt() != 0;
+    autoPlayOn = buffer->getInt() != 0;
+    autoCollectOn = buffer->getInt() != 0;
+    stockLock = buffer->getInt() != 0;
+    buffer->getBytes(cardLock, sizeof(cardLock));
+
+    // Step #3: animations, every one of them moves something of gameLayout
+
+    tweens.clear();
+    int count = buffer->getInt();
+    for (int i=0; i<count && buffer->failed() == false; i++)
+    {
+        Tween tween;
+        if (tweens.size() == TWEENS_MAX) {
+            buffer->fail();
+        } else if (tween.load(buffer, &gameLayout, sizeof(gameLayout))) {
+            tweens.push(tween);
+        }
+    }
+    events.clear();
+    count = buffer->getInt();
+    for (int i=0; i<count && buffer->failed() == false; i++)
+    {
+        Event event;
+        if (events.size() == EVENTS_MAX) {
+            buffer->fail();
+        } else if (event.load(buffer)) {
+            events.push(event);
+        }
+    }
+
+    if (buffer->failed())
+    {
+        cmdNew();
+        return false;
+    }
+    replayWriter.endGame();
+    deadEndDetector.init(gameState, DEAD_END_MICROS_PER_TICK);
+    return true;
+}
+
+bool Commander::keepSession(const char* aSessionPath, const char* aJournalPath)
+{
+    sessionPath = aSessionPath;
+    journalPath = aJournalPath;
+    bool resumed = false;
+    if (sessionBuffer.loadFile(sessionPath))
+    {
+        unsigned long long checksum = MoveJournal::Checksum(sessionBuffer);
+        resumed = loadSession(&sessionBuffer);
+
+        // The moves made after the save, without writing them again
+        int records = 0;
+        if (resumed)
+        {
+            gameState->setHistoryListener(NULL_PTR, NULL_PTR);
+            MoveJournal::Recover(journalPath, checksum, gameState, &records);
+            gameState->setHistoryListener(OnHistoryEvent, this);
+        }
+
+        // The animations of the saved moment don't fit the position now
+        if (records > 0)
+        {
+            startMoveOn = false;
+            startAnimationOn = false;
+            autoPlayOn = false;
+            gameLayout.oldX = 0.f;
+            gameLayout.oldY = 0.f;
+            resetGameLayout();
+            clearControlButtons();
+            deadEndDetector.init(gameState, DEAD_END_MICROS_PER_TICK);
+        }
+    }
+    storeSession();
+    return resumed;
+}
+
+void Commander::storeSession()
+{
+    if (sessionPath == NULL_PTR) {
+        return;
+    }
+
+    // A failed save leaves the journal of the file before going on
+    saveSession(&sessionBuffer);
+    if (sessionBuffer.saveFile(sessionPath)) {
+        journal.open(journalPath, MoveJournal::Checksum(sessionBuffer), JOURNAL_SYNC_MS);
+    }
+}
+
+void Commander::OnHistoryEvent(const HistoryEvent& event, void* arg)
 {
+    Commander* commander = (Commander*)arg;
+    ReplayWriter::OnHistoryEvent(event, &commander->replayWriter);
+    commander->journal.add(event);
+    commander->deadEndDetector.addEvent(event);
 }
 
-void Commander::init(GameState* aGameState)
+void Commander::setDealSource(DealSource func, void* arg)
+{
+    dealSource = func;
+    dealSourceArg = arg;
+}
+
+void Commander::init(GameState* aGameState, DealQueue* aDealQueue, HintEngine* aHintEngine)
 {
     gameState = aGameState;
+    dealQueue = aDealQueue;
+    hintEngine = aHintEngine;
+    gameState->history.setKeepBranches(KEEP_UNDO_BRANCHES);
+    gameState->setHistoryListener(OnHistoryEvent, this);
+    deadEndDetector.init(gameState, DEAD_END_MICROS_PER_TICK);
 
     layout.init();
     widgetLayout.init(layout);
@@ -747,6 +1070,16 @@ bool Commander::gameEnded()
     return gameState->gameWon() && events.empty() && tweens.empty();
 }
 
+bool Commander::noMovesLeft()
+{
+    return deadEndDetector.getStatus() == DeadEndDetector::STATUS_DEAD_END;
+}
+
+const DeadEndDetector::Stats& Commander::getDeadEndStats()
+{
+    return deadEndDetector.getStats();
+}
+
 void Commander::handleInput(Input& input)
 {
     if (gameEnded() || autoPlaying()) 
@@ -774,7 +1107,11 @@ void Commander::handleInputForGame(Input& input)
         y = input.left.pressY;
     }
 
-    if (input.left.clicked && input.dragEnd == false) {
+    // Cards in hand with no drag going on, as after a session was loaded
+    // in the middle of one, go where they would have been dropped
+    if (gameState->hand.empty() == false && input.dragActive == false && input.dragEnd == false) {
+        cmdReleaseHand();
+    } else if (input.left.clicked && input.dragEnd == false) {
         cmdAutoClick(x, y);
     } else if (input.dragStart) {
         cmdPickHand(x, y);
@@ -788,6 +1125,8 @@ void Commander::handleInputForGame(Input& input)
         && input.fwrd.pressed == false)
     {
         cmdAdvanceStock();
+    } else if (input.middle.clicked && input.left.pressed == false) {
+        cmdHint();
     }
 }
 
@@ -817,6 +1156,11 @@ void Commander::handleInputForButtons(Input& input)
                 : ButtonDesc::STATE_NORMAL);
         }
     }
+
+    // Nothing left to play, point the player to a new game
+    if (focusButton != WidgetLayout::BUTTON_NEW && noMovesLeft()) {
+        widgetLayout.buttons[WidgetLayout::BUTTON_NEW].setState(ButtonDesc::STATE_HOVER);
+    }
     
     if (input.left.clicked && focusButton != WidgetLayout::BUTTON_MAX)
     {
@@ -941,6 +1285,79 @@ void Commander::updateEvents()
 void Commander::update()
 {
     updateEvents();
+    updateAutoCollect();
+    updateHint();
+    deadEndDetector.update();
+
+    journal.update();
+    if (journal.getRecordCount() >= JOURNAL_RECORDS_PER_SAVE) {
+        storeSession();
+    }
+}
+
+HintEngine::Hint Commander::getHint()
+{
+    if (hintEngine == NULL_PTR || hintHash != gameState->getHash()) {
+        return HintEngine::Hint();
+    }
+    return hintEngine->getHint();
+}
+
+void Commander::updateHint()
+{
+    if (hintWanted == false) {
+        return;
+    }
+
+    // The player moved on before the answer came
+    if (hintHash != gameState->getHash())
+    {
+        cancelHint();
+        return;
+    }
+
+    HintEngine::Hint hint = hintEngine->getHint();
+    if (hint.status == HintEngine::STATUS_SEARCHING) {
+        return;
+    }
+
+    hintWanted = false;
+    if (hint.status == HintEngine::STATUS_FOUND && gameState->hand.empty()) {
+        addHintAnimation(hint.move);
+    }
+}
+
+void Commander::cancelHint()
+{
+    hintWanted = false;
+    if (hintEngine != NULL_PTR) {
+        hintEngine->cancel();
+    }
+}
+
+void Commander::updateAutoCollect()
+{
+    // One card at a time once the last one has landed. Taking moves back
+    // turns it off until the player moves again, or the card would come
+    // right back.
+    if (AUTO_COLLECT == false || autoCollectOn == false || autoPlaying() || starting() || movingScreen()) {
+        return;
+    }
+    if (gameState->hand.empty() == false || tweens.empty() == false || events.empty() == false) {
+        return;
+    }
+
+    CardStack* destStack = NULL_PTR;
+    CardStack* src = gameState->findSafeCollect(&destStack);
+    if (src == NULL_PTR) {
+        return;
+    }
+
+    gameState->fillHand(src, src->size()-1);
+    raiseHand();
+    addHandMovementAnimation(destStack);
+    gameState->releaseHand(destStack);
+    clearControlButtons();
 }
 
 void Commander::resize(int width, int height)
@@ -1081,35 +1498,55 @@ void Commander::resetGameLayout()
 
 void Commander::cmdUndo()
 {
+    cancelHint();
+    autoCollectOn = false;
     gameState->undo();
     resetGameLayout();
 }
 
 void Commander::cmdRedo()
 {
+    cancelHint();
+    autoCollectOn = false;
     gameState->redo();
     resetGameLayout();
 }
 
 void Commander::cmdFullUndo()
 {
+    cancelHint();
+    autoCollectOn = false;
     gameState->fullUndo();
     resetGameLayout();
 }
 
 void Commander::cmdFullRedo()
 {
+    cancelHint();
+    autoCollectOn = false;
     gameState->fullRedo();
     resetGameLayout();
 }
 
 void Commander::cmdNew()
 {
+    cancelHint();
     autoPlayOn = false;
-    gameState->init();
+    autoCollectOn = true;
+    if (dealSource != NULL_PTR) {
+        gameState->init(dealSource(dealSourceArg));
+    } else if (dealQueue != NULL_PTR) {
+        gameState->init(dealQueue->next());
+    } else {
+        gameState->init();
+    }
+    replayWriter.beginGame(*gameState);
     resetGameLayout();
     addStartAnimation();
     clearControlButtons();
+    if (journal.isOpen()) {
+        storeSession();
+    }
 }
 
 void Commander::cmdMoveToNew()
@@ -1129,6 +1566,7 @@ void Commander::cmdAdvanceStock()
     {
         addAdvanceStockAnimation();
         gameState->advanceStock();
+        autoCollectOn = true;
     }
 }
 
@@ -1197,31 +1635,25 @@ void Commander::cmdReleaseHand()
     float x = handRect.x + handRect.w / 2.f;
     float y = handRect.y + handRect.h / 2.f;
 
-    static const int LEN = 3;
-    CardStack* stacks[LEN] = {gameState->tableaux, gameState->foundations, &gameState->waste};
-    int sizes[LEN] = {TABLEAU_COUNT, FOUNDATION_COUNT, WASTE_COUNT};
+    unsigned int destMask = gameState->getHandDestMask() | (1u << gameState->getStackIndex(gameState->handSource));
 
-    for (int i=0; i<LEN; i++) {
-        for (int j=0; j<sizes[i]; j++)
+    for (; destMask != 0; destMask &= destMask - 1)
+    {
+        CardStack* destCandidate = gameState->getStack(Utils_LowestBit(destMask));
+        Rect destRect = gameLayout.getDestCardRect(destCandidate);
+        float destX = destRect.x + destRect.w/2.f;
+        float destY = destRect.y + destRect.h/2.f;
+        float dist = getVAdjustedDistSqr(x, y, destX, destY);
+        if (dist < layout.getCardHeight()*layout.getCardHeight() && (dist < bestDist || bestDist < 0.0))
         {
-            CardStack* destCandidate = &stacks[i][j]; 
-            if (destCandidate == gameState->handSource || gameState->canReleaseHand(destCandidate)) 
-            {
-                Rect destRect = gameLayout.getDestCardRect(destCandidate);
-                float destX = destRect.x + destRect.w/2.f;
-                float destY = destRect.y + destRect.h/2.f;
-                float dist = getVAdjustedDistSqr(x, y, destX, destY);
-                if (dist < layout.getCardHeight()*layout.getCardHeight() && (dist < bestDist || bestDist < 0.0))
-                {
-                    destStack = destCandidate;
-                    bestDist = dist;
-                }
-            }
+            destStack = destCandidate;
+            bestDist = dist;
         }
     }
 
     addHandMovementAnimation(destStack);
     gameState->releaseHand(destStack);
+    autoCollectOn = true;
 }
 
 void Commander::cmdAutoClick(float x, float y)
@@ -1242,6 +1674,7 @@ void Commander::cmdAutoClick(float x, float y)
         CardStack* destStack = gameState->findHandAutoDest();
         addHandMovementAnimation(destStack);
         gameState->releaseHand(destStack);
+        autoCollectOn = true;
     }
 }
 
@@ -1256,6 +1689,57 @@ void Commander::cmdAutoPlay()
     autoPlayOn = true;
 }
 
+void Commander::cmdHint()
+{
+    if (hintEngine == NULL_PTR || gameState->hand.empty() == false || gameState->gameWon()) {
+        return;
+    }
+
+    // Asking again for the same position shows the hint that is there
+    HintEngine::Hint hint = getHint();
+    if (hint.status == HintEngine::STATUS_IDLE)
+    {
+        hintHash = gameState->getHash();
+        hintEngine->request(*gameState);
+    }
+    hintWanted = true;
+}
+
+void Commander::addHintAnimation(const SolverMove& move)
+{
+    static const int HINT_TICKS = 12;
+    static const float HINT_DISTANCE = 0.3f;
+
+    CardStack* src = gameState->getStack(move.src);
+    CardStack* dst = gameState->getStack(move.dst);
+    if (move.isAdvance() && gameState->stock.empty())
+    {
+        src = &gameState->waste;
+        dst = &gameState->stock;
+    }
+    if (src->empty()) {
+        return;
+    }
+
+    int idx = move.isAdvance() ? src->size()-1 : move.idx;
+    Rect begR = gameLayout.cardDescs[(*src)[idx].id].screenRect;
+    Rect endR = move.isAdvance() ? gameLayout.getStackRect(dst) : gameLayout.getDestCardRect(dst);
+    float dx = (endR.x - begR.x) * HINT_DISTANCE;
+    float dy = (endR.y - begR.y) * HINT_DISTANCE;
+
+    for (int i=idx; i<src->size(); i++)
+    {
+        int cardId = (*src)[i].id;
+        if (cardLock[cardId]) {
+            continue;
+        }
+        gameLayout.raiseZ(cardId);
+        tweens.push(Tween(&gameLayout.cardDescs[cardId].screenRect.x, dx, Tween::CURVE_SIN, HINT_TICKS, 0, true));
+        tweens.push(Tween(&gameLayout.cardDescs[cardId].screenRect.y, dy, Tween::CURVE_SIN, HINT_TICKS, 0, true));
+        doMax(cardLock[cardId], HINT_TICKS*2 + 1);
+    }
+}
+
 void Commander::doAutoMove()
 {
     CardStack* src = NULL_PTR;
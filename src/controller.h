@@ -1,6 +1,10 @@
 #pragma once
 
+#include "dealer.h"
+#include "hints.h"
+#include "journal.h"
 #include "model.h"
+#include "replay.h"
 
 struct Rect
 {
@@ -118,6 +122,7 @@ public:
     MouseButton right;
     MouseButton back;
     MouseButton fwrd;
+    MouseButton middle;
 
     float x;
     float y;
@@ -133,6 +138,9 @@ public:
     void init(SysAPI* aSys);
     void update();
 
+    // MouseButtonState mask of the buttons held since the last update
+    int getButtons() const;
+
 private:
     float oldX;
     float oldY;
@@ -167,6 +175,9 @@ public:
     int getArg();
     Type getType();
 
+    void save(SnapshotBuffer* buffer) const;
+    bool load(SnapshotBuffer* buffer);
+
 private:
     int delayLeft;
     int arg;
@@ -188,6 +199,11 @@ public:
     explicit Tween(float* receiver, float delta, CurveType curveType, int ticks, int delay = 0, bool doRoundTrip = false);
     void update();
     bool finished();
+
+    // The receiver is saved as its offset from base, a block of baseSize
+    // bytes it has to lie in
+    void save(SnapshotBuffer* buffer, const void* base) const;
+    bool load(SnapshotBuffer* buffer, void* base, int baseSize);
 private:
     static float curve(CurveType curve, float x);
     static float curveLinear(float x);
@@ -235,6 +251,10 @@ public:
     Rect getStackRect(CardStack* stack);
     CardDesc& getOrderedCard(int ordinal);
 
+    // Rects, z-order and screen offsets; load() keeps the Layout
+    void save(SnapshotBuffer* buffer) const;
+    bool load(SnapshotBuffer* buffer);
+
     CardDesc cardDescs[CARDS_TOTAL];
 
     float oldX;
@@ -273,6 +293,10 @@ public:
     void setEnabled(bool aEnabled);
     void setState(ButtonState aState);
 
+    // State and flags, the rect comes from WidgetLayout::init()
+    void save(SnapshotBuffer* buffer) const;
+    bool load(SnapshotBuffer* buffer);
+
 private:
     ButtonState state;
     Rect rect;
@@ -301,11 +325,35 @@ public:
     ButtonDesc buttons[BUTTON_MAX];
 };
 
+// Number of the next deal to play, see Commander::setDealSource
+typedef unsigned long long (*DealSource)(void* arg);
+
 class Commander
 {
 public:
     Commander();
-    void init(GameState* aGameState);
+    void init(GameState* aGameState, DealQueue* aDealQueue, HintEngine* aHintEngine);
+
+    // Appends every game to a replay file (see replay.h), call before init()
+    bool recordReplays(const char* path);
+
+    // The whole session after init(): game, history, card layout and the
+    // animations under way. A session that doesn't load is replaced by a
+    // new game. Resumed games don't go to the replay file.
+    void saveSession(SnapshotBuffer* buffer);
+    bool loadSession(SnapshotBuffer* buffer);
+
+    // Keeps the session in a file from now on, saved at every deal, every
+    // JOURNAL_RECORDS_PER_SAVE records and by storeSession(), with the moves
+    // in between in a journal (see journal.h). The session the file had,
+    // with the moves of its journal, is resumed first; false when there
+    // was none. Call after init(), the paths are kept.
+    bool keepSession(const char* aSessionPath, const char* aJournalPath);
+    void storeSession();
+
+    // Asked for every deal instead of the DealQueue, set before init() to
+    // cover the first one too. NULL_PTR for none.
+    void setDealSource(DealSource func, void* arg);
     void handleInput(Input& input);
     void update();
     void resize(int width, int height);
@@ -315,6 +363,13 @@ public:
     bool starting();
     bool movingScreen();
 
+    // Set once no productive moves are left, see DeadEndDetector
+    bool noMovesLeft();
+    const DeadEndDetector::Stats& getDeadEndStats();
+
+    // Hint for the current position, never waits for the search
+    HintEngine::Hint getHint();
+
     Layout layout;
     WidgetLayout widgetLayout;
     GameLayout gameLayout;
@@ -323,6 +378,9 @@ private:
     void handleInputForGame(Input& input);
     void updateEvents();
 
+    // Every history event goes to the replay file and the journal
+    static void OnHistoryEvent(const HistoryEvent& event, void* arg);
+
     void cmdUndo();
     void cmdRedo();
     void cmdFullUndo();
@@ -336,6 +394,11 @@ private:
     void cmdReleaseHand();
     void cmdAutoClick(float x, float y);
     void cmdAutoPlay();
+    void cmdHint();
+
+    void updateHint();
+    void cancelHint();
+    void updateAutoCollect();
 
     void handleEvent(Event& event);
     void doAutoMove();
@@ -347,6 +410,7 @@ private:
     void addAdvanceStockAnimation();
     void addHandMovementAnimation(CardStack* dest);
     void addStartAnimation();
+    void addHintAnimation(const SolverMove& move);
 
     void moveAnimation(int cardId, Rect beg, Rect end, int ticks, bool slower = false, int delay=0);
     void turnAnimation(int cardId, int halfTicks, int delay);
@@ -356,11 +420,27 @@ private:
     bool startMoveOn;
     bool startAnimationOn;
     bool autoPlayOn;
+    bool autoCollectOn;
     bool stockLock;
     int cardLock[CARDS_TOTAL];
 
     GameState* gameState;
-    FixedVec<Tween, 256> tweens;
-    FixedVec<Event, 256> events;
-    FixedVec<Event, 256> eventsCopy;
+    DealQueue* dealQueue;
+    DealSource dealSource;
+    void* dealSourceArg;
+    HintEngine* hintEngine;
+    bool hintWanted;
+    unsigned long long hintHash;
+    DeadEndDetector deadEndDetector;
+    ReplayWriter replayWriter;
+    MoveJournal journal;
+    SnapshotBuffer sessionBuffer;
+    const char* sessionPath;
+    const char* journalPath;
+    static const int TWEENS_MAX = 256;
+    static const int EVENTS_MAX = 256;
+
+    FixedVec<Tween, TWEENS_MAX> tweens;
+    FixedVec<Event, EVENTS_MAX> events;
+    FixedVec<Event, EVENTS_MAX> eventsCopy;
 };
@@ -0,0 +1,170 @@
+#include "dealer.h"
+
+const double DealQueue::FALLBACK_SECONDS = 0.015;
+
+DealQueue::Stats::Stats()
+    : depth(0)
+    , checked(0)
+    , accepted(0)
+    , fallbacks(0)
+    , unchecked(0)
+    , indexed(0)
+    , checkSeconds(0.0)
+{
+}
+
+DealQueue::DealQueue()
+    : head(0)
+    , count(0)
+    , stopping(false)
+    , workerState(NULL_PTR)
+    , fallbackState(NULL_PTR)
+    , fallbackSolver(NULL_PTR)
+    , index(NULL_PTR)
+    , tier(0)
+    , indexRandom(0)
+{
+}
+
+DealQueue::~DealQueue()
+{
+    stop();
+    delete workerState;
+    delete fallbackState;
+    delete fallbackSolver;
+}
+
+void DealQueue::start()
+{
+    if (worker.started()) {
+        return;
+    }
+
+    if (workerState == NULL_PTR)
+    {
+        workerState = new GameState();
+        workerSolver.init(WORKER_MAX_NODES, WORKER_HASH_MB);
+    }
+
+    stopping = false;
+    worker.start(workerMain, this);
+}
+
+void DealQueue::stop()
+{
+    if (worker.started())
+    {
+        stopping = true;
+        wakeUp.set();
+        worker.join();
+    }
+}
+
+void DealQueue::useIndex(const DifficultyIndex* aIndex, int aTier)
+{
+    index = aIndex;
+    tier = aTier;
+    indexRandom = (unsigned long long)(Platform_GetTime() * 1000000.0);
+}
+
+unsigned long long DealQueue::next()
+{
+    unsigned long long dealNumber;
+    if (index != NULL_PTR && index->pickSeed(tier, &indexRandom, &dealNumber))
+    {
+        ScopedLock lock(mutex);
+        stats.indexed++;
+        return dealNumber;
+    }
+
+    if (pop(&dealNumber)) {
+        return dealNumber;
+    }
+
+    if (fallbackSolver == NULL_PTR)
+    {
+        fallbackState = new GameState();
+        fallbackSolver = new Solver();
+        fallbackSolver->init(FALLBACK_MAX_NODES, FALLBACK_HASH_MB);
+    }
+
+    double fallbackStart = Platform_GetTime();
+    for (int i=0; i<FALLBACK_ATTEMPTS && Platform_GetTime()-fallbackStart < FALLBACK_SECONDS; i++)
+    {
+        dealNumber = GameDeal::RandomNumber();
+        double start = Platform_GetTime();
+        fallbackState->init(dealNumber);
+        bool winnable = fallbackSolver->solve(*fallbackState) == Solver::RESULT_SOLVED;
+
+        ScopedLock lock(mutex);
+        stats.checkSeconds += Platform_GetTime() - start;
+        stats.checked++;
+        if (winnable)
+        {
+            stats.fallbacks++;
+            return dealNumber;
+        }
+    }
+
+    ScopedLock lock(mutex);
+    stats.unchecked++;
+    return dealNumber;
+}
+
+DealQueue::Stats DealQueue::getStats()
+{
+    ScopedLock lock(mutex);
+    stats.depth = count;
+    return stats;
+}
+
+void DealQueue::workerMain(void* arg)
+{
+    ((DealQueue*)arg)->run();
+}
+
+void DealQueue::run()
+{
+    while (stopping == false)
+    {
+        bool full = false;
+        {
+            ScopedLock lock(mutex);
+            full = count == CAPACITY;
+        }
+        if (full)
+        {
+            wakeUp.wait(1000);
+            continue;
+        }
+
+        unsigned long long dealNumber = GameDeal::RandomNumber();
+        double start = Platform_GetTime();
+        workerState->init(dealNumber);
+        bool winnable = workerSolver.solve(*workerState) == Solver::RESULT_SOLVED;
+
+        ScopedLock lock(mutex);
+        stats.checkSeconds += Platform_GetTime() - start;
+        stats.checked++;
+        if (winnable)
+        {
+            deals[(head + count) % CAPACITY] = dealNumber;
+            count++;
+            stats.accepted++;
+        }
+    }
+}
+
+bool DealQueue::pop(unsigned long long* dealNumber)
+{
+    ScopedLock lock(mutex);
+    if (count == 0) {
+        return false;
+    }
+
+    *dealNumber = deals[head];
+    head = (head + 1) % CAPACITY;
+    count--;
+    wakeUp.set();
+    return true;
+}
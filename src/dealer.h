@@ -0,0 +1,78 @@
+#pragma once
+
+#include "difficulty.h"
+#include "model.h"
+#include "platform.h"
+#include "solver.h"
+
+// Keeps a few deals that are already proven to be winnable, so that a new
+// game can start without waiting for the solver. Deals are checked on a
+// worker thread.
+class DealQueue
+{
+public:
+    struct Stats
+    {
+        int depth;
+        int checked;
+        int accepted;
+        int fallbacks;
+        int unchecked;
+        int indexed;
+        double checkSeconds;
+
+        Stats();
+    };
+
+    DealQueue();
+    ~DealQueue();
+
+    void start();
+    void stop();
+
+    // Deals of the tier come from the index, the solver is only used when
+    // the tier has no seeds
+    void useIndex(const DifficultyIndex* aIndex, int aTier);
+
+    // Number of the next deal (see GameDeal::FromSeed). Never blocks for
+    // long: when the queue is empty, a deal is checked right away with a
+    // small time budget and given out unchecked if that did not work out.
+    unsigned long long next();
+    Stats getStats();
+
+private:
+    static const int CAPACITY = 8;
+    static const int WORKER_MAX_NODES = 200000;
+    static const int FALLBACK_MAX_NODES = 2000;
+    static const int FALLBACK_ATTEMPTS = 4;
+    static const double FALLBACK_SECONDS;
+    static const int WORKER_HASH_MB = 16;
+    static const int FALLBACK_HASH_MB = 1;
+
+    static void workerMain(void* arg);
+    void run();
+    bool pop(unsigned long long* dealNumber);
+
+    unsigned long long deals[CAPACITY];
+    int head;
+    int count;
+
+    Mutex mutex;
+    Signal wakeUp;
+    Thread worker;
+    volatile bool stopping;
+
+    GameState* workerState;
+    Solver workerSolver;
+    GameState* fallbackState;
+    Solver* fallbackSolver;
+
+    const DifficultyIndex* index;
+    int tier;
+    unsigned long long indexRandom;
+
+    Stats stats;
+
+    DealQueue(const DealQueue&);
+    DealQueue& operator=(const DealQueue&);
+};
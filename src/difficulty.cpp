@@ -0,0 +1,168 @@
+#include "difficulty.h"
+
+#include <string.h>
+
+#include "properties.h"
+#include "utils.h"
+
+// Header: magic, version, record size, first seed, seed count by tier.
+// Records: seed offset, nodes, moves, tier; all numbers little endian.
+static const char MAGIC[] = "XNYINDEX";
+
+static void putU16(unsigned char* p, unsigned int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void putU32(unsigned char* p, unsigned int v)
+{
+    putU16(p, v & 0xFFFF);
+    putU16(p+2, v >> 16);
+}
+
+static void putU64(unsigned char* p, unsigned long long v)
+{
+    putU32(p, (unsigned int)v);
+    putU32(p+4, (unsigned int)(v >> 32));
+}
+
+static unsigned int getU16(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int getU32(const unsigned char* p)
+{
+    return getU16(p) | (getU16(p+2) << 16);
+}
+
+static unsigned long long getU64(const unsigned char* p)
+{
+    return getU32(p) | ((unsigned long long)getU32(p+4) << 32);
+}
+
+DifficultyIndex::Entry::Entry(): seed(0), nodes(0), moves(0), tier(0)
+{
+}
+
+DifficultyIndex::DifficultyIndex(): firstSeed(0)
+{
+    for (int i=0; i<TIER_COUNT; i++) {
+        tierStart[i] = tierCount[i] = 0;
+    }
+}
+
+bool DifficultyIndex::open(const char* path)
+{
+    close();
+    if (file.open(path) == false) {
+        return false;
+    }
+
+    // Only the header is read, the records are paged in by lookups
+    const unsigned char* p = file.getData();
+    bool valid = file.getSize() >= (unsigned long long)HEADER_SIZE
+        && memcmp(p, MAGIC, 8) == 0
+        && getU32(p+8) == (unsigned int)VERSION
+        && getU32(p+12) == (unsigned int)RECORD_SIZE;
+
+    unsigned long long total = 0;
+    if (valid)
+    {
+        firstSeed = getU64(p+16);
+        for (int i=0; i<TIER_COUNT; i++)
+        {
+            tierStart[i] = total;
+            tierCount[i] = getU64(p+24 + i*8);
+            total += tierCount[i];
+        }
+        valid = total <= MAX_SEEDS && file.getSize() == HEADER_SIZE + total*RECORD_SIZE;
+    }
+
+    if (valid == false)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void DifficultyIndex::close()
+{
+    file.close();
+    firstSeed = 0;
+    for (int i=0; i<TIER_COUNT; i++) {
+        tierStart[i] = tierCount[i] = 0;
+    }
+}
+
+bool DifficultyIndex::isOpen() const
+{
+    return file.getData() != NULL_PTR;
+}
+
+unsigned long long DifficultyIndex::getCount(int tier) const
+{
+    return tier >= 0 && tier < TIER_COUNT ? tierCount[tier] : 0;
+}
+
+bool DifficultyIndex::getEntry(int tier, unsigned long long n, Entry* entry) const
+{
+    if (n >= getCount(tier)) {
+        return false;
+    }
+
+    const unsigned char* p = file.getData() + HEADER_SIZE + (tierStart[tier] + n) * RECORD_SIZE;
+    entry->seed = firstSeed + getU32(p);
+    entry->nodes = getU32(p+4);
+    entry->moves = (int)getU16(p+8);
+    entry->tier = p[10];
+    return true;
+}
+
+bool DifficultyIndex::pickSeed(int tier, unsigned long long* randomState, unsigned long long* seed) const
+{
+    unsigned long long count = getCount(tier);
+    if (count == 0) {
+        return false;
+    }
+
+    Entry entry;
+    getEntry(tier, Utils_SplitMix64(randomState) % count, &entry);
+    *seed = entry.seed;
+    return true;
+}
+
+int DifficultyIndex::Classify(unsigned int nodes)
+{
+    if (nodes <= EASY_MAX_NODES) {
+        return TIER_EASY;
+    } else if (nodes <= MEDIUM_MAX_NODES) {
+        return TIER_MEDIUM;
+    } else if (nodes <= HARD_MAX_NODES) {
+        return TIER_HARD;
+    }
+    return TIER_EXPERT;
+}
+
+void DifficultyIndex::EncodeHeader(unsigned long long aFirstSeed, const unsigned long long* tierCounts, unsigned char* p)
+{
+    memset(p, 0, HEADER_SIZE);
+    memcpy(p, MAGIC, 8);
+    putU32(p+8, VERSION);
+    putU32(p+12, RECORD_SIZE);
+    putU64(p+16, aFirstSeed);
+    for (int i=0; i<TIER_COUNT; i++) {
+        putU64(p+24 + i*8, tierCounts[i]);
+    }
+}
+
+void DifficultyIndex::EncodeEntry(const Entry& entry, unsigned long long aFirstSeed, unsigned char* p)
+{
+    putU32(p, (unsigned int)(entry.seed - aFirstSeed));
+    putU32(p+4, entry.nodes);
+    putU16(p+8, (unsigned int)entry.moves);
+    p[10] = (unsigned char)entry.tier;
+    p[11] = 0;
+}
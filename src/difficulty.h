@@ -0,0 +1,67 @@
+#pragma once
+
+#include "platform.h"
+
+// Winnable seeds (see GameDeal::FromSeed) sorted into difficulty tiers by
+// the work the solver needed for them. The index is built offline from the
+// results of a batch analysis (BatchAnalysis::ExportIndex) and stores fixed
+// size records grouped by tier, so opening it reads only the header and
+// picking a seed of a tier is a single record read from the mapped file.
+class DifficultyIndex
+{
+public:
+    enum Tier
+    {
+        TIER_EASY = 0,
+        TIER_MEDIUM,
+        TIER_HARD,
+        TIER_EXPERT,
+        TIER_COUNT,
+    };
+
+    struct Entry
+    {
+        unsigned long long seed;
+        unsigned int nodes;
+        int moves;
+        int tier;
+
+        Entry();
+    };
+
+    static const int HEADER_SIZE = 64;
+    static const int RECORD_SIZE = 12;
+
+    // Seeds are stored relative to the first one
+    static const unsigned long long MAX_SEEDS = 0x100000000ULL;
+
+    DifficultyIndex();
+
+    bool open(const char* path);
+    void close();
+    bool isOpen() const;
+
+    unsigned long long getCount(int tier) const;
+    bool getEntry(int tier, unsigned long long n, Entry* entry) const;
+    bool pickSeed(int tier, unsigned long long* randomState, unsigned long long* seed) const;
+
+    // Tier of a solved deal by the number of positions the solver visited
+    static int Classify(unsigned int nodes);
+
+    static void EncodeHeader(unsigned long long firstSeed, const unsigned long long* tierCounts, unsigned char* p);
+    static void EncodeEntry(const Entry& entry, unsigned long long firstSeed, unsigned char* p);
+
+private:
+    static const int VERSION = 1;
+    static const unsigned int EASY_MAX_NODES = 200;
+    static const unsigned int MEDIUM_MAX_NODES = 5000;
+    static const unsigned int HARD_MAX_NODES = 100000;
+
+    MappedFile file;
+    unsigned long long firstSeed;
+    unsigned long long tierStart[TIER_COUNT];
+    unsigned long long tierCount[TIER_COUNT];
+
+    DifficultyIndex(const DifficultyIndex&);
+    DifficultyIndex& operator=(const DifficultyIndex&);
+};
@@ -0,0 +1,218 @@
+#include "estimator.h"
+
+#include <math.h>
+
+static const double Z_95 = 1.96;
+
+WinEstimator::Estimate::Estimate()
+    : probability(0)
+    , low(0)
+    , high(1)
+    , rollouts(0)
+    , wins(0)
+    , seconds(0)
+    , rolloutsPerSecond(0)
+    , accurate(false)
+{
+}
+
+WinEstimator::Worker::Worker(): owner(NULL_PTR), gameState(NULL_PTR), random(0)
+{
+}
+
+WinEstimator::Worker::~Worker()
+{
+    delete gameState;
+}
+
+WinEstimator::WinEstimator()
+    : workers(NULL_PTR)
+    , workerCount(0)
+    , seedState(0x57696E457374ULL)
+    , position(NULL_PTR)
+    , margin(0)
+    , maxSeconds(0)
+    , rollouts(0)
+    , wins(0)
+    , stopping(false)
+{
+}
+
+WinEstimator::~WinEstimator()
+{
+    delete[] workers;
+}
+
+void WinEstimator::init(int threadCount)
+{
+    delete[] workers;
+    workerCount = threadCount > 0 ? threadCount : Platform_GetCpuCount();
+    workers = new Worker[workerCount];
+    for (int i=0; i<workerCount; i++)
+    {
+        workers[i].owner = this;
+        workers[i].gameState = new GameState();
+    }
+}
+
+WinEstimator::Estimate WinEstimator::estimate(const GameState& gameState, double aMargin, double aMaxSeconds)
+{
+    if (workers == NULL_PTR) {
+        init(0);
+    }
+
+    position = &gameState;
+    margin = aMargin;
+    maxSeconds = aMaxSeconds;
+    rollouts = 0;
+    wins = 0;
+    stopping = false;
+
+    // The calling thread is the first worker and decides when to stop
+    double start = Platform_GetTime();
+    for (int i=0; i<workerCount; i++) {
+        workers[i].random = Utils_SplitMix64(&seedState);
+    }
+    for (int i=1; i<workerCount; i++) {
+        workers[i].thread.start(workerMain, &workers[i]);
+    }
+
+    Estimate result;
+    while (shouldStop(start, &result) == false)
+    {
+        bool won = playOut(workers[0]);
+        Platform_AtomicAdd(&wins, won ? 1 : 0);
+        Platform_AtomicAdd(&rollouts, 1);
+    }
+
+    stopping = true;
+    for (int i=1; i<workerCount; i++) {
+        workers[i].thread.join();
+    }
+
+    // Count the rollouts that finished while the others were stopping too
+    shouldStop(start, &result);
+    return result;
+}
+
+void WinEstimator::workerMain(void* arg)
+{
+    Worker* worker = (Worker*)arg;
+    worker->owner->runWorker(*worker);
+}
+
+void WinEstimator::runWorker(Worker& worker)
+{
+    while (stopping == false)
+    {
+        bool won = playOut(worker);
+        Platform_AtomicAdd(&wins, won ? 1 : 0);
+        Platform_AtomicAdd(&rollouts, 1);
+    }
+}
+
+bool WinEstimator::shouldStop(double startTime, Estimate* result)
+{
+    long long n = Platform_AtomicAdd(&rollouts, 0);
+    long long w = Platform_AtomicAdd(&wins, 0);
+    if (w > n) {
+        w = n;
+    }
+
+    result->rollouts = n;
+    result->wins = w;
+    result->seconds = Platform_GetTime() - startTime;
+    result->rolloutsPerSecond = result->seconds > 0 ? n / result->seconds : 0;
+
+    if (n > 0)
+    {
+        double p = (double)w / n;
+        double z2 = Z_95 * Z_95;
+        double denom = 1 + z2 / n;
+        double center = (p + z2 / (2*n)) / denom;
+        double half = Z_95 * sqrt(p*(1-p)/n + z2/(4.0*n*n)) / denom;
+
+        result->probability = p;
+        result->low = center - half > 0 ? center - half : 0;
+        result->high = center + half < 1 ? center + half : 1;
+        result->accurate = n >= MIN_ROLLOUTS && p - result->low <= margin && result->high - p <= margin;
+    }
+
+    return result->accurate || result->seconds >= maxSeconds;
+}
+
+int WinEstimator::scoreMove(const GameState& gameState, const LegalMove& move) const
+{
+    // Negative scores are moves the policy never makes: they either undo
+    // progress or could be repeated forever
+    if (move.src >= STACK_IDX_FOUNDATION && move.src < STACK_IDX_STOCK) {
+        return -1;
+    }
+    if (move.dst >= STACK_IDX_FOUNDATION) {
+        return 4;
+    }
+    if (move.src == STACK_IDX_WASTE) {
+        return 1;
+    }
+
+    const CardStack& src = *gameState.getStack(move.src);
+    if (move.idx == 0) {
+        return gameState.getStack(move.dst)->empty() ? -1 : 2;
+    }
+    return src[move.idx-1].opened() ? -1 : 3;
+}
+
+bool WinEstimator::playOut(Worker& worker)
+{
+    GameState& gameState = *worker.gameState;
+    gameState.copyPosition(*position);
+    gameState.shuffleHiddenCards(&worker.random);
+
+    int idleAdvances = 0;
+    for (int step=0; step<MAX_STEPS; step++)
+    {
+        if (gameState.gameWon()) {
+            return true;
+        }
+
+        // Step #1: the best move by the policy, ties are broken at random
+
+        LegalMove moves[MAX_MOVES];
+        int moveCount = gameState.generateMoves(moves, MAX_MOVES);
+        int best = -1;
+        unsigned long long bestScore = 0;
+        for (int i=0; i<moveCount; i++)
+        {
+            int score = scoreMove(gameState, moves[i]);
+            if (score < 0) {
+                continue;
+            }
+            unsigned long long key = ((unsigned long long)score << 32) | (Utils_SplitMix64(&worker.random) >> 32);
+            if (best < 0 || key > bestScore)
+            {
+                best = i;
+                bestScore = key;
+            }
+        }
+
+        if (best >= 0)
+        {
+            gameState.fillHand(gameState.getStack(moves[best].src), moves[best].idx);
+            gameState.releaseHand(gameState.getStack(moves[best].dst));
+            idleAdvances = 0;
+            continue;
+        }
+
+        // Step #2: nothing to play, a full pass through the talon without
+        // a move loses
+
+        int talonSize = gameState.stock.size() + gameState.waste.size();
+        if (talonSize == 0 || idleAdvances > talonSize) {
+            return false;
+        }
+        gameState.advanceStock();
+        idleAdvances++;
+    }
+
+    return false;
+}
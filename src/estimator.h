@@ -0,0 +1,76 @@
+#pragma once
+
+#include "model.h"
+#include "platform.h"
+
+// Chance to win a position as the player sees it. Every rollout deals the
+// closed tableau cards and the stock again at random (see
+// GameState::shuffleHiddenCards) and plays the game out with a fast greedy
+// policy, so the result is the win rate of that policy rather than of
+// perfect play. Rollouts run on all threads until the confidence interval
+// is narrow enough or the time is up.
+class WinEstimator
+{
+public:
+    struct Estimate
+    {
+        double probability;
+
+        // 95% Wilson score interval
+        double low;
+        double high;
+
+        long long rollouts;
+        long long wins;
+        double seconds;
+        double rolloutsPerSecond;
+        bool accurate;
+
+        Estimate();
+    };
+
+    WinEstimator();
+    ~WinEstimator();
+
+    void init(int threadCount);
+
+    // Stops once both ends of the interval are within margin of the
+    // probability, or after maxSeconds. The hand must be empty.
+    Estimate estimate(const GameState& gameState, double margin, double maxSeconds);
+
+private:
+    static const int MIN_ROLLOUTS = 100;
+    static const int MAX_STEPS = 4000;
+    static const int MAX_MOVES = 256;
+
+    struct Worker
+    {
+        WinEstimator* owner;
+        Thread thread;
+        GameState* gameState;
+        unsigned long long random;
+
+        Worker();
+        ~Worker();
+    };
+
+    static void workerMain(void* arg);
+    void runWorker(Worker& worker);
+    bool playOut(Worker& worker);
+    int scoreMove(const GameState& gameState, const LegalMove& move) const;
+    bool shouldStop(double startTime, Estimate* result);
+
+    Worker* workers;
+    int workerCount;
+    unsigned long long seedState;
+
+    const GameState* position;
+    double margin;
+    double maxSeconds;
+    volatile long long rollouts;
+    volatile long long wins;
+    volatile bool stopping;
+
+    WinEstimator(const WinEstimator&);
+    WinEstimator& operator=(const WinEstimator&);
+};
@@ -0,0 +1,181 @@
+#include "hints.h"
+
+HintEngine::Hint::Hint()
+    : status(STATUS_IDLE)
+    , seconds(0.0)
+    , fromLine(false)
+{
+}
+
+HintEngine::HintEngine()
+    : stopping(false)
+    , pendingState(NULL_PTR)
+    , hasPending(false)
+    , requestId(0)
+    , requestTime(0.0)
+    , searchState(NULL_PTR)
+    , lineState(NULL_PTR)
+{
+}
+
+HintEngine::~HintEngine()
+{
+    stop();
+    delete pendingState;
+    delete searchState;
+    delete lineState;
+}
+
+void HintEngine::start()
+{
+    if (worker.started()) {
+        return;
+    }
+
+    if (searchState == NULL_PTR)
+    {
+        pendingState = new GameState();
+        searchState = new GameState();
+        lineState = new GameState();
+        solver.init(MAX_NODES, HASH_MB);
+    }
+
+    stopping = false;
+    worker.start(workerMain, this);
+}
+
+void HintEngine::stop()
+{
+    if (worker.started())
+    {
+        stopping = true;
+        solver.setCancelled(true);
+        wakeUp.set();
+        worker.join();
+    }
+}
+
+void HintEngine::request(const GameState& gameState)
+{
+    if (worker.started() == false) {
+        return;
+    }
+
+    {
+        ScopedLock lock(mutex);
+        pendingState->copyPosition(gameState);
+        hasPending = true;
+        requestId++;
+        requestTime = Platform_GetTime();
+        hint = Hint();
+        hint.status = STATUS_SEARCHING;
+        solver.setCancelled(true);
+    }
+    wakeUp.set();
+}
+
+void HintEngine::cancel()
+{
+    ScopedLock lock(mutex);
+    hasPending = false;
+    requestId++;
+    hint = Hint();
+    solver.setCancelled(true);
+}
+
+HintEngine::Hint HintEngine::getHint()
+{
+    ScopedLock lock(mutex);
+    return hint;
+}
+
+void HintEngine::workerMain(void* arg)
+{
+    ((HintEngine*)arg)->run();
+}
+
+void HintEngine::run()
+{
+    while (stopping == false)
+    {
+        int id = 0;
+        double requestedAt = 0.0;
+        {
+            ScopedLock lock(mutex);
+            if (hasPending && stopping == false)
+            {
+                searchState->copyPosition(*pendingState);
+                hasPending = false;
+                solver.setCancelled(false);
+                id = requestId;
+                requestedAt = requestTime;
+            }
+        }
+        if (id == 0)
+        {
+            wakeUp.wait(1000);
+            continue;
+        }
+
+        Hint result = think(requestedAt);
+
+        // Results of requests that were replaced or cancelled meanwhile are
+        // thrown away
+        ScopedLock lock(mutex);
+        if (id == requestId) {
+            hint = result;
+        }
+    }
+}
+
+HintEngine::Hint HintEngine::think(double requestedAt)
+{
+    Hint result;
+
+    // Step #1: the player may still be on the line of the last search
+
+    unsigned long long hash = searchState->getHash();
+    for (int i=0; i<lineHashes.size(); i++) {
+        if (lineHashes[i] == hash)
+        {
+            result.status = STATUS_FOUND;
+            result.move = lineMoves[i];
+            result.fromLine = true;
+            result.seconds = Platform_GetTime() - requestedAt;
+            return result;
+        }
+    }
+
+    // Step #2: search from scratch
+
+    Solver::Result solved = solver.solve(*searchState);
+    result.seconds = Platform_GetTime() - requestedAt;
+
+    if (solved == Solver::RESULT_SOLVED && solver.getSolutionLength() > 0)
+    {
+        storeLine();
+        result.status = STATUS_FOUND;
+        result.move = lineMoves[0];
+    }
+    else if (solved == Solver::RESULT_UNSOLVABLE) {
+        result.status = STATUS_NO_WIN;
+    } else {
+        result.status = STATUS_GAVE_UP;
+    }
+    return result;
+}
+
+void HintEngine::storeLine()
+{
+    lineMoves.clear();
+    lineHashes.clear();
+    lineState->copyPosition(*searchState);
+
+    for (int i=0; i<solver.getSolutionLength(); i++)
+    {
+        const SolverMove& move = solver.getSolutionMove(i);
+        lineMoves.push(move);
+        lineHashes.push(lineState->getHash());
+        move.apply(*lineState);
+    }
+}
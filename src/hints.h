@@ -0,0 +1,75 @@
+#pragma once
+
+#include "model.h"
+#include "platform.h"
+#include "solver.h"
+
+// Finds the next move of a winning line for the player on a worker thread.
+// Requests and results go through a mutex that is held only for copying,
+// so the game loop never waits for the search. The line found by the last
+// search is kept: while the player follows it, hints come out of it without
+// searching again.
+class HintEngine
+{
+public:
+    enum Status
+    {
+        STATUS_IDLE = 0,
+        STATUS_SEARCHING,
+        STATUS_FOUND,
+        STATUS_NO_WIN,
+        STATUS_GAVE_UP,
+    };
+
+    struct Hint
+    {
+        Status status;
+        SolverMove move;
+        double seconds;
+        bool fromLine;
+
+        Hint();
+    };
+
+    HintEngine();
+    ~HintEngine();
+
+    void start();
+    void stop();
+
+    // Both drop the search that is in progress
+    void request(const GameState& gameState);
+    void cancel();
+
+    Hint getHint();
+
+private:
+    static const int MAX_NODES = 2000000;
+    static const int HASH_MB = 32;
+
+    static void workerMain(void* arg);
+    void run();
+    Hint think(double requestedAt);
+    void storeLine();
+
+    Mutex mutex;
+    Signal wakeUp;
+    Thread worker;
+    volatile bool stopping;
+
+    GameState* pendingState;
+    bool hasPending;
+    int requestId;
+    double requestTime;
+    Hint hint;
+
+    // Worker only
+    GameState* searchState;
+    GameState* lineState;
+    Solver solver;
+    FixedVec<SolverMove, Solver::MAX_SOLUTION_LENGTH> lineMoves;
+    FixedVec<unsigned long long, Solver::MAX_SOLUTION_LENGTH> lineHashes;
+
+    HintEngine(const HintEngine&);
+    HintEngine& operator=(const HintEngine&);
+};
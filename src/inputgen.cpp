@@ -0,0 +1,203 @@
+#include "inputgen.h"
+
+#include "system.h"
+#include "utils.h"
+
+// Gestures in percent, what is left over clicks a button
+static const int DRAG_PERCENT = 45;
+static const int CARD_CLICK_PERCENT = 20;
+static const int STOCK_PERCENT = 15;
+static const int UNDO_PERCENT = 5;
+static const int REDO_PERCENT = 3;
+static const int HINT_PERCENT = 2;
+
+// Deepest tableau a drag starts from or drops onto: the closed cards of
+// the last column and a run from the king down
+static const int TABLEAU_CLOSED_MAX = 6;
+static const int TABLEAU_OPENED_MAX = 12;
+
+static const int MOVE_MS = 120;
+static const int PRESS_MS = 40;
+static const int DRAG_MS = 250;
+static const int SETTLE_MS = 150;
+
+InputGenerator::InputGenerator()
+    : random(0)
+    , ticksPerSecond(60)
+    , gesturesPerDeal(0)
+    , stepCount(0)
+    , stepIndex(0)
+    , stepTick(0)
+    , fromX(0)
+    , fromY(0)
+    , gestureCount(0)
+    , dealCount(0)
+{
+}
+
+void InputGenerator::init(unsigned long long seed, int width, int height, int aTicksPerSecond, int aGesturesPerDeal)
+{
+    layout.init();
+    layout.setGameSize(width, height);
+    widgetLayout.init(layout);
+
+    random = seed;
+    ticksPerSecond = aTicksPerSecond > 0 ? aTicksPerSecond : 60;
+    gesturesPerDeal = aGesturesPerDeal;
+    stepCount = stepIndex = stepTick = 0;
+    fromX = width / 2;
+    fromY = height / 2;
+    gestureCount = dealCount = 0;
+}
+
+bool InputGenerator::next(InputFrame* frame)
+{
+    while (stepIndex == stepCount) {
+        planGesture();
+    }
+
+    // Step #1: the way from the last step's point, a pixel at a time when
+    // the step is short of ticks
+
+    const Step& step = steps[stepIndex];
+    stepTick++;
+    frame->x = fromX + (step.x - fromX) * stepTick / step.ticks;
+    frame->y = fromY + (step.y - fromY) * stepTick / step.ticks;
+    frame->buttons = step.buttons;
+
+    // Step #2: on to the next step once this one is there
+
+    if (stepTick == step.ticks)
+    {
+        fromX = step.x;
+        fromY = step.y;
+        stepIndex++;
+        stepTick = 0;
+    }
+    return true;
+}
+
+bool InputGenerator::NextFrame(InputFrame* frame, void* arg)
+{
+    return ((InputGenerator*)arg)->next(frame);
+}
+
+long long InputGenerator::getGestureCount() const
+{
+    return gestureCount;
+}
+
+long long InputGenerator::getDealCount() const
+{
+    return dealCount;
+}
+
+void InputGenerator::planGesture()
+{
+    stepCount = stepIndex = stepTick = 0;
+    gestureCount++;
+
+    if (gesturesPerDeal > 0 && gestureCount % gesturesPerDeal == 0)
+    {
+        dealCount++;
+        planClick(getButtonRect(WidgetLayout::BUTTON_NEW), MOUSE_BUTTON_LEFT);
+        return;
+    }
+
+    // Card clicks and buttons go with the left button, which also takes a
+    // won game on to the next deal
+    int roll = pick(100);
+    if ((roll -= DRAG_PERCENT) < 0) {
+        planDrag();
+    } else if ((roll -= CARD_CLICK_PERCENT) < 0) {
+        planClick(getStackArea(CardStack::TYPE_TABLEAU, pick(TABLEAU_COUNT)), MOUSE_BUTTON_LEFT);
+    } else if ((roll -= STOCK_PERCENT) < 0) {
+        planClick(getStackArea(CardStack::TYPE_STOCK, 0), pick(2) == 0 ? MOUSE_BUTTON_LEFT : MOUSE_BUTTON_RIGHT);
+    } else if ((roll -= UNDO_PERCENT) < 0) {
+        planClick(Rect((float)fromX, (float)fromY, 1.f, 1.f), MOUSE_BUTTON_BACK);
+    } else if ((roll -= REDO_PERCENT) < 0) {
+        planClick(Rect((float)fromX, (float)fromY, 1.f, 1.f), MOUSE_BUTTON_FWRD);
+    } else if ((roll -= HINT_PERCENT) < 0) {
+        planClick(Rect((float)fromX, (float)fromY, 1.f, 1.f), MOUSE_BUTTON_MIDDLE);
+    } else {
+        // New deals are left to gesturesPerDeal
+        int button = pick(WidgetLayout::BUTTON_MAX - 1);
+        if (button >= WidgetLayout::BUTTON_NEW) {
+            button++;
+        }
+        planClick(getButtonRect((WidgetLayout::ButtonType)button), MOUSE_BUTTON_LEFT);
+    }
+}
+
+void InputGenerator::planDrag()
+{
+    // Cards come off the tableaux mostly, off the waste and the foundations
+    // now and then; they go to a tableau or a foundation
+    Rect source;
+    int roll = pick(10);
+    if (roll < 7) {
+        source = getStackArea(CardStack::TYPE_TABLEAU, pick(TABLEAU_COUNT));
+    } else if (roll < 9) {
+        source = getStackArea(CardStack::TYPE_WASTE, 0);
+    } else {
+        source = getStackArea(CardStack::TYPE_FOUNDATION, pick(FOUNDATION_COUNT));
+    }
+    Rect dest = pick(3) == 0
+        ? getStackArea(CardStack::TYPE_FOUNDATION, pick(FOUNDATION_COUNT))
+        : getStackArea(CardStack::TYPE_TABLEAU, pick(TABLEAU_COUNT));
+
+    int x = 0;
+    int y = 0;
+    pickPoint(source, &x, &y);
+    addStep(x, y, MOUSE_BUTTON_NONE, MOVE_MS);
+    addStep(x, y, MOUSE_BUTTON_LEFT, PRESS_MS);
+    pickPoint(dest, &x, &y);
+    addStep(x, y, MOUSE_BUTTON_LEFT, DRAG_MS);
+    addStep(x, y, MOUSE_BUTTON_NONE, SETTLE_MS);
+}
+
+void InputGenerator::planClick(Rect target, int buttons)
+{
+    int x = 0;
+    int y = 0;
+    pickPoint(target, &x, &y);
+    addStep(x, y, MOUSE_BUTTON_NONE, MOVE_MS);
+    addStep(x, y, buttons, PRESS_MS);
+    addStep(x, y, MOUSE_BUTTON_NONE, SETTLE_MS);
+}
+
+void InputGenerator::addStep(int x, int y, int buttons, int ms)
+{
+    Step& step = steps[stepCount++];
+    step.x = x;
+    step.y = y;
+    step.buttons = buttons;
+    step.ticks = max(1, (ms * ticksPerSecond + 500) / 1000);
+}
+
+Rect InputGenerator::getStackArea(CardStack::Type type, int ordinal)
+{
+    CardStack stack;
+    stack.init(type, ordinal);
+    Rect area = layout.getStackRect(&stack);
+    if (type == CardStack::TYPE_TABLEAU) {
+        area.h += TABLEAU_CLOSED_MAX * layout.getSlide(false) + TABLEAU_OPENED_MAX * layout.getSlide(true);
+    }
+    return area;
+}
+
+Rect InputGenerator::getButtonRect(WidgetLayout::ButtonType button)
+{
+    return widgetLayout.buttons[button].getRect();
+}
+
+void InputGenerator::pickPoint(Rect area, int* x, int* y)
+{
+    *x = (int)area.x + pick(max(1, (int)area.w));
+    *y = (int)area.y + pick(max(1, (int)area.h));
+}
+
+int InputGenerator::pick(int count)
+{
+    return (int)(Utils_SplitMix64(&random) % (unsigned long long)count);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "controller.h"
+#include "inputlog.h"
+
+// Drag and drop play made up from a seed, for soak and latency runs with
+// no one at the controls: drags between the stacks, clicks on cards and
+// buttons, the stock turned, undo and redo, and a new deal asked for every
+// so many gestures. The gestures are aimed at where the stacks and the
+// buttons are for the game size, without looking at the cards, so most of
+// them are moves the game turns down, as they would be for a careless
+// player. Gesture timings are in milliseconds, made into ticks at the
+// given rate, and the same seed, size and rate give the same frames.
+class InputGenerator
+{
+public:
+    InputGenerator();
+
+    void init(unsigned long long seed, int width, int height, int ticksPerSecond, int gesturesPerDeal);
+
+    // The frame of the next tick, there is always one
+    bool next(InputFrame* frame);
+
+    // An InputSource, arg is the generator
+    static bool NextFrame(InputFrame* frame, void* arg);
+
+    long long getGestureCount() const;
+    long long getDealCount() const;
+
+private:
+    // The mouse goes from where it is to x, y in ticks, buttons held
+    struct Step
+    {
+        int x;
+        int y;
+        int buttons;
+        int ticks;
+    };
+
+    static const int MAX_STEPS = 8;
+
+    void planGesture();
+    void planDrag();
+    void planClick(Rect target, int buttons);
+    void addStep(int x, int y, int buttons, int ms);
+
+    Rect getStackArea(CardStack::Type type, int ordinal);
+    Rect getButtonRect(WidgetLayout::ButtonType button);
+    void pickPoint(Rect area, int* x, int* y);
+    int pick(int count);
+
+    Layout layout;
+    WidgetLayout widgetLayout;
+    unsigned long long random;
+    int ticksPerSecond;
+    int gesturesPerDeal;
+
+    Step steps[MAX_STEPS];
+    int stepCount;
+    int stepIndex;
+    int stepTick;
+    int fromX;
+    int fromY;
+
+    long long gestureCount;
+    long long dealCount;
+};
@@ -0,0 +1,286 @@
+#include "inputlog.h"
+
+#include <string.h>
+
+#include "properties.h"
+
+static const unsigned char MAGIC[] = {0xFE, 'X', 'N', 'Y', 'I', 'N', 'P'};
+static const int MAGIC_SIZE = 7;
+static const int VERSION = 1;
+
+static const int TAG_FRAME = 0x01;
+static const int TAG_DEAL = 0x02;
+static const int TAG_SIZE = 0x03;
+
+InputFrame::InputFrame(): x(0), y(0), buttons(0)
+{
+}
+
+InputFrame::InputFrame(int x, int y, int buttons): x(x), y(y), buttons(buttons)
+{
+}
+
+InputLogWriter::InputLogWriter(): file(NULL_PTR), runTicks(0)
+{
+}
+
+InputLogWriter::~InputLogWriter()
+{
+    close();
+}
+
+bool InputLogWriter::open(const char* path)
+{
+    close();
+    file = fopen(path, "wb");
+    if (file == NULL_PTR) {
+        return false;
+    }
+    fwrite(MAGIC, 1, MAGIC_SIZE, file);
+    putc(VERSION, file);
+    last = InputFrame();
+    runTicks = 0;
+    return true;
+}
+
+void InputLogWriter::close()
+{
+    if (file != NULL_PTR)
+    {
+        flushRun();
+        fclose(file);
+        file = NULL_PTR;
+    }
+}
+
+bool InputLogWriter::isOpen() const
+{
+    return file != NULL_PTR;
+}
+
+void InputLogWriter::addFrame(const InputFrame& frame)
+{
+    if (file == NULL_PTR) {
+        return;
+    }
+    if (runTicks > 0 && (frame == run) == false) {
+        flushRun();
+    }
+    run = frame;
+    runTicks++;
+}
+
+void InputLogWriter::addDeal(unsigned long long dealNumber)
+{
+    if (file == NULL_PTR) {
+        return;
+    }
+    flushRun();
+    putc(TAG_DEAL, file);
+    putVarint(dealNumber);
+}
+
+void InputLogWriter::addSize(int width, int height)
+{
+    if (file == NULL_PTR) {
+        return;
+    }
+    flushRun();
+    putc(TAG_SIZE, file);
+    putVarint((unsigned long long)width);
+    putVarint((unsigned long long)height);
+}
+
+void InputLogWriter::flushRun()
+{
+    if (runTicks > 0)
+    {
+        putc(TAG_FRAME, file);
+        putVarint((unsigned long long)runTicks);
+        putSigned(run.x - last.x);
+        putSigned(run.y - last.y);
+        putc(run.buttons, file);
+        last = run;
+        runTicks = 0;
+    }
+}
+
+void InputLogWriter::putVarint(unsigned long long v)
+{
+    while (v >= 0x80)
+    {
+        putc((int)(v & 0x7F) | 0x80, file);
+        v >>= 7;
+    }
+    putc((int)v, file);
+}
+
+void InputLogWriter::putSigned(int v)
+{
+    putVarint(v < 0 ? ((unsigned long long)(-(long long)v) << 1) - 1 : (unsigned long long)v << 1);
+}
+
+InputLogReader::InputLogReader(): file(NULL_PTR), runTicks(0), peeked(false)
+{
+}
+
+InputLogReader::~InputLogReader()
+{
+    close();
+}
+
+bool InputLogReader::open(const char* path)
+{
+    close();
+    file = fopen(path, "rb");
+    if (file == NULL_PTR) {
+        return false;
+    }
+
+    unsigned char header[MAGIC_SIZE+1];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)
+        || memcmp(header, MAGIC, MAGIC_SIZE) != 0
+        || header[MAGIC_SIZE] != VERSION)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void InputLogReader::close()
+{
+    if (file != NULL_PTR)
+    {
+        fclose(file);
+        file = NULL_PTR;
+    }
+    last = InputFrame();
+    runTicks = 0;
+    peeked = false;
+}
+
+bool InputLogReader::next(Entry* entry)
+{
+    // The rest of a run comes first, a peeked frame is one of its ticks
+    if (runTicks > 0)
+    {
+        runTicks--;
+        entry->type = Entry::TYPE_FRAME;
+        entry->frame = last;
+        return true;
+    }
+    if (peeked)
+    {
+        peeked = false;
+        *entry = peekEntry;
+        return true;
+    }
+    return readEntry(entry);
+}
+
+bool InputLogReader::nextDeal(unsigned long long* dealNumber)
+{
+    if (runTicks > 0) {
+        return false;
+    }
+    if (peeked == false)
+    {
+        if (readEntry(&peekEntry) == false) {
+            return false;
+        }
+        peeked = true;
+    }
+    if (peekEntry.type != Entry::TYPE_DEAL) {
+        return false;
+    }
+    peeked = false;
+    *dealNumber = peekEntry.dealNumber;
+    return true;
+}
+
+bool InputLogReader::NextFrame(InputFrame* frame, void* arg)
+{
+    Entry entry;
+    while (((InputLogReader*)arg)->next(&entry))
+    {
+        if (entry.type == Entry::TYPE_FRAME)
+        {
+            *frame = entry.frame;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool InputLogReader::readEntry(Entry* entry)
+{
+    if (file == NULL_PTR) {
+        return false;
+    }
+
+    int tag = getc(file);
+    if (tag == TAG_FRAME)
+    {
+        unsigned long long ticks = 0;
+        int dx = 0;
+        int dy = 0;
+        int buttons = 0;
+        if (getVarint(&ticks) == false || ticks == 0 || getSigned(&dx) == false || getSigned(&dy) == false) {
+            return false;
+        }
+        if ((buttons = getc(file)) == EOF) {
+            return false;
+        }
+        last = InputFrame(last.x + dx, last.y + dy, buttons);
+        runTicks = ticks - 1;
+        entry->type = Entry::TYPE_FRAME;
+        entry->frame = last;
+        return true;
+    }
+    if (tag == TAG_DEAL)
+    {
+        entry->type = Entry::TYPE_DEAL;
+        return getVarint(&entry->dealNumber);
+    }
+    if (tag == TAG_SIZE)
+    {
+        unsigned long long w = 0;
+        unsigned long long h = 0;
+        if (getVarint(&w) == false || getVarint(&h) == false) {
+            return false;
+        }
+        entry->type = Entry::TYPE_SIZE;
+        entry->width = (int)w;
+        entry->height = (int)h;
+        return true;
+    }
+    return false;
+}
+
+bool InputLogReader::getVarint(unsigned long long* v)
+{
+    *v = 0;
+    for (int shift=0; shift<64; shift+=7)
+    {
+        int b = getc(file);
+        if (b == EOF) {
+            return false;
+        }
+        *v |= (unsigned long long)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool InputLogReader::getSigned(int* v)
+{
+    unsigned long long u = 0;
+    if (getVarint(&u) == false) {
+        return false;
+    }
+    *v = (u & 1) != 0 ? -(int)((u + 1) >> 1) : (int)(u >> 1);
+    return true;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdio.h>
+
+// Mouse position and MouseButtonState mask (see system.h) the game saw in
+// one tick
+struct InputFrame
+{
+    int x;
+    int y;
+    int buttons;
+
+    InputFrame();
+    InputFrame(int x, int y, int buttons);
+
+    bool operator == (const InputFrame& other) const
+    {
+        return x == other.x && y == other.y && buttons == other.buttons;
+    }
+};
+
+// Input of one tick after another from somewhere other than the OS, for a
+// system.h with no one at the controls (see src/system_headless.cpp); false
+// once there is no more
+typedef bool (*InputSource)(InputFrame* frame, void* arg);
+
+// Raw input of a game session tick by tick, along with the deals started
+// and the window sizes, which is all it takes to play the session again
+// (see tools/xenny-run). After a version header, records of a tag byte:
+//
+//   0x01 varint n, zigzag dx, zigzag dy, buttons
+//                         the same frame for n ticks, position relative
+//                         to the frame before
+//   0x02 varint           deal number, written when the deal is asked for
+//   0x03 varint w, h      game size
+//
+// Varints are 7 bits per byte, low bits first.
+class InputLogWriter
+{
+public:
+    InputLogWriter();
+    ~InputLogWriter();
+
+    bool open(const char* path);
+    void close();
+    bool isOpen() const;
+
+    void addFrame(const InputFrame& frame);
+    void addDeal(unsigned long long dealNumber);
+    void addSize(int width, int height);
+
+private:
+    void flushRun();
+    void putVarint(unsigned long long v);
+    void putSigned(int v);
+
+    FILE* file;
+    InputFrame last;
+    InputFrame run;
+    int runTicks;
+
+    InputLogWriter(const InputLogWriter&);
+    InputLogWriter& operator=(const InputLogWriter&);
+};
+
+// Reads an input log one tick at a time without loading it
+class InputLogReader
+{
+public:
+    struct Entry
+    {
+        enum Type
+        {
+            TYPE_FRAME = 0,
+            TYPE_DEAL,
+            TYPE_SIZE,
+        };
+
+        Type type;
+        InputFrame frame;
+        unsigned long long dealNumber;
+        int width;
+        int height;
+    };
+
+    InputLogReader();
+    ~InputLogReader();
+
+    bool open(const char* path);
+    void close();
+
+    // The next tick's frame, deal or size; false at the end of the log or
+    // where it is broken
+    bool next(Entry* entry);
+
+    // Takes the next entry when it is a deal, for a deal asked for in the
+    // middle of a tick
+    bool nextDeal(unsigned long long* dealNumber);
+
+    // An InputSource of the frames alone, deals and sizes passed over; arg
+    // is the reader
+    static bool NextFrame(InputFrame* frame, void* arg);
+
+private:
+    bool readEntry(Entry* entry);
+    bool getVarint(unsigned long long* v);
+    bool getSigned(int* v);
+
+    FILE* file;
+    InputFrame last;
+    unsigned long long runTicks;
+    bool peeked;
+    Entry peekEntry;
+
+    InputLogReader(const InputLogReader&);
+    InputLogReader& operator=(const InputLogReader&);
+};
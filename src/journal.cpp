@@ -0,0 +1,353 @@
+#include "journal.h"
+
+#include <string.h>
+
+static const unsigned char MAGIC[] = {0xFE, 'X', 'N', 'Y', 'J', 'N', 'L'};
+static const int MAGIC_SIZE = 7;
+
+// Header start, version and the session checksum
+static const int HEADER_SIZE = 16;
+
+static const int CODE_UNDO = 0xE0;
+static const int CODE_REDO = 0xE1;
+static const int CODE_SEEK = 0xE2;
+static const int CODE_BRANCH = 0xE3;
+static const int CODE_AUTO_MOVE = 0xE4;
+
+static const int AMOUNT_MASK = 0x3F;
+static const int FLAG_CARD_OPENED = 0x40;
+static const int FLAG_FROM_STOCK = 0x80;
+
+static unsigned int getU32(const unsigned char* p)
+{
+    return (unsigned int)p[0] | (unsigned int)p[1] << 8 | (unsigned int)p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+static int getRecordSize(int code)
+{
+    if (code < CODE_UNDO) {
+        return 2;
+    }
+    return (code == CODE_SEEK || code == CODE_BRANCH) ? 5 : 1;
+}
+
+// Same checks as ReplayReader::ApplyStep, with the amount and the flags of
+// the move known they have to come out the same
+static bool applyMove(const unsigned char* record, GameState* gameState)
+{
+    int src = record[0] >> 4;
+    int dst = record[0] & 0x0F;
+    int amount = record[1] & AMOUNT_MASK;
+    bool cardOpened = (record[1] & FLAG_CARD_OPENED) != 0;
+
+    if (record[1] & FLAG_FROM_STOCK)
+    {
+        bool draw = src == STACK_IDX_STOCK && dst == STACK_IDX_WASTE && amount == 1
+            && gameState->stock.empty() == false;
+        bool turnOver = src == STACK_IDX_WASTE && dst == STACK_IDX_STOCK && amount == gameState->waste.size()
+            && gameState->stock.empty() && gameState->waste.empty() == false;
+        if (draw || turnOver) {
+            gameState->advanceStock();
+        }
+        return draw || turnOver;
+    }
+
+    if (src >= STACK_IDX_HAND || dst >= STACK_IDX_STOCK || amount < 1) {
+        return false;
+    }
+    CardStack* stack = gameState->getStack(src);
+    int idx = stack->size() - amount;
+    if (idx < 0 || (gameState->getDestMask(src, idx) & (1u << dst)) == 0) {
+        return false;
+    }
+
+    gameState->fillHand(stack, idx);
+    if (gameState->shouldOpenCard() != cardOpened)
+    {
+        gameState->releaseHand(stack);
+        return false;
+    }
+    gameState->releaseHand(gameState->getStack(dst));
+    return true;
+}
+
+static bool applyAutoMove(GameState* gameState)
+{
+    CardStack* dst = NULL_PTR;
+    int srcIdx = -1;
+    CardStack* src = gameState->findAutoMove(&dst, &srcIdx);
+    if (src == NULL_PTR) {
+        return false;
+    }
+    gameState->doAutoMove(src, srcIdx, dst);
+    return true;
+}
+
+static bool applyRecord(const unsigned char* record, GameState* gameState)
+{
+    switch (record[0])
+    {
+    case CODE_UNDO:
+        return gameState->undo();
+    case CODE_REDO:
+        return gameState->redo();
+    case CODE_SEEK:
+        return getU32(record+1) <= (unsigned int)gameState->history.getMoveCount() && gameState->seek((int)getU32(record+1));
+    case CODE_BRANCH:
+        return getU32(record+1) < (unsigned int)gameState->history.getBranchCount() && gameState->switchBranch((int)getU32(record+1));
+    case CODE_AUTO_MOVE:
+        return applyAutoMove(gameState);
+    default:
+        return record[0] < CODE_UNDO && applyMove(record, gameState);
+    }
+}
+
+MoveJournal::MoveJournal()
+    : file(NULL_PTR)
+    , syncMs(0)
+    , lastHandOver(0.0)
+    , recordCount(0)
+    , bufferCount(0)
+    , pending(NULL_PTR)
+    , pendingCount(0)
+    , pendingCapacity(0)
+    , writing(NULL_PTR)
+    , writingCapacity(0)
+    , stopping(false)
+{
+}
+
+MoveJournal::~MoveJournal()
+{
+    close();
+    delete[] pending;
+    delete[] writing;
+}
+
+bool MoveJournal::open(const char* path, unsigned long long sessionChecksum, int aSyncMs)
+{
+    close();
+    file = fopen(path, "wb");
+    if (file == NULL_PTR) {
+        return false;
+    }
+
+    if (pending == NULL_PTR)
+    {
+        pending = new unsigned char[BUFFER_SIZE];
+        pendingCapacity = BUFFER_SIZE;
+        writing = new unsigned char[BUFFER_SIZE];
+        writingCapacity = BUFFER_SIZE;
+    }
+    syncMs = aSyncMs;
+    recordCount = 0;
+
+    // The header is synced with the first records, or on its own once
+    // the interval is up
+    for (int i=0; i<MAGIC_SIZE; i++) {
+        putByte(MAGIC[i]);
+    }
+    putByte(VERSION);
+    putU32((unsigned int)sessionChecksum);
+    putU32((unsigned int)(sessionChecksum >> 32));
+    lastHandOver = Platform_GetTime();
+
+    stopping = false;
+    if (worker.start(workerMain, this) == false)
+    {
+        fclose(file);
+        file = NULL_PTR;
+        return false;
+    }
+    return true;
+}
+
+void MoveJournal::close()
+{
+    if (file != NULL_PTR)
+    {
+        handOver();
+        stopping = true;
+        wakeUp.set();
+        worker.join();
+        fclose(file);
+        file = NULL_PTR;
+    }
+    bufferCount = 0;
+    pendingCount = 0;
+}
+
+bool MoveJournal::isOpen() const
+{
+    return file != NULL_PTR;
+}
+
+void MoveJournal::OnHistoryEvent(const HistoryEvent& event, void* arg)
+{
+    ((MoveJournal*)arg)->add(event);
+}
+
+void MoveJournal::add(const HistoryEvent& event)
+{
+    if (file == NULL_PTR) {
+        return;
+    }
+
+    switch (event.type)
+    {
+    case HistoryEvent::TYPE_MOVE:
+        putByte(event.move.src << 4 | event.move.dst);
+        putByte(event.move.amount | (event.move.cardOpened ? FLAG_CARD_OPENED : 0) | (event.move.fromStock ? FLAG_FROM_STOCK : 0));
+        break;
+    case HistoryEvent::TYPE_UNDO:
+        putByte(CODE_UNDO);
+        break;
+    case HistoryEvent::TYPE_REDO:
+        putByte(CODE_REDO);
+        break;
+    case HistoryEvent::TYPE_SEEK:
+        putByte(CODE_SEEK);
+        putU32((unsigned int)event.arg);
+        break;
+    case HistoryEvent::TYPE_BRANCH:
+        putByte(CODE_BRANCH);
+        putU32((unsigned int)event.arg);
+        break;
+    case HistoryEvent::TYPE_AUTO_MOVE:
+        putByte(CODE_AUTO_MOVE);
+        break;
+    }
+    recordCount++;
+}
+
+void MoveJournal::update()
+{
+    if (file != NULL_PTR && bufferCount > 0 && (Platform_GetTime() - lastHandOver) * 1000.0 >= syncMs) {
+        handOver();
+    }
+}
+
+int MoveJournal::getRecordCount() const
+{
+    return recordCount;
+}
+
+unsigned long long MoveJournal::Checksum(const SnapshotBuffer& session)
+{
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+    const unsigned char* data = session.getData();
+    for (int i=0; i<session.getSize(); i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+bool MoveJournal::Recover(const char* path, unsigned long long sessionChecksum, GameState* gameState, int* records)
+{
+    *records = 0;
+
+    // Step #1: a header for this very session
+
+    SnapshotBuffer journal;
+    if (journal.loadFile(path) == false || journal.getSize() < HEADER_SIZE) {
+        return false;
+    }
+    const unsigned char* data = journal.getData();
+    unsigned long long checksum = (unsigned long long)getU32(data+12) << 32 | getU32(data+8);
+    if (memcmp(data, MAGIC, MAGIC_SIZE) != 0 || data[MAGIC_SIZE] != VERSION || checksum != sessionChecksum) {
+        return false;
+    }
+
+    // Step #2: the records as far as they go, made from an empty hand as
+    // the player made them
+
+    int size = journal.getSize();
+    int pos = HEADER_SIZE;
+    if (pos < size && gameState->hand.empty() == false) {
+        gameState->releaseHand(gameState->handSource);
+    }
+    while (pos < size)
+    {
+        int recordSize = getRecordSize(data[pos]);
+        if (pos + recordSize > size || applyRecord(data+pos, gameState) == false) {
+            break;
+        }
+        pos += recordSize;
+        (*records)++;
+    }
+    return true;
+}
+
+void MoveJournal::workerMain(void* arg)
+{
+    ((MoveJournal*)arg)->run();
+}
+
+void MoveJournal::run()
+{
+    bool last = false;
+    while (last == false)
+    {
+        wakeUp.wait(1000);
+        last = stopping;
+
+        int count = 0;
+        {
+            ScopedLock lock(mutex);
+            unsigned char* swapData = writing;
+            int swapCapacity = writingCapacity;
+            writing = pending;
+            writingCapacity = pendingCapacity;
+            pending = swapData;
+            pendingCapacity = swapCapacity;
+            count = pendingCount;
+            pendingCount = 0;
+        }
+        if (count > 0)
+        {
+            fwrite(writing, 1, count, file);
+            Platform_SyncFile(file);
+        }
+    }
+}
+
+void MoveJournal::handOver()
+{
+    if (bufferCount > 0)
+    {
+        ScopedLock lock(mutex);
+        if (pendingCount + bufferCount > pendingCapacity)
+        {
+            // The disk fell behind, the records wait in a bigger block
+            int newCapacity = pendingCapacity * 2;
+            while (pendingCount + bufferCount > newCapacity) {
+                newCapacity *= 2;
+            }
+            unsigned char* grown = new unsigned char[newCapacity];
+            memcpy(grown, pending, pendingCount);
+            delete[] pending;
+            pending = grown;
+            pendingCapacity = newCapacity;
+        }
+        memcpy(pending + pendingCount, buffer, bufferCount);
+        pendingCount += bufferCount;
+        bufferCount = 0;
+    }
+    lastHandOver = Platform_GetTime();
+    wakeUp.set();
+}
+
+void MoveJournal::putByte(int b)
+{
+    if (bufferCount == BUFFER_SIZE) {
+        handOver();
+    }
+    buffer[bufferCount++] = (unsigned char)b;
+}
+
+void MoveJournal::putU32(unsigned int v)
+{
+    for (int i=0; i<4; i++) {
+        putByte((int)(v >> (8*i)) & 0xFF);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "model.h"
+#include "platform.h"
+#include "snapshot.h"
+
+// Changes made to the history of a GameState since its session was last
+// saved, appended as they are made so that a crash loses no more than the
+// last sync interval of play. The file starts over with every save:
+//
+//   0xFE "XNYJNL" version   header start
+//   u64                     Checksum() of the saved session the records
+//                           go on from, low byte first
+//   src << 4 | dst, amount | cardOpened << 6 | fromStock << 7
+//                           move between stacks numbered as in
+//                           GameState::getStack()
+//   0xE0, 0xE1              undo, redo
+//   0xE2 u32, 0xE3 u32      GameState::seek, GameState::switchBranch
+//   0xE4                    auto move, the one GameState::findAutoMove picks
+//
+// A record cut short by a crash ends the journal.
+class MoveJournal
+{
+public:
+    static const int VERSION = 2;
+
+    MoveJournal();
+    ~MoveJournal();
+
+    // Starts the file over for the session saved with the given checksum.
+    // Records are handed to a thread that writes them and waits for the
+    // disk, every syncMs milliseconds or when a buffer fills up.
+    bool open(const char* path, unsigned long long sessionChecksum, int syncMs);
+    // Syncs what is left
+    void close();
+    bool isOpen() const;
+
+    // Passed to GameState::setHistoryListener with the journal as arg
+    static void OnHistoryEvent(const HistoryEvent& event, void* arg);
+    void add(const HistoryEvent& event);
+
+    // Hands the records over to be synced once the interval is up, call
+    // every tick
+    void update();
+
+    // Records added since open()
+    int getRecordCount() const;
+
+    // FNV-1a of the bytes of a saved session
+    static unsigned long long Checksum(const SnapshotBuffer& session);
+
+    // Makes the records of a journal on gameState, which has to be the
+    // session with the given checksum as loaded, a hand held then is put
+    // back first. False when there is no journal for that session.
+    // Stops at the first record cut short or not possible in the position.
+    static bool Recover(const char* path, unsigned long long sessionChecksum, GameState* gameState, int* records);
+
+private:
+    static const int BUFFER_SIZE = 4096;
+
+    static void workerMain(void* arg);
+    void run();
+    void handOver();
+    void putByte(int b);
+    void putU32(unsigned int v);
+
+    FILE* file;
+    int syncMs;
+    double lastHandOver;
+    int recordCount;
+
+    // Filled by add() on the calling thread
+    unsigned char buffer[BUFFER_SIZE];
+    int bufferCount;
+
+    // Handed over and not written yet, and what the thread writes from
+    Mutex mutex;
+    Signal wakeUp;
+    Thread worker;
+    unsigned char* pending;
+    int pendingCount;
+    int pendingCapacity;
+    unsigned char* writing;
+    int writingCapacity;
+    volatile bool stopping;
+
+    MoveJournal(const MoveJournal&);
+    MoveJournal& operator=(const MoveJournal&);
+};
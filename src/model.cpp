@@ -1,4 +1,106 @@
+#include <string.h>
+
 #include "model.h"
+#include "platform.h"
+
+// Zobrist keys. A card is described by what lies directly below it: another
+// card or the bottom of a stack, so moving a run of cards only changes the
+// link of its lowest card. Stock and waste form one sequence (waste bottom
+// to top, then stock top to bottom) which stays the same when the stock is
+// advanced or recycled, only the waste size changes. Closed cards are
+// always at the bottom of a tableau and are keyed by their count. Canonical
+// hashes key the closed count by the bottom card instead of the column.
+static const int LINK_BASE = CARDS_TOTAL;
+static const int LINK_NONE = -1;
+
+static unsigned long long LINK_KEYS[CARDS_TOTAL][CARDS_TOTAL + STACK_COUNT];
+static unsigned long long WASTE_SIZE_KEYS[CARDS_TOTAL + 1];
+static unsigned long long CLOSED_COUNT_KEYS[TABLEAU_COUNT][CARDS_TOTAL + 1];
+static unsigned long long HAND_SOURCE_KEYS[STACK_COUNT];
+static unsigned long long CANONICAL_CLOSED_KEYS[CARDS_TOTAL][TABLEAU_COUNT];
+
+static struct ZobristKeys
+{
+    ZobristKeys()
+    {
+        unsigned long long state = 0x58656E6E79ULL;
+        for (int i=0; i<CARDS_TOTAL; i++) {
+            for (int j=0; j<CARDS_TOTAL + STACK_COUNT; j++) {
+                LINK_KEYS[i][j] = Utils_SplitMix64(&state);
+            }
+        }
+        for (int i=0; i<=CARDS_TOTAL; i++) {
+            WASTE_SIZE_KEYS[i] = Utils_SplitMix64(&state);
+        }
+        for (int i=0; i<TABLEAU_COUNT; i++) {
+            for (int j=0; j<=CARDS_TOTAL; j++) {
+                CLOSED_COUNT_KEYS[i][j] = Utils_SplitMix64(&state);
+            }
+        }
+        for (int i=0; i<STACK_COUNT; i++) {
+            HAND_SOURCE_KEYS[i] = Utils_SplitMix64(&state);
+        }
+        for (int i=0; i<CARDS_TOTAL; i++) {
+            for (int j=0; j<TABLEAU_COUNT; j++) {
+                CANONICAL_CLOSED_KEYS[i][j] = Utils_SplitMix64(&state);
+            }
+        }
+    }
+} zobristKeys;
+
+// Card sets by card id for DestTable: cards that go on a card in a tableau
+// (other colour, one rank lower) and on a card in a foundation (same suit,
+// one rank higher)
+static unsigned long long TABLEAU_CHILD_SETS[CARDS_TOTAL];
+static unsigned long long FOUNDATION_NEXT_SETS[CARDS_TOTAL];
+static unsigned long long KING_SET;
+static unsigned long long ACE_SET;
+
+static struct CardSets
+{
+    CardSets()
+    {
+        for (int i=0; i<CARDS_TOTAL; i++)
+        {
+            GameCard card(i);
+            if (card.getValue() == 0) {
+                ACE_SET |= 1ULL << i;
+            }
+            if (card.isKing()) {
+                KING_SET |= 1ULL << i;
+            } else {
+                FOUNDATION_NEXT_SETS[i] = 1ULL << (i + 1);
+            }
+            for (int j=0; j<CARDS_TOTAL; j++)
+            {
+                GameCard child(j);
+                if (child.getColor() != card.getColor() && child.getValue() == card.getValue() - 1) {
+                    TABLEAU_CHILD_SETS[i] |= 1ULL << j;
+                }
+            }
+        }
+    }
+} cardSets;
+
+static void putBits(unsigned char* data, int* pos, int value, int bits)
+{
+    for (int i=0; i<bits; i++, (*pos)++) {
+        if (value & (1 << i)) {
+            data[*pos / 8] |= (unsigned char)(1 << (*pos % 8));
+        }
+    }
+}
+
+static int getBits(const unsigned char* data, int* pos, int bits)
+{
+    int value = 0;
+    for (int i=0; i<bits; i++, (*pos)++) {
+        if (data[*pos / 8] & (1 << (*pos % 8))) {
+            value |= 1 << i;
+        }
+    }
+    return value;
+}
 
 GameCard::GameCard(): id(0), state(STATE_CLOSED)
 {
@@ -82,7 +184,7 @@ GameCard::Color GameCard::getColor() const
     return getSuit() < 2 ? SUIT_RED : SUIT_BLACK;
 }
 
-CardStack::CardStack(): ordinal(-1)
+CardStack::CardStack(): ordinal(-1), type(TYPE_UNKNOWN)
 {
     static int handleCount = 0;
     handle = handleCount++;
@@ -95,16 +197,124 @@ void CardStack::init(Type t, int ord)
     clear();
 }
 
+void CardStack::assign(const CardStack& other)
+{
+    clear();
+    for (int i=0; i<other.size(); i++) {
+        push(other[i]);
+    }
+}
+
+GameDeal GameDeal::Random()
+{
+    return FromSeed(RandomNumber());
+}
+
+// The steps of Utils_CreateSeededPermutation, on the card bytes in place
+static void shuffleDeal(unsigned long long seed, unsigned char* cardIds)
+{
+    for (int i=0; i<CARDS_TOTAL; i++) {
+        cardIds[i] = (unsigned char)i;
+    }
+
+    unsigned long long state = seed;
+    for (int i=CARDS_TOTAL-1; i>0; i--)
+    {
+        unsigned long long z = Utils_SplitMix64(&state);
+        int j = (int)(((z >> 32) * (unsigned long long)(i+1)) >> 32);
+        unsigned char tmp = cardIds[i];
+        cardIds[i] = cardIds[j];
+        cardIds[j] = tmp;
+    }
+}
+
+GameDeal GameDeal::FromSeed(unsigned long long seed)
+{
+    GameDeal deal;
+    shuffleDeal(seed, deal.cardIds);
+    return deal;
+}
+
+void GameDeal::FromSeedRange(unsigned long long firstSeed, int count, unsigned char* out)
+{
+    for (int n=0; n<count; n++) {
+        shuffleDeal(firstSeed + n, out + (size_t)n * CARDS_TOTAL);
+    }
+}
+
+unsigned long long GameDeal::RandomNumber()
+{
+    // Consecutive calls, from any thread, go through a sequence that starts
+    // at a random place
+    static const unsigned long long GOLDEN_GAMMA = 0x9E3779B97F4A7C15ULL;
+    static volatile long long counter = 0;
+    static volatile unsigned long long start = 0;
+
+    // The start is taken from the clock by the first call. Calls racing it
+    // on other threads all go on from the one value that got stored, which
+    // is never zero.
+    unsigned long long first = Platform_AtomicLoad(&start);
+    if (first == 0)
+    {
+        Platform_AtomicCompareExchange(&start, 0, (unsigned long long)(Platform_GetTime() * 1000000.0) | 1);
+        first = Platform_AtomicLoad(&start);
+    }
+
+    unsigned long long state = first + (unsigned long long)Platform_AtomicAdd(&counter, 1) * GOLDEN_GAMMA;
+    return Utils_SplitMix64(&state);
+}
+
+bool PackedGameState::operator==(const PackedGameState& other) const
+{
+    return memcmp(data, other.data, SIZE) == 0;
+}
+
+bool PackedGameState::operator!=(const PackedGameState& other) const
+{
+    return (*this == other) == false;
+}
+
+unsigned int DestTable::getMask(int cardId) const
+{
+    unsigned int mask = 0;
+    for (int i=0; i<TABLEAU_COUNT + FOUNDATION_COUNT; i++) {
+        mask |= (unsigned int)((accepts[i] >> cardId) & 1) << i;
+    }
+    return mask;
+}
+
+static unsigned int getRunDestMask(const DestTable& table, int srcIdx, const CardStack& src, int idx)
+{
+    // Runs only go to tableaux. A whole tableau may move to an empty one,
+    // which is what putting it back looks like after it was picked up.
+    unsigned int isRun = 0u - (unsigned int)(idx < src.size() - 1);
+    unsigned int isWhole = 0u - (unsigned int)(idx == 0 && src.type == CardStack::TYPE_TABLEAU);
+    unsigned int mask = table.getMask(src[idx].id) & ~(DestTable::FOUNDATION_BITS & isRun);
+    return (mask | (table.emptyTableaux & isWhole)) & ~(1u << srcIdx);
+}
+
+static int pushMoves(LegalMove* moves, int count, int maxMoves, int src, int idx, unsigned int destMask)
+{
+    for (; destMask != 0 && count < maxMoves; destMask &= destMask - 1)
+    {
+        LegalMove& move = moves[count++];
+        move.src = (signed char)src;
+        move.idx = (signed char)idx;
+        move.dst = (signed char)Utils_LowestBit(destMask);
+    }
+    return count;
+}
+
 GameMove::GameMove()
-    : src(NULL_PTR)
-    , dst(NULL_PTR)
+    : src(STACK_ID_NULL)
+    , dst(STACK_ID_NULL)
     , amount(0)
     , cardOpened(false)
     , fromStock(false)
 {
 }
 
-GameMove::GameMove(CardStack* s, CardStack* d, int a, bool c, bool f)
+GameMove::GameMove(int s, int d, int a, bool c, bool f)
     : src(s), dst(d), amount(a), cardOpened(c), fromStock(f)
 {
 }
@@ -114,34 +324,111 @@ bool GameMove::isEmpty() const
     return amount == 0;
 }
 
-GameHistory::GameHistory(): moveCount(0), position(0)
+// Every card once and a hand that came from somewhere, for snapshots read
+// from a file
+static bool isValidSnapshot(const GameSnapshot& snapshot)
+{
+    int total = 0;
+    for (int i=0; i<STACK_COUNT; i++) {
+        total += snapshot.sizes[i];
+    }
+    bool ok = total == CARDS_TOTAL
+        && snapshot.handSource >= STACK_ID_NULL && snapshot.handSource < STACK_IDX_HAND
+        && (snapshot.handSource == STACK_ID_NULL) == (snapshot.sizes[STACK_IDX_HAND] == 0);
+
+    unsigned long long seen = 0;
+    for (int i=0; ok && i<CARDS_TOTAL; i++)
+    {
+        int id = snapshot.cards[i] & 0x7F;
+        ok = id < CARDS_TOTAL && ((seen >> id) & 1) == 0;
+        seen |= 1ULL << id;
+    }
+    return ok;
+}
+
+GameHistory::GameHistory(): position(0), keepBranches(false)
 {
 }
 
 void GameHistory::clear()
 {
-    moveCount = position = 0;
+    // Chunks are kept for the next game
+    moves.clear();
+    checkpoints.clear();
+    position = 0;
+    resetTree();
 }
 
-void GameHistory::addMove(CardStack* src, 
-                          CardStack* dst, 
+void GameHistory::addMove(int src, 
+                          int dst, 
                           int  amount, 
                           bool cardOpened, 
                           bool fromStock)
 {
-    GameMove move(src, dst, amount, cardOpened, fromStock);
-    moves[position++] = move;
-    moveCount = position;
+    Code code = Encode(src, dst, amount, cardOpened, fromStock);
+    moves.truncate(position);
+    moves.push(code);
+
+    // Checkpoints past the position belong to the moves just dropped
+    int kept = position / CHECKPOINT_INTERVAL + 1;
+    if (checkpoints.size() > kept) {
+        checkpoints.truncate(kept);
+    }
+    if (keepBranches) {
+        addNode(code);
+    }
+    position++;
+}
+
+void GameHistory::addNode(Code code)
+{
+    // The same move made again from the same position takes the node it
+    // had, with the moves below it
+    int parent = lineNodes[position];
+    int prev = STACK_ID_NULL;
+    int child = nodes[parent].firstChild;
+    while (child != STACK_ID_NULL && nodes[child].code != code)
+    {
+        prev = child;
+        child = nodes[child].nextSibling;
+    }
+
+    if (child == STACK_ID_NULL)
+    {
+        Node node;
+        node.firstChild = STACK_ID_NULL;
+        node.nextSibling = nodes[parent].firstChild;
+        node.code = code;
+        child = nodes.size();
+        nodes.push(node);
+        nodes[parent].firstChild = child;
+    }
+    else if (prev != STACK_ID_NULL)
+    {
+        nodes[prev].nextSibling = nodes[child].nextSibling;
+        nodes[child].nextSibling = nodes[parent].firstChild;
+        nodes[parent].firstChild = child;
+    }
+
+    lineNodes.truncate(position+1);
+    lineNodes.push(child);
 }
 
 GameMove GameHistory::undo()
 {
-    return position > 0 ? moves[--position] : GameMove();
+    if (position == 0) {
+        return GameMove();
+    }
+    position--;
+    return Decode(moves[position]);
 }
 
 GameMove GameHistory::redo()
 {
-    return position < moveCount ? moves[position++] : GameMove();
+    if (position == moves.size()) {
+        return GameMove();
+    }
+    return Decode(moves[position++]);
 }
 
 bool GameHistory::canUndo() const
@@ -151,11 +438,228 @@ bool GameHistory::canUndo() const
 
 bool GameHistory::canRedo() const
 {
-    return position < moveCount;
+    return position < moves.size();
+}
+
+int GameHistory::getPosition() const
+{
+    return position;
+}
+
+int GameHistory::getMoveCount() const
+{
+    return moves.size();
+}
+
+void GameHistory::setKeepBranches(bool keep)
+{
+    keepBranches = keep;
+    resetTree();
+}
+
+void GameHistory::resetTree()
+{
+    // The tree starts as the moves made so far
+    nodes.clear();
+    lineNodes.clear();
+    if (keepBranches == false) {
+        return;
+    }
+
+    for (int i=0; i<=moves.size(); i++)
+    {
+        Node node;
+        node.firstChild = i < moves.size() ? i+1 : STACK_ID_NULL;
+        node.nextSibling = STACK_ID_NULL;
+        node.code = i > 0 ? moves[i-1] : 0;
+        nodes.push(node);
+        lineNodes.push(i);
+    }
+}
+
+int GameHistory::getBranchCount() const
+{
+    if (keepBranches == false) {
+        return canRedo() ? 1 : 0;
+    }
+
+    int count = 0;
+    for (int child = nodes[lineNodes[position]].firstChild; child != STACK_ID_NULL; child = nodes[child].nextSibling) {
+        count++;
+    }
+    return count;
+}
+
+bool GameHistory::switchBranch(int n)
+{
+    if (keepBranches == false) {
+        return false;
+    }
+
+    int parent = lineNodes[position];
+    int prev = STACK_ID_NULL;
+    int child = nodes[parent].firstChild;
+    for (int i=0; i<n && child != STACK_ID_NULL; i++)
+    {
+        prev = child;
+        child = nodes[child].nextSibling;
+    }
+    if (child == STACK_ID_NULL || n < 0) {
+        return false;
+    }
+
+    if (prev != STACK_ID_NULL)
+    {
+        nodes[prev].nextSibling = nodes[child].nextSibling;
+        nodes[child].nextSibling = nodes[parent].firstChild;
+        nodes[parent].firstChild = child;
+    }
+
+    moves.truncate(position);
+    lineNodes.truncate(position+1);
+    for (int node = child; node != STACK_ID_NULL; node = nodes[node].firstChild)
+    {
+        moves.push(nodes[node].code);
+        lineNodes.push(node);
+    }
+
+    int kept = position / CHECKPOINT_INTERVAL + 1;
+    if (checkpoints.size() > kept) {
+        checkpoints.truncate(kept);
+    }
+    return true;
+}
+
+bool GameHistory::needsCheckpoint(unsigned long long hash) const
+{
+    // Checkpoints go with the moves past them, the hash is a last check
+    // that the one kept is of this very position
+    if (position % CHECKPOINT_INTERVAL != 0) {
+        return false;
+    }
+    int n = position / CHECKPOINT_INTERVAL;
+    return n >= checkpoints.size() || checkpoints[n].hash != hash;
+}
+
+void GameHistory::setCheckpoint(const GameSnapshot& snapshot, unsigned long long hash)
+{
+    // Checkpoints are reached in order, the one after the last at most
+    int n = position / CHECKPOINT_INTERVAL;
+    if (n > checkpoints.size()) {
+        return;
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.position = snapshot;
+    checkpoint.hash = hash;
+
+    checkpoints.truncate(n);
+    checkpoints.push(checkpoint);
+}
+
+int GameHistory::getCheckpointPosition(int moveIndex) const
+{
+    int n = moveIndex / CHECKPOINT_INTERVAL;
+    if (n >= checkpoints.size()) {
+        n = checkpoints.size()-1;
+    }
+    return n * CHECKPOINT_INTERVAL;
+}
+
+const GameSnapshot& GameHistory::seekCheckpoint(int moveIndex)
+{
+    position = getCheckpointPosition(moveIndex);
+    return checkpoints[position / CHECKPOINT_INTERVAL].position;
+}
+
+void GameHistory::save(SnapshotBuffer* buffer) const
+{
+    buffer->putInt(position);
+    buffer->putInt(keepBranches ? 1 : 0);
+    buffer->putVec(moves);
+    buffer->putVec(checkpoints);
+    buffer->putVec(nodes);
+    buffer->putVec(lineNodes);
+}
+
+bool GameHistory::load(SnapshotBuffer* buffer)
+{
+    position = buffer->getInt();
+    keepBranches = buffer->getInt() != 0;
+    bool ok = buffer->getVec(&moves, MAX_LOADED_MOVES)
+        && buffer->getVec(&checkpoints, MAX_LOADED_MOVES / CHECKPOINT_INTERVAL + 1)
+        && buffer->getVec(&nodes, MAX_LOADED_MOVES + 1)
+        && buffer->getVec(&lineNodes, MAX_LOADED_MOVES + 1);
+
+    // Indices have to stay in range, whatever the moves mean. Checkpoints
+    // past the moves, of a line left before addMove dropped them, are
+    // never restored.
+    int maxCheckpoints = moves.size() / CHECKPOINT_INTERVAL + 1;
+    if (ok && checkpoints.size() > maxCheckpoints) {
+        checkpoints.truncate(maxCheckpoints);
+    }
+    ok = ok && position >= 0 && position <= moves.size() && checkpoints.size() >= 1;
+    for (int i=0; ok && i<checkpoints.size(); i++) {
+        ok = isValidSnapshot(checkpoints[i].position) && checkpoints[i].position.handSource == STACK_ID_NULL;
+    }
+    for (int i=0; ok && i<moves.size(); i++)
+    {
+        GameMove move = Decode(moves[i]);
+        ok = move.src < STACK_IDX_HAND && move.dst < STACK_IDX_HAND && move.src != move.dst
+            && move.amount >= 1 && move.amount <= CARDS_TOTAL;
+    }
+    if (keepBranches) {
+        ok = ok && nodes.size() >= 1 && lineNodes.size() == moves.size() + 1;
+    } else {
+        ok = ok && nodes.size() == 0 && lineNodes.size() == 0;
+    }
+    for (int i=0; ok && i<nodes.size(); i++)
+    {
+        ok = nodes[i].firstChild >= STACK_ID_NULL && nodes[i].firstChild < nodes.size()
+            && nodes[i].nextSibling >= STACK_ID_NULL && nodes[i].nextSibling < nodes.size();
+    }
+    for (int i=0; ok && i<lineNodes.size(); i++) {
+        ok = lineNodes[i] >= 0 && lineNodes[i] < nodes.size();
+    }
+
+    if (ok == false)
+    {
+        clear();
+        buffer->fail();
+    }
+    return ok;
+}
+
+GameHistory::Code GameHistory::Encode(int src, int dst, int amount, bool cardOpened, bool fromStock)
+{
+    return (Code)(src | (dst << 4) | (amount << 8) | (cardOpened ? 0x4000 : 0) | (fromStock ? 0x8000 : 0));
+}
+
+GameMove GameHistory::Decode(Code code)
+{
+    return GameMove(code & 0xF, (code >> 4) & 0xF, (code >> 8) & 0x3F, (code & 0x4000) != 0, (code & 0x8000) != 0);
 }
 
-GameState::GameState(): handSource(NULL_PTR)
+GameState::GameState()
+    : handSource(NULL_PTR)
+    , hashKey(0)
+    , dealNumber(0)
+    , numbered(false)
+    , listener(NULL_PTR)
+    , listenerArg(NULL_PTR)
 {
+    for (int i=0; i<TABLEAU_COUNT; i++) {
+        stacks[STACK_IDX_TABLEAU + i] = &tableaux[i];
+    }
+    for (int i=0; i<FOUNDATION_COUNT; i++) {
+        stacks[STACK_IDX_FOUNDATION + i] = &foundations[i];
+    }
+    stacks[STACK_IDX_STOCK] = &stock;
+    stacks[STACK_IDX_WASTE] = &waste;
+    stacks[STACK_IDX_HAND] = &hand;
+    initAllStacks();
+    rebuildCardIndex();
+    resetHistory();
 }
 
 void GameState::initAllStacks()
@@ -173,28 +677,20 @@ void GameState::initAllStacks()
     hand.init(CardStack::TYPE_HAND);
 }
 
-void GameState::dealRandomGame()
+void GameState::dealGame(const GameDeal& deal)
 {
-    GameCard cardData[CARDS_TOTAL];
-    for (int i=0; i<CARDS_TOTAL; i++) {
-        cardData[i] = GameCard(i);
-    }
-
-    int cardIdx[CARDS_TOTAL];
-    Utils_CreateRandomPermutation(cardIdx, CARDS_TOTAL);
-
     int top = 0;
     for (int i=0; i<TABLEAU_COUNT; i++)
     {
         for (int j=0; j<i; j++) {
-            tableaux[i].push(cardData[cardIdx[top++]]);
+            tableaux[i].push(GameCard(deal.cardIds[top++]));
         }
-        cardData[cardIdx[top]].open();
-        tableaux[i].push(cardData[cardIdx[top++]]);
+        tableaux[i].push(GameCard(deal.cardIds[top++]));
+        tableaux[i].top().open();
     }
 
     while (top < CARDS_TOTAL) {
-        stock.push(cardData[cardIdx[top++]]);
+        stock.push(GameCard(deal.cardIds[top++]));
     }
 }
 
@@ -231,110 +727,674 @@ void GameState::dealReadyToAuto()
 }
 
 void GameState::init()
+{
+    init(GameDeal::RandomNumber());
+}
+
+void GameState::init(const GameDeal& deal)
 {
     initAllStacks();
     //dealReadyToAuto();
-    dealRandomGame();
+    dealGame(deal);
     handSource = NULL_PTR;
-    history.clear();
+    hashKey = computeHash();
+    rebuildCardIndex();
+    resetHistory();
+    numbered = false;
 }
 
-void GameState::registerMove(CardStack* src,
-                             CardStack* dst,
-                             int  amount,
-                             bool cardOpened,
-                             bool fromStock)
+void GameState::init(unsigned long long aDealNumber)
 {
-    history.addMove(src, dst, amount, cardOpened, fromStock);
+    init(GameDeal::FromSeed(aDealNumber));
+    dealNumber = aDealNumber;
+    numbered = true;
 }
 
-bool GameState::redo()
+bool GameState::getDealNumber(unsigned long long* number) const
 {
-    if (history.canRedo())
-    {
-        GameMove move = history.redo();
-        if (move.fromStock)
-        {
-            for (int i=0; i<move.amount; i++)
-            {
-                move.src->transfer(*move.dst, 1);
-                move.dst->top().switchState();
-            }
-        }
-        else
-        {
-            move.src->transfer(*move.dst, move.amount);
-            if (move.cardOpened) {
-                move.src->top().open();
-            }
-        }
-        return true;
-    }
-    return false;
+    *number = dealNumber;
+    return numbered;
 }
 
-void GameState::fullRedo()
+void GameState::copyPosition(const GameState& other)
 {
-    while (redo())
-        ;
+    initAllStacks();
+    for (int i=0; i<STACK_COUNT; i++) {
+        getStack(i)->assign(*other.getStack(i));
+    }
+    handSource = other.handSource != NULL_PTR 
+        ? getStack(other.getStackIndex(other.handSource)) 
+        : NULL_PTR;
+    dealNumber = other.dealNumber;
+    numbered = other.numbered;
+    hashKey = computeHash();
+    rebuildCardIndex();
+    resetHistory();
 }
 
-bool GameState::undo()
+void GameState::shuffleHiddenCards(unsigned long long* randomState)
 {
-    if (history.canUndo())
-    {
-        GameMove move = history.undo();
-        if (move.fromStock)
-        {
-            for (int i=0; i<move.amount; i++)
-            {
-                move.dst->transfer(*move.src, 1);
-                move.src->top().switchState();
-            }
-        }
-        else
-        {
-            if (move.cardOpened) {
-                move.src->top().close();
-            }
-            move.dst->transfer(*move.src, move.amount);
+    GameCard* hidden[CARDS_TOTAL];
+    int count = 0;
+    for (int i=0; i<TABLEAU_COUNT; i++) {
+        for (int j=0; j<tableaux[i].size() && tableaux[i][j].opened() == false; j++) {
+            hidden[count++] = &tableaux[i][j];
         }
-        return true;
     }
-    return false;
-}
+    for (int i=0; i<stock.size(); i++) {
+        hidden[count++] = &stock[i];
+    }
 
-void GameState::fullUndo()
-{
-    while (undo())
-        ;
+    for (int i=count-1; i>0; i--)
+    {
+        int j = (int)(((Utils_SplitMix64(randomState) >> 32) * (unsigned long long)(i+1)) >> 32);
+        int id = hidden[i]->id;
+        hidden[i]->id = hidden[j]->id;
+        hidden[j]->id = id;
+    }
+    hashKey = computeHash();
+    rebuildCardIndex();
+    resetHistory();
 }
-    
-void GameState::advanceStock()
+
+void GameState::pack(PackedGameState* packed) const
 {
+    memset(packed->data, 0, PackedGameState::SIZE);
+    int pos = 0;
+
+    // Step #1: foundations hold a suit in order, so the top value is enough
+
+    for (int i=0; i<FOUNDATION_COUNT; i++)
+    {
+        putBits(packed->data, &pos, foundations[i].size(), 4);
+        putBits(packed->data, &pos, foundations[i].empty() ? 0 : foundations[i][0].getSuit(), 2);
+    }
+
+    // Step #2: tableaux bottom-up after the number of closed cards
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& t = tableaux[i];
+        int closed = 0;
+        while (closed < t.size() && t[closed].opened() == false) {
+            closed++;
+        }
+
+        putBits(packed->data, &pos, t.size(), 6);
+        putBits(packed->data, &pos, closed, 6);
+        for (int j=0; j<t.size(); j++) {
+            putBits(packed->data, &pos, t[j].id, 6);
+        }
+    }
+
+    // Step #3: waste bottom-up, then stock top-down
+
+    putBits(packed->data, &pos, waste.size(), 6);
+    putBits(packed->data, &pos, stock.size(), 6);
+    for (int i=0; i<waste.size(); i++) {
+        putBits(packed->data, &pos, waste[i].id, 6);
+    }
+    for (int i=stock.size()-1; i>=0; i--) {
+        putBits(packed->data, &pos, stock[i].id, 6);
+    }
+
+    // Step #4: cards being dragged
+
+    putBits(packed->data, &pos, hand.size(), 6);
+    putBits(packed->data, &pos, hand.empty() ? 0 : getStackIndex(handSource), 4);
+    for (int i=0; i<hand.size(); i++) {
+        putBits(packed->data, &pos, hand[i].id, 6);
+    }
+}
+
+void GameState::unpack(const PackedGameState& packed)
+{
+    initAllStacks();
+    int pos = 0;
+
+    for (int i=0; i<FOUNDATION_COUNT; i++)
+    {
+        int count = getBits(packed.data, &pos, 4);
+        int suit = getBits(packed.data, &pos, 2);
+        for (int j=0; j<count; j++)
+        {
+            foundations[i].push(GameCard(GameCard::GetAceId(suit) + j));
+            foundations[i].top().open();
+        }
+    }
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        int count = getBits(packed.data, &pos, 6);
+        int closed = getBits(packed.data, &pos, 6);
+        for (int j=0; j<count; j++)
+        {
+            tableaux[i].push(GameCard(getBits(packed.data, &pos, 6)));
+            if (j >= closed) {
+                tableaux[i].top().open();
+            }
+        }
+    }
+
+    int wasteCount = getBits(packed.data, &pos, 6);
+    int stockCount = getBits(packed.data, &pos, 6);
+    for (int i=0; i<wasteCount; i++)
+    {
+        waste.push(GameCard(getBits(packed.data, &pos, 6)));
+        waste.top().open();
+    }
+    int stockIds[CARDS_TOTAL];
+    for (int i=0; i<stockCount; i++) {
+        stockIds[i] = getBits(packed.data, &pos, 6);
+    }
+    for (int i=stockCount-1; i>=0; i--) {
+        stock.push(GameCard(stockIds[i]));
+    }
+
+    int handCount = getBits(packed.data, &pos, 6);
+    int handStack = getBits(packed.data, &pos, 4);
+    for (int i=0; i<handCount; i++)
+    {
+        hand.push(GameCard(getBits(packed.data, &pos, 6)));
+        hand.top().open();
+    }
+
+    handSource = hand.empty() ? NULL_PTR : getStack(handStack);
+    numbered = false;
+    hashKey = computeHash();
+    rebuildCardIndex();
+    resetHistory();
+}
+
+void GameState::takeSnapshot(GameSnapshot* snapshot) const
+{
+    int n = 0;
+    for (int i=0; i<STACK_COUNT; i++)
+    {
+        const CardStack& stack = *stacks[i];
+        snapshot->sizes[i] = (unsigned char)stack.size();
+        for (int j=0; j<stack.size(); j++) {
+            snapshot->cards[n++] = (unsigned char)(stack[j].id | (stack[j].opened() ? 0x80 : 0));
+        }
+    }
+    snapshot->handSource = (signed char)(handSource != NULL_PTR ? getStackIndex(handSource) : STACK_ID_NULL);
+}
+
+void GameState::restoreSnapshot(const GameSnapshot& snapshot)
+{
+    int n = 0;
+    for (int i=0; i<STACK_COUNT; i++)
+    {
+        CardStack& stack = *stacks[i];
+        stack.clear();
+        for (int j=0; j<snapshot.sizes[i]; j++)
+        {
+            int code = snapshot.cards[n++];
+            stack.push(GameCard(code & 0x7F));
+            if (code & 0x80) {
+                stack.top().open();
+            }
+        }
+    }
+    handSource = getStack(snapshot.handSource);
+    hashKey = computeHash();
+    rebuildCardIndex();
+}
+
+void GameState::resetHistory()
+{
+    history.clear();
+    updateCheckpoint();
+}
+
+void GameState::updateCheckpoint()
+{
+    if (hand.empty() && history.needsCheckpoint(hashKey))
+    {
+        GameSnapshot snapshot;
+        takeSnapshot(&snapshot);
+        history.setCheckpoint(snapshot, hashKey);
+    }
+}
+
+unsigned long long GameState::getHash() const
+{
+    return hashKey;
+}
+
+unsigned long long GameState::computeHash() const
+{
+    unsigned long long key = WASTE_SIZE_KEYS[waste.size()];
+
+    for (int i=0; i<STACK_COUNT; i++)
+    {
+        const CardStack* cs = getStack(i);
+        for (int j=0; j<cs->size(); j++) {
+            key ^= LINK_KEYS[(*cs)[j].id][getLinkBelow(cs, j)];
+        }
+    }
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        int closed = 0;
+        for (int j=0; j<tableaux[i].size(); j++) {
+            closed += tableaux[i][j].opened() ? 0 : 1;
+        }
+        key ^= CLOSED_COUNT_KEYS[i][closed];
+    }
+
+    if (handSource != NULL_PTR) {
+        key ^= HAND_SOURCE_KEYS[getStackIndex(handSource)];
+    }
+
+    return key;
+}
+
+unsigned long long GameState::getCanonicalHash(bool withStockPosition) const
+{
+    // Only the links of bottom cards and the closed counts name a slot, they
+    // are swapped for the keys of the first slot and of the bottom card
+    unsigned long long key = hashKey;
+    if (withStockPosition == false) {
+        key ^= WASTE_SIZE_KEYS[waste.size()];
+    }
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& t = tableaux[i];
+        int closed = 0;
+        while (closed < t.size() && t[closed].opened() == false) {
+            closed++;
+        }
+        key ^= CLOSED_COUNT_KEYS[i][closed];
+
+        if (t.empty() == false)
+        {
+            int bottom = t[0].id;
+            key ^= LINK_KEYS[bottom][LINK_BASE + STACK_IDX_TABLEAU + i] ^ LINK_KEYS[bottom][LINK_BASE + STACK_IDX_TABLEAU];
+            key ^= CANONICAL_CLOSED_KEYS[bottom][closed];
+        }
+    }
+
+    for (int i=0; i<FOUNDATION_COUNT; i++) {
+        if (foundations[i].empty() == false)
+        {
+            int bottom = foundations[i][0].id;
+            key ^= LINK_KEYS[bottom][LINK_BASE + STACK_IDX_FOUNDATION + i] ^ LINK_KEYS[bottom][LINK_BASE + STACK_IDX_FOUNDATION];
+        }
+    }
+
+    return key;
+}
+
+void GameState::getCanonicalView(CanonicalView* view) const
+{
+    // Insertion sort by bottom card, empty columns count as the highest
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        int bottom = tableaux[i].empty() ? CARDS_TOTAL : tableaux[i][0].id;
+        int j = i;
+        while (j > 0)
+        {
+            const CardStack& prev = tableaux[view->tableaux[j-1] - STACK_IDX_TABLEAU];
+            int prevBottom = prev.empty() ? CARDS_TOTAL : prev[0].id;
+            if (prevBottom <= bottom) {
+                break;
+            }
+            view->tableaux[j] = view->tableaux[j-1];
+            j--;
+        }
+        view->tableaux[j] = (signed char)(STACK_IDX_TABLEAU + i);
+    }
+
+    for (int s=0; s<SUIT_COUNT; s++) {
+        view->foundations[s] = STACK_ID_NULL;
+    }
+    for (int i=0; i<FOUNDATION_COUNT; i++) {
+        if (foundations[i].empty() == false) {
+            view->foundations[foundations[i][0].getSuit()] = (signed char)(STACK_IDX_FOUNDATION + i);
+        }
+    }
+}
+
+int GameState::getLinkBelow(const CardStack* stack, int idx) const
+{
+    if (stack == &stock)
+    {
+        if (idx+1 < stock.size()) {
+            return stock[idx+1].id;
+        }
+        return waste.empty() ? LINK_BASE + STACK_IDX_STOCK : waste.top().id;
+    }
+
+    if (idx > 0) {
+        return (*stack)[idx-1].id;
+    }
+    return LINK_BASE + (stack == &waste ? STACK_IDX_STOCK : getStackIndex(stack));
+}
+
+int GameState::getLinkAbove(const CardStack* stack, int idx) const
+{
+    if (stack == &stock) {
+        return idx > 0 ? stock[idx-1].id : LINK_NONE;
+    }
+
+    if (idx+1 < stack->size()) {
+        return (*stack)[idx+1].id;
+    }
+    if (stack == &waste && stock.empty() == false) {
+        return stock.top().id;
+    }
+    return LINK_NONE;
+}
+
+unsigned long long GameState::linkKeys(const CardStack* stack, int idx, int amount) const
+{
+    // Keys that change when cards [idx, idx+amount) are taken out of the
+    // stack or have just been put there
+    int first = (*stack)[idx].id;
+    int last = (*stack)[idx+amount-1].id;
+    int below = getLinkBelow(stack, idx);
+    int above = getLinkAbove(stack, idx+amount-1);
+
+    unsigned long long keys = LINK_KEYS[first][below];
+    if (above != LINK_NONE) {
+        keys ^= LINK_KEYS[above][last] ^ LINK_KEYS[above][below];
+    }
+    return keys;
+}
+
+void GameState::moveCards(CardStack* src, CardStack* dst, int amount)
+{
+    if (amount <= 0) {
+        return;
+    }
+
+    // Runs put on or taken from the stock are reversed in the talon
+    // sequence, which never happens during a game
+    if (amount > 1 && (src == &stock || dst == &stock))
+    {
+        src->transfer(*dst, amount);
+        hashKey = computeHash();
+        indexCards(src, src->size());
+        indexCards(dst, dst->size()-amount);
+        return;
+    }
+
+    int wasteSize = waste.size();
+    hashKey ^= linkKeys(src, src->size()-amount, amount);
+    src->transfer(*dst, amount);
+    hashKey ^= linkKeys(dst, dst->size()-amount, amount);
+    moveStockCursor(wasteSize);
+    indexCards(src, src->size());
+    indexCards(dst, dst->size()-amount);
+}
+
+void GameState::openTop(CardStack* stack)
+{
+    if (stack->top().opened()) {
+        return;
+    }
+
+    stack->top().open();
+    if (stack->type == CardStack::TYPE_TABLEAU) {
+        hashKey ^= CLOSED_COUNT_KEYS[stack->ordinal][stack->size()] ^ CLOSED_COUNT_KEYS[stack->ordinal][stack->size()-1];
+    }
+}
+
+void GameState::closeTop(CardStack* stack)
+{
+    if (stack->top().opened() == false) {
+        return;
+    }
+
+    stack->top().close();
+    if (stack->type == CardStack::TYPE_TABLEAU) {
+        hashKey ^= CLOSED_COUNT_KEYS[stack->ordinal][stack->size()-1] ^ CLOSED_COUNT_KEYS[stack->ordinal][stack->size()];
+    }
+}
+
+void GameState::moveStockCursor(int oldWasteSize)
+{
+    hashKey ^= WASTE_SIZE_KEYS[oldWasteSize] ^ WASTE_SIZE_KEYS[waste.size()];
+}
+
+void GameState::registerMove(int  src,
+                             int  dst,
+                             int  amount,
+                             bool cardOpened,
+                             bool fromStock)
+{
+    history.addMove(src, dst, amount, cardOpened, fromStock);
+    if (listener != NULL_PTR) {
+        notify(HistoryEvent::TYPE_MOVE, GameMove(src, dst, amount, cardOpened, fromStock), 0);
+    }
+}
+
+bool GameState::redo()
+{
+    bool done = redoMove();
+    if (done)
+    {
+        updateCheckpoint();
+        notify(HistoryEvent::TYPE_REDO, GameMove(), 0);
+    }
+    return done;
+}
+
+bool GameState::redoMove()
+{
+    if (history.canRedo())
+    {
+        GameMove move = history.redo();
+        CardStack* src = stacks[move.src];
+        CardStack* dst = stacks[move.dst];
+        if (move.fromStock)
+        {
+            int wasteSize = waste.size();
+            for (int i=0; i<move.amount; i++)
+            {
+                src->transfer(*dst, 1);
+                dst->top().switchState();
+            }
+            moveStockCursor(wasteSize);
+            indexCards(dst, dst->size()-move.amount);
+        }
+        else
+        {
+            moveCards(src, dst, move.amount);
+            if (move.cardOpened) {
+                openTop(src);
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+void GameState::fullRedo()
+{
+    if (seek(history.getMoveCount()) == false)
+    {
+        while (redo())
+            ;
+    }
+}
+
+bool GameState::undo()
+{
+    bool done = undoMove();
+    if (done) {
+        notify(HistoryEvent::TYPE_UNDO, GameMove(), 0);
+    }
+    return done;
+}
+
+bool GameState::undoMove()
+{
+    if (history.canUndo())
+    {
+        GameMove move = history.undo();
+        CardStack* src = stacks[move.src];
+        CardStack* dst = stacks[move.dst];
+        if (move.fromStock)
+        {
+            int wasteSize = waste.size();
+            for (int i=0; i<move.amount; i++)
+            {
+                dst->transfer(*src, 1);
+                src->top().switchState();
+            }
+            moveStockCursor(wasteSize);
+            indexCards(src, src->size()-move.amount);
+        }
+        else
+        {
+            if (move.cardOpened) {
+                closeTop(src);
+            }
+            moveCards(dst, src, move.amount);
+        }
+        return true;
+    }
+    return false;
+}
+
+void GameState::fullUndo()
+{
+    if (seek(0) == false)
+    {
+        while (undo())
+            ;
+    }
+}
+
+bool GameState::seek(int moveIndex)
+{
+    bool done = seekMove(moveIndex);
+    if (done) {
+        notify(HistoryEvent::TYPE_SEEK, GameMove(), moveIndex);
+    }
+    return done;
+}
+
+bool GameState::seekMove(int moveIndex)
+{
+    if (moveIndex < 0 || moveIndex > history.getMoveCount() || hand.empty() == false) {
+        return false;
+    }
+
+    // Step #1: restore the checkpoint below the index, unless stepping
+    // from the current position takes fewer moves
+
+    int position = history.getPosition();
+    int distance = moveIndex > position ? moveIndex - position : position - moveIndex;
+    if (distance > moveIndex - history.getCheckpointPosition(moveIndex)) {
+        restoreSnapshot(history.seekCheckpoint(moveIndex));
+    }
+
+    // Step #2: the moves left, with the checkpoints a new branch doesn't
+    // have yet
+
+    while (history.getPosition() < moveIndex)
+    {
+        redoMove();
+        updateCheckpoint();
+    }
+    while (history.getPosition() > moveIndex) {
+        undoMove();
+    }
+    return true;
+}
+
+bool GameState::switchBranch(int n)
+{
+    if (hand.empty() == false || history.switchBranch(n) == false) {
+        return false;
+    }
+
+    notify(HistoryEvent::TYPE_BRANCH, GameMove(), n);
+    return true;
+}
+
+void GameState::setHistoryListener(HistoryListener func, void* arg)
+{
+    listener = func;
+    listenerArg = arg;
+}
+
+void GameState::save(SnapshotBuffer* buffer) const
+{
+    GameSnapshot snapshot;
+    takeSnapshot(&snapshot);
+    buffer->putBytes(&snapshot, sizeof(snapshot));
+    buffer->putU64(dealNumber);
+    buffer->putInt(numbered ? 1 : 0);
+    history.save(buffer);
+}
+
+bool GameState::load(SnapshotBuffer* buffer)
+{
+    GameSnapshot snapshot;
+    buffer->getBytes(&snapshot, sizeof(snapshot));
+    dealNumber = buffer->getU64();
+    numbered = buffer->getInt() != 0;
+
+    // The position, then the history with its checkpoints, each of them
+    // checked as the position is
+    if (isValidSnapshot(snapshot) == false || buffer->failed() || history.load(buffer) == false)
+    {
+        buffer->fail();
+        return false;
+    }
+    initAllStacks();
+    restoreSnapshot(snapshot);
+    return true;
+}
+
+void GameState::notify(HistoryEvent::Type type, const GameMove& move, int arg)
+{
+    if (listener != NULL_PTR)
+    {
+        HistoryEvent event;
+        event.type = type;
+        event.move = move;
+        event.arg = arg;
+        listener(event, listenerArg);
+    }
+}
+    
+void GameState::advanceStock()
+{
+    int wasteSize = waste.size();
     if (stock.empty() && waste.empty() == false)
     {
-        registerMove(&waste, &stock, waste.size(), false, true);
+        registerMove(STACK_IDX_WASTE, STACK_IDX_STOCK, waste.size(), false, true);
         while (waste.empty() == false)
         {
             waste.transfer(stock, 1);
             stock.top().close();
         }
+        indexCards(&stock, 0);
     }
     else if (stock.empty() == false)
     {
         stock.transfer(waste, 1);
         waste.top().open();
-        registerMove(&stock, &waste, 1, false, true);
+        registerMove(STACK_IDX_STOCK, STACK_IDX_WASTE, 1, false, true);
+        indexCards(&waste, waste.size()-1);
     }
+    moveStockCursor(wasteSize);
+    updateCheckpoint();
 }
 
 void GameState::fillHand(CardStack* stack, int idx)
 {
     if (hand.empty() && idx >= 0 && idx < stack->size())
     {
-        stack->transfer(hand, stack->size()-idx);
+        moveCards(stack, &hand, stack->size()-idx);
         handSource = stack;
+        hashKey ^= HAND_SOURCE_KEYS[getStackIndex(handSource)];
     }
 }
 
@@ -343,16 +1403,19 @@ void GameState::releaseHand(CardStack* dest)
     if (hand.empty() == false && dest != NULL_PTR)
     {
         bool doOpenCard = shouldOpenCard();
+        int srcIdx = getStackIndex(handSource);
 
         if (dest != handSource) {
-            registerMove(handSource, dest, hand.size(), doOpenCard, false);
+            registerMove(srcIdx, getStackIndex(dest), hand.size(), doOpenCard, false);
             if (doOpenCard) {
-                handSource->top().open();
+                openTop(handSource);
             }
         }
 
-        hand.transfer(*dest, hand.size());
+        moveCards(&hand, dest, hand.size());
+        hashKey ^= HAND_SOURCE_KEYS[srcIdx];
         handSource = NULL_PTR;
+        updateCheckpoint();
     }
 }
 
@@ -361,37 +1424,26 @@ bool GameState::canReleaseHand(CardStack* dest) const
     if (dest == NULL_PTR || hand.empty()) {
         return false;
     }
+    int n = getStackIndex(dest);
+    return n >= STACK_IDX_TABLEAU && n < STACK_IDX_STOCK && (getHandDestMask() & (1u << n)) != 0;
+}
 
-    if (dest->type != CardStack::TYPE_TABLEAU 
-        && dest->type != CardStack::TYPE_FOUNDATION) 
-    {
-        return false;
-    }
-
-    int handSuit = hand[0].getSuit();
-    int handValue = hand[0].getValue();
-    int handColor = hand[0].getColor();
-
-    if (dest->empty())
-    {
-        return (dest->type == CardStack::TYPE_TABLEAU && handValue == 12)
-            || (dest->type == CardStack::TYPE_FOUNDATION && handValue == 0)
-            || (dest->type == CardStack::TYPE_TABLEAU && handSource->type == CardStack::TYPE_TABLEAU && handSource->empty());
-    }
-    else
-    {
-        int destSuit = dest->top().getSuit();
-        int destValue = dest->top().getValue();
-        int destColor = dest->top().getColor();
-
-        if (dest->type == CardStack::TYPE_TABLEAU) {
-            return destColor != handColor && handValue == destValue - 1;
-        } else if (dest->type == CardStack::TYPE_FOUNDATION) {
-            return destSuit == handSuit && handValue == destValue + 1;
-        }
+unsigned int GameState::getHandDestMask() const
+{
+    if (hand.empty()) {
+        return 0;
     }
 
-    return false;
+    DestTable table;
+    getDestTable(&table);
+    unsigned int mask = table.getMask(hand[0].id);
+    if (hand.size() > 1) {
+        mask &= ~DestTable::FOUNDATION_BITS;
+    }
+    if (handSource != NULL_PTR && handSource->type == CardStack::TYPE_TABLEAU && handSource->empty()) {
+        mask |= table.emptyTableaux;
+    }
+    return mask;
 }
 
 bool GameState::shouldOpenCard() const
@@ -403,26 +1455,31 @@ bool GameState::shouldOpenCard() const
 
 CardStack* GameState::getStack(int n)
 {
-    if (n < 0) {
-        return NULL_PTR;
-    }
+    const GameState* self = this;
+    return const_cast<CardStack*>(self->getStack(n));
+}
 
-    if (n < TABLEAU_COUNT) {
-        return &tableaux[n];
-    } else if (n < TABLEAU_COUNT+FOUNDATION_COUNT) {
-        n -= TABLEAU_COUNT;
-        return &foundations[n];
-    } else if (n < TABLEAU_COUNT+FOUNDATION_COUNT+1) {
-        n -= TABLEAU_COUNT + 1;
-        return &stock;
-    } else if (n < TABLEAU_COUNT+FOUNDATION_COUNT+2) {
-        n -= TABLEAU_COUNT + 2;
-        return &waste;
-    } else if (n < TABLEAU_COUNT+FOUNDATION_COUNT+3) {
-        n -= TABLEAU_COUNT + 3;
-        return &hand;
-    } else {
-        return NULL_PTR;
+const CardStack* GameState::getStack(int n) const
+{
+    return n >= 0 && n < STACK_COUNT ? stacks[n] : NULL_PTR;
+}
+
+int GameState::getStackIndex(const CardStack* stack) const
+{
+    switch (stack->type)
+    {
+    case CardStack::TYPE_TABLEAU:
+        return STACK_IDX_TABLEAU + stack->ordinal;
+    case CardStack::TYPE_FOUNDATION:
+        return STACK_IDX_FOUNDATION + stack->ordinal;
+    case CardStack::TYPE_STOCK:
+        return STACK_IDX_STOCK;
+    case CardStack::TYPE_WASTE:
+        return STACK_IDX_WASTE;
+    case CardStack::TYPE_HAND:
+        return STACK_IDX_HAND;
+    default:
+        return STACK_ID_NULL;
     }
 }
 
@@ -449,114 +1506,174 @@ CardStack* GameState::findHandAutoDest()
         return NULL_PTR;
     }
 
-    for (int i=0; i<FOUNDATION_COUNT; i++) {
-        if (canReleaseHand(&foundations[i])) {
-            return &foundations[i];
+    unsigned int mask = getHandDestMask() & DestTable::FOUNDATION_BITS;
+    return mask != 0 ? getStack(Utils_LowestBit(mask)) : handSource;
+}
+
+CardStack* GameState::findAutoMove(CardStack** destStack, int* srcIdx)
+{
+    // Step #1: a card needed next on top of a tableau
+
+    for (int s=0; s<SUIT_COUNT; s++)
+    {
+        int cardId = getNextNeededCard(s);
+        int stack = cardId != CARD_ID_NULL ? cardStacks[cardId] : STACK_ID_NULL;
+        if (stack >= STACK_IDX_TABLEAU && stack < STACK_IDX_FOUNDATION && tableaux[stack].top().id == cardId)
+        {
+            *destStack = getSuitFoundation(s);
+            *srcIdx = tableaux[stack].size() - 1;
+            return &tableaux[stack];
+        }
+    }
+
+    // Step #2: anywhere in the stock or the waste
+
+    for (int s=0; s<SUIT_COUNT; s++)
+    {
+        int cardId = getNextNeededCard(s);
+        int stack = cardId != CARD_ID_NULL ? cardStacks[cardId] : STACK_ID_NULL;
+        if (stack == STACK_IDX_STOCK || stack == STACK_IDX_WASTE)
+        {
+            CardStack* src = getStack(stack);
+            for (int i=0; i<src->size(); i++) {
+                if ((*src)[i].id == cardId)
+                {
+                    *destStack = getSuitFoundation(s);
+                    *srcIdx = i;
+                    return src;
+                }
+            }
         }
     }
 
-    return handSource;
+    // Step #3: nothing found - either the game is already finished or we have a bug here
+
+    return NULL_PTR;
 }
 
-int GameState::getNextFoundationCard(int topCardId, int suit) const
+void GameState::doAutoMove(CardStack* srcStack, int srcIdx, CardStack* destStack)
 {
-    if (topCardId == -1) {
-        return GameCard::GetAceId(suit);
-    } 
+    int wasteSize = waste.size();
+    bool closedInTableau = srcStack->type == CardStack::TYPE_TABLEAU && (*srcStack)[srcIdx].opened() == false;
+    hashKey ^= linkKeys(srcStack, srcIdx, 1);
 
-    if (GameCard(topCardId).isKing()) {
-        return -1;
-    } else {
-        return topCardId + 1;
+    destStack->push((*srcStack)[srcIdx]);
+    for (int i=srcIdx+1; i<srcStack->size(); i++) {
+        (*srcStack)[i-1] = (*srcStack)[i];
+    }
+    srcStack->pop();
+
+    hashKey ^= linkKeys(destStack, destStack->size()-1, 1);
+    moveStockCursor(wasteSize);
+    if (closedInTableau) {
+        hashKey = computeHash();
     }
+    indexCards(srcStack, srcStack->size());
+    indexCards(destStack, destStack->size()-1);
+    notify(HistoryEvent::TYPE_AUTO_MOVE, GameMove(getStackIndex(srcStack), getStackIndex(destStack), 1, false, false), srcIdx);
 }
 
-CardStack* GameState::findAutoMove(CardStack** destStack, int* srcIdx)
+int GameState::getCardStack(int cardId) const
 {
-    // Step #1: Find what card is needed next for each foundation
+    return cardStacks[cardId];
+}
 
-    bool suitUsed[FOUNDATION_COUNT];
-    int desiredCardIds[FOUNDATION_COUNT];
+int GameState::getNextNeededCard(int suit) const
+{
+    int slot = suitSlots[suit];
+    int count = slot != STACK_ID_NULL ? foundations[slot - STACK_IDX_FOUNDATION].size() : 0;
+    return count < CARDS_PER_SUIT ? GameCard::GetAceId(suit) + count : CARD_ID_NULL;
+}
 
-    for (int i=0; i<FOUNDATION_COUNT; i++) {
-        suitUsed[i] = false;
-        desiredCardIds[i] = -1;
+bool GameState::isSafeToCollect(int cardId) const
+{
+    GameCard card(cardId);
+    int value = card.getValue();
+    if (value <= 1) {
+        return true;
     }
 
-    for (int i=0; i<FOUNDATION_COUNT; i++) {
-        if (foundations[i].empty() == false) {
-            suitUsed[foundations[i].top().getSuit()] = true;
+    for (int s=0; s<SUIT_COUNT; s++)
+    {
+        int next = getNextNeededCard(s);
+        int count = next != CARD_ID_NULL ? next - GameCard::GetAceId(s) : CARDS_PER_SUIT;
+        if (GameCard(GameCard::GetAceId(s)).getColor() != card.getColor() && count < value) {
+            return false;
         }
     }
+    return true;
+}
 
-    for (int i=0; i<FOUNDATION_COUNT; i++) {
-        if (foundations[i].empty()) {
-            for (int j=0; j<FOUNDATION_COUNT; j++) {
-                if (suitUsed[j] == false) 
-                {
-                    desiredCardIds[i] = getNextFoundationCard(-1, j);
-                    suitUsed[j] = true;
-                    break;
-                }
-            }
-        } else {
-            desiredCardIds[i] = getNextFoundationCard(foundations[i].top().id);
+CardStack* GameState::findSafeCollect(CardStack** destStack)
+{
+    for (int s=0; s<SUIT_COUNT; s++)
+    {
+        int cardId = getNextNeededCard(s);
+        if (cardId == CARD_ID_NULL || isSafeToCollect(cardId) == false) {
+            continue;
         }
-    }
-
-    // Step #2: loop through all tableaus and check if there is any of the desired cards
 
-    for (int i=0; i<TABLEAU_COUNT; i++) {
-        if (tableaux[i].empty() == false) {
-            for (int j=FOUNDATION_COUNT-1; j>=0; j--) {
-                if (tableaux[i].top().id == desiredCardIds[j])
-                {
-                    *destStack = &foundations[j];
-                    *srcIdx = tableaux[i].size() - 1;
-                    return &tableaux[i];
-                }
-            }
+        int stack = cardStacks[cardId];
+        CardStack* src = getStack(stack);
+        bool onTop = (stack < STACK_IDX_FOUNDATION || stack == STACK_IDX_WASTE) && src->top().id == cardId;
+        if (onTop && src->top().opened())
+        {
+            *destStack = getSuitFoundation(s);
+            return src;
         }
     }
+    return NULL_PTR;
+}
 
-    // Step #3: loop through stock
-
-    for (int i=0; i<stock.size(); i++) {
-        for (int j=FOUNDATION_COUNT-1; j>=0; j--) {
-            if (stock[i].id == desiredCardIds[j])
-            {
-                *destStack = &foundations[j];
-                *srcIdx = i;
-                return &stock;
-            }
+CardStack* GameState::getSuitFoundation(int suit)
+{
+    if (suitSlots[suit] != STACK_ID_NULL) {
+        return getStack(suitSlots[suit]);
+    }
+    for (int i=0; i<FOUNDATION_COUNT; i++) {
+        if (foundations[i].empty()) {
+            return &foundations[i];
         }
     }
+    return NULL_PTR;
+}
 
-    // Step #4: loop through waste
+void GameState::indexCards(const CardStack* stack, int idx)
+{
+    // Cards from idx up have just been put on the stack, a foundation may
+    // also have just been emptied
+    int n = getStackIndex(stack);
+    for (int i=idx; i<stack->size(); i++) {
+        cardStacks[(*stack)[i].id] = (signed char)n;
+    }
 
-    for (int i=0; i<waste.size(); i++) {
-        for (int j=FOUNDATION_COUNT-1; j>=0; j--) {
-            if (waste[i].id == desiredCardIds[j])
-            {
-                *destStack = &foundations[j];
-                *srcIdx = i;
-                return &waste;
+    if (stack->type != CardStack::TYPE_FOUNDATION) {
+        return;
+    }
+    if (stack->empty() == false) {
+        suitSlots[(*stack)[0].getSuit()] = (signed char)n;
+    }
+    else
+    {
+        for (int s=0; s<SUIT_COUNT; s++) {
+            if (suitSlots[s] == n) {
+                suitSlots[s] = STACK_ID_NULL;
             }
         }
     }
-
-    // Step #5: nothing found - either the game is already finished or we have a bug here
-
-    return NULL_PTR;
 }
 
-void GameState::doAutoMove(CardStack* srcStack, int srcIdx, CardStack* destStack)
+void GameState::rebuildCardIndex()
 {
-    destStack->push((*srcStack)[srcIdx]);
-    for (int i=srcIdx+1; i<srcStack->size(); i++) {
-        (*srcStack)[i-1] = (*srcStack)[i];
+    for (int i=0; i<CARDS_TOTAL; i++) {
+        cardStacks[i] = STACK_ID_NULL;
+    }
+    for (int s=0; s<SUIT_COUNT; s++) {
+        suitSlots[s] = STACK_ID_NULL;
+    }
+    for (int i=0; i<STACK_COUNT; i++) {
+        indexCards(getStack(i), 0);
     }
-    srcStack->pop();
 }
 
 bool GameState::gameWon() const
@@ -592,3 +1709,324 @@ int GameState::countCardsLeft() const
     count += hand.size();  // this one should be 0
     return count;
 }
+
+bool GameState::foundationAccepts(const GameCard& card) const
+{
+    for (int i=0; i<FOUNDATION_COUNT; i++)
+    {
+        const CardStack& f = foundations[i];
+        if (f.empty() ? card.getValue() == 0 : f.top().id == card.id - 1 && f.top().getSuit() == card.getSuit()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GameState::tableauAccepts(const CardStack& tableau, const GameCard& card) const
+{
+    if (tableau.empty()) {
+        return card.isKing();
+    }
+    return tableau.top().getColor() != card.getColor()
+        && tableau.top().getValue() == card.getValue() + 1;
+}
+
+bool GameState::talonFeeds(const GameCard& card) const
+{
+    // Draw one with unlimited passes: every talon card can be played
+    for (int i=0; i<stock.size(); i++) {
+        if (stock[i].getColor() != card.getColor() && stock[i].getValue() == card.getValue() - 1) {
+            return true;
+        }
+    }
+    for (int i=0; i<waste.size(); i++) {
+        if (waste[i].getColor() != card.getColor() && waste[i].getValue() == card.getValue() - 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GameState::runFeeds(const GameCard& card, int skipTableau) const
+{
+    // A run that would turn a card or empty its tableau by moving onto card
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& t = tableaux[i];
+        if (i == skipTableau) {
+            continue;
+        }
+        for (int k=0; k<t.size(); k++) {
+            if (t[k].opened() && (k == 0 || t[k-1].opened() == false))
+            {
+                if (t[k].getColor() != card.getColor() && t[k].getValue() == card.getValue() - 1) {
+                    return true;
+                }
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+bool GameState::hasProductiveMove(int stackIdx) const
+{
+    if (stackIdx == STACK_IDX_STOCK || stackIdx == STACK_IDX_WASTE)
+    {
+        for (int i=0; i<stock.size() + waste.size(); i++)
+        {
+            const GameCard& card = i < stock.size() ? stock[i] : waste[i - stock.size()];
+            if (foundationAccepts(card)) {
+                return true;
+            }
+            for (int j=0; j<TABLEAU_COUNT; j++) {
+                if (tableauAccepts(tableaux[j], card)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    if (stackIdx >= STACK_IDX_FOUNDATION && stackIdx < STACK_IDX_STOCK)
+    {
+        // Taking a card back pays off only when something goes on it next
+        const CardStack& f = foundations[stackIdx - STACK_IDX_FOUNDATION];
+        if (f.empty()) {
+            return false;
+        }
+        for (int j=0; j<TABLEAU_COUNT; j++) {
+            if (tableauAccepts(tableaux[j], f.top())) {
+                return talonFeeds(f.top()) || runFeeds(f.top(), STACK_ID_NULL);
+            }
+        }
+        return false;
+    }
+
+    if (stackIdx < STACK_IDX_TABLEAU || stackIdx >= STACK_IDX_FOUNDATION) {
+        return false;
+    }
+
+    const CardStack& src = tableaux[stackIdx - STACK_IDX_TABLEAU];
+    if (src.empty()) {
+        return false;
+    }
+    if (src.top().opened() == false || foundationAccepts(src.top())) {
+        return true;
+    }
+
+    for (int k=src.size()-1; k>=0 && src[k].opened(); k--) {
+        for (int j=0; j<TABLEAU_COUNT; j++)
+        {
+            const CardStack& dst = tableaux[j];
+            if (&dst == &src || tableauAccepts(dst, src[k]) == false) {
+                continue;
+            }
+            // Kings moving between empty tableaux get nowhere
+            if (k == 0) 
+            {
+                if (dst.empty() == false) {
+                    return true;
+                }
+                continue;
+            }
+            if (src[k-1].opened() == false) {
+                return true;
+            }
+            // Splitting a run helps if the uncovered card can move on or
+            // take a card that does
+            const GameCard& uncovered = src[k-1];
+            if (foundationAccepts(uncovered) 
+                || talonFeeds(uncovered) 
+                || runFeeds(uncovered, stackIdx - STACK_IDX_TABLEAU))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void GameState::getDestTable(DestTable* table) const
+{
+    table->emptyTableaux = 0;
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& t = tableaux[i];
+        table->emptyTableaux |= (unsigned int)t.empty() << i;
+        table->accepts[i] = t.empty() 
+            ? KING_SET 
+            : (t.top().opened() ? TABLEAU_CHILD_SETS[t.top().id] : 0);
+    }
+    for (int i=0; i<FOUNDATION_COUNT; i++)
+    {
+        const CardStack& f = foundations[i];
+        table->accepts[TABLEAU_COUNT + i] = f.empty() ? ACE_SET : FOUNDATION_NEXT_SETS[f.top().id];
+    }
+}
+
+unsigned int GameState::getDestMask(int stackIdx, int idx) const
+{
+    if (stackIdx < STACK_IDX_TABLEAU || stackIdx >= STACK_IDX_HAND || stackIdx == STACK_IDX_STOCK) {
+        return 0;
+    }
+
+    const CardStack& src = *getStack(stackIdx);
+    if (idx < 0 || idx >= src.size() || src[idx].opened() == false) {
+        return 0;
+    }
+    if (src.type != CardStack::TYPE_TABLEAU && idx != src.size() - 1) {
+        return 0;
+    }
+
+    DestTable table;
+    getDestTable(&table);
+    return getRunDestMask(table, stackIdx, src, idx);
+}
+
+int GameState::generateMoves(LegalMove* moves, int maxMoves) const
+{
+    DestTable table;
+    getDestTable(&table);
+    int count = 0;
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& t = tableaux[i];
+        for (int k=t.size()-1; k>=0 && t[k].opened(); k--) {
+            count = pushMoves(moves, count, maxMoves, STACK_IDX_TABLEAU + i, k, getRunDestMask(table, STACK_IDX_TABLEAU + i, t, k));
+        }
+    }
+
+    if (waste.empty() == false) {
+        count = pushMoves(moves, count, maxMoves, STACK_IDX_WASTE, waste.size()-1, getRunDestMask(table, STACK_IDX_WASTE, waste, waste.size()-1));
+    }
+
+    for (int i=0; i<FOUNDATION_COUNT; i++)
+    {
+        const CardStack& f = foundations[i];
+        if (f.empty() == false) {
+            count = pushMoves(moves, count, maxMoves, STACK_IDX_FOUNDATION + i, f.size()-1, getRunDestMask(table, STACK_IDX_FOUNDATION + i, f, f.size()-1));
+        }
+    }
+
+    return count;
+}
+
+DeadEndDetector::Stats::Stats(): checks(0), steps(0), seconds(0)
+{
+}
+
+DeadEndDetector::DeadEndDetector()
+    : gameState(NULL_PTR)
+    , maxSeconds(0)
+    , checkedHash(0)
+    , status(STATUS_UNKNOWN)
+    , touched(0)
+    , lastProductive(SOURCE_TALON)
+    , nextSource(0)
+{
+}
+
+void DeadEndDetector::init(const GameState* aGameState, int maxMicrosPerTick)
+{
+    gameState = aGameState;
+    maxSeconds = maxMicrosPerTick / 1000000.;
+    checkedHash = 0;
+    status = STATUS_UNKNOWN;
+    stats = Stats();
+    touched = 0;
+    lastProductive = SOURCE_TALON;
+    nextSource = 0;
+}
+
+void DeadEndDetector::addEvent(const HistoryEvent& event)
+{
+    // Undo and redo don't tell their move, the talon and the last source
+    // go first then
+    if (event.type == HistoryEvent::TYPE_MOVE || event.type == HistoryEvent::TYPE_AUTO_MOVE) {
+        touched |= 1u << GetSource(event.move.src) | 1u << GetSource(event.move.dst);
+    }
+}
+
+int DeadEndDetector::GetSource(int stackIdx)
+{
+    return stackIdx < STACK_IDX_STOCK ? stackIdx : SOURCE_TALON;
+}
+
+void DeadEndDetector::startCheck()
+{
+    // Step #1: the stacks touched, the talon and the last productive source
+
+    int count = 0;
+    unsigned int first = touched | 1u << SOURCE_TALON | 1u << lastProductive;
+    for (int i=0; i<SOURCE_COUNT; i++) {
+        if (first & (1u << i)) {
+            order[count++] = i;
+        }
+    }
+
+    // Step #2: the rest
+
+    for (int i=0; i<SOURCE_COUNT; i++) {
+        if ((first & (1u << i)) == 0) {
+            order[count++] = i;
+        }
+    }
+
+    touched = 0;
+    nextSource = 0;
+    status = STATUS_UNKNOWN;
+}
+
+void DeadEndDetector::update()
+{
+    if (gameState == NULL_PTR || gameState->hand.empty() == false) {
+        return;
+    }
+
+    unsigned long long hash = gameState->getHash();
+    if (hash != checkedHash)
+    {
+        checkedHash = hash;
+        startCheck();
+    }
+    if (status != STATUS_UNKNOWN || gameState->gameWon()) {
+        return;
+    }
+
+    // At least one step per tick, so every check finishes eventually
+    double startTime = Platform_GetTime();
+    double now = startTime;
+    do
+    {
+        int source = order[nextSource++];
+        int stackIdx = source != SOURCE_TALON ? source : STACK_IDX_STOCK;
+        stats.steps++;
+
+        if (gameState->hasProductiveMove(stackIdx))
+        {
+            status = STATUS_MOVES_LEFT;
+            lastProductive = source;
+        }
+        else if (nextSource == SOURCE_COUNT) {
+            status = STATUS_DEAD_END;
+        }
+        now = Platform_GetTime();
+    } while (status == STATUS_UNKNOWN && now - startTime < maxSeconds);
+
+    if (status != STATUS_UNKNOWN) {
+        stats.checks++;
+    }
+    stats.seconds += now - startTime;
+}
+
+DeadEndDetector::Status DeadEndDetector::getStatus() const
+{
+    return status;
+}
+
+const DeadEndDetector::Stats& DeadEndDetector::getStats() const
+{
+    return stats;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "properties.h"
+#include "snapshot.h"
 #include "system.h"
 #include "utils.h"
 
@@ -60,33 +61,124 @@ public:
 
     CardStack();
     void init(Type t, int ord = 0);
+    void assign(const CardStack& other);
 
 private:
     CardStack(const CardStack&);
     CardStack& operator=(const CardStack&);
 };
 
+struct GameDeal
+{
+    // Card ids in dealing order: tableaux row by row, then the stock bottom-up
+    unsigned char cardIds[CARDS_TOTAL];
+
+    static GameDeal Random();
+
+    // Deal number seed, the same on every platform: card ids 0..51 shuffled
+    // by Fisher-Yates from the last position down, where position i swaps
+    // with (h * (i+1)) >> 32, h being the high 32 bits of the next
+    // SplitMix64 output for a state starting at seed
+    static GameDeal FromSeed(unsigned long long seed);
+
+    // The deals of count seeds from firstSeed, the same as FromSeed makes
+    // them, back to back in out as CARDS_TOTAL card ids each, shuffled
+    // right there. Ranges don't depend on each other and can be made on
+    // any thread.
+    static void FromSeedRange(unsigned long long firstSeed, int count, unsigned char* out);
+
+    // Random deal number, a different one on every call
+    static unsigned long long RandomNumber();
+};
+
+// A position in at most one cache line: 6 bits per card that is not on a
+// foundation plus a few counters. Face state is implied by the stacks, so
+// equal positions always give equal bytes.
+struct PackedGameState
+{
+    static const int SIZE = 64;
+    unsigned char data[SIZE];
+
+    bool operator==(const PackedGameState& other) const;
+    bool operator!=(const PackedGameState& other) const;
+};
+
+// Every stack of a position card by card, bit 7 of a card set when it is
+// open. Bigger than a PackedGameState but much faster to take and restore.
+struct GameSnapshot
+{
+    unsigned char cards[CARDS_TOTAL];
+    unsigned char sizes[STACK_COUNT];
+    signed char handSource;
+};
+
+// A move of the history, stacks numbered as in GameState::getStack()
 struct GameMove
 {
-    CardStack* src;
-    CardStack* dst;
+    int src;
+    int dst;
     int amount;
     bool cardOpened;
     bool fromStock;
 
     GameMove();
-    GameMove(CardStack* s, CardStack* d, int a, bool c, bool f);
+    GameMove(int s, int d, int a, bool c, bool f);
     bool isEmpty() const;
 };
 
+// A move the player can make with the hand: cards from idx to the top of
+// src go to dst, stacks numbered as in GameState::getStack()
+struct LegalMove
+{
+    signed char src;
+    signed char idx;
+    signed char dst;
+};
+
+// Cards each tableau and foundation of a position takes next, bit n of an
+// entry stands for card id n
+struct DestTable
+{
+    static const unsigned int TABLEAU_BITS = (1u << TABLEAU_COUNT) - 1;
+    static const unsigned int FOUNDATION_BITS = ((1u << FOUNDATION_COUNT) - 1) << STACK_IDX_FOUNDATION;
+
+    unsigned long long accepts[TABLEAU_COUNT + FOUNDATION_COUNT];
+    unsigned int emptyTableaux;
+
+    // Bit n is set when getStack(n) takes the card
+    unsigned int getMask(int cardId) const;
+};
+
+// Tableau columns and foundations of a position in an order that doesn't
+// depend on the slots they take: columns by their bottom card with empty
+// ones last, foundations by suit. Entries are stack numbers as in
+// GameState::getStack(), STACK_ID_NULL for a suit not started yet.
+struct CanonicalView
+{
+    signed char tableaux[TABLEAU_COUNT];
+    signed char foundations[SUIT_COUNT];
+};
+
+// Moves made since the deal, two bytes each in chunks allocated as the
+// game goes on, so there is no limit on the number of moves and a history
+// nothing was played on takes no memory. Every CHECKPOINT_INTERVAL moves
+// the position is stored as well (see GameState::seek), the first one
+// being the position the history starts from.
+//
+// A new move after an undo drops the moves that could be redone, unless
+// branches are kept: then every move ever made stays in a tree, the
+// moves made so far and the ones redo plays next being one path of it,
+// and switchBranch() picks another path from the current position.
 class GameHistory
 {
 public:
+    static const int CHECKPOINT_INTERVAL = 64;
+
     GameHistory();
 
     void clear();
-    void addMove(CardStack* src, 
-                 CardStack* dst, 
+    void addMove(int src, 
+                 int dst, 
                  int  amount, 
                  bool cardOpened, 
                  bool fromStock);
@@ -96,12 +188,106 @@ public:
     bool canUndo() const;
     bool canRedo() const;
 
+    // Moves up to the current position and in all, undone ones included
+    int getPosition() const;
+    int getMoveCount() const;
+
+    // Off by default, searches make far too many moves to keep them all.
+    // The moves made so far are kept either way.
+    void setKeepBranches(bool keep);
+
+    // Moves that can be redone from the current position, one per branch,
+    // the one redo() plays first. Without branches kept zero or one.
+    int getBranchCount() const;
+
+    // Makes the n-th move of getBranchCount() the one redo() plays, and
+    // below it the path that was followed last. Costs the length of that
+    // path. The position doesn't change, checkpoints past it are dropped
+    // and taken again as redo and seek get there, see GameState::seek.
+    bool switchBranch(int n);
+
+    // Whether the position reached now, with the given hash, is due for a
+    // checkpoint it doesn't have yet
+    bool needsCheckpoint(unsigned long long hash) const;
+    void setCheckpoint(const GameSnapshot& snapshot, unsigned long long hash);
+
+    // Last checkpoint at or before a move index, of the ones taken so far:
+    // its move index, or the history goes back or forward to it and the
+    // caller restores the position
+    int getCheckpointPosition(int moveIndex) const;
+    const GameSnapshot& seekCheckpoint(int moveIndex);
+
+    // Everything above, for GameState::save; false for a broken history
+    void save(SnapshotBuffer* buffer) const;
+    bool load(SnapshotBuffer* buffer);
+
 private:
-    GameMove moves[10000];
-    int moveCount;
+    // Source stack in bits 0..3, destination in 4..7, amount in 8..13,
+    // then cardOpened and fromStock
+    typedef unsigned short Code;
+
+    static const int CHUNK_BITS = 12;
+    static const int MAX_LOADED_MOVES = 1 << 24;
+
+    struct Checkpoint
+    {
+        GameSnapshot position;
+        unsigned long long hash;
+    };
+
+    // A move of the tree, children most recently followed first
+    struct Node
+    {
+        int firstChild;
+        int nextSibling;
+        Code code;
+    };
+
+    ChunkedVec<Code, CHUNK_BITS> moves;
+    ChunkedVec<Checkpoint, 6> checkpoints;
     int position;
+
+    // With branches kept: node 0 stands for the start, lineNodes holds the
+    // node of every move in moves
+    ChunkedVec<Node, CHUNK_BITS> nodes;
+    ChunkedVec<int, CHUNK_BITS> lineNodes;
+    bool keepBranches;
+
+    void addNode(Code code);
+    void resetTree();
+
+    static Code Encode(int src, int dst, int amount, bool cardOpened, bool fromStock);
+    static GameMove Decode(Code code);
+
+    GameHistory(const GameHistory&);
+    GameHistory& operator=(const GameHistory&);
 };
 
+// What a GameState tells its history listener about, see
+// GameState::setHistoryListener
+struct HistoryEvent
+{
+    enum Type
+    {
+        TYPE_MOVE = 0,
+        TYPE_UNDO,
+        TYPE_REDO,
+        TYPE_SEEK,
+        TYPE_BRANCH,
+        TYPE_AUTO_MOVE,
+    };
+
+    Type type;
+
+    // The move of TYPE_MOVE and TYPE_AUTO_MOVE, the move index of TYPE_SEEK,
+    // the branch of TYPE_BRANCH and the index of the card an auto move
+    // took in its source stack
+    GameMove move;
+    int arg;
+};
+
+typedef void (*HistoryListener)(const HistoryEvent& event, void* arg);
+
 class GameState
 {
 public:
@@ -118,8 +304,35 @@ public:
     GameState();
 
     void init();
-    void registerMove(CardStack* src, 
-                      CardStack* dst, 
+    void init(const GameDeal& deal);
+    void init(unsigned long long dealNumber);
+
+    // Number of the deal the game started from, see GameDeal::FromSeed;
+    // false for deals given by their cards
+    bool getDealNumber(unsigned long long* number) const;
+    void copyPosition(const GameState& other);
+
+    // Deals the cards the player can't see, closed tableau cards and the
+    // stock, again in random order. Every card keeps its place otherwise,
+    // the history starts over.
+    void shuffleHiddenCards(unsigned long long* randomState);
+
+    void pack(PackedGameState* packed) const;
+    void unpack(const PackedGameState& packed);
+
+    // Zobrist hash of the position, kept up to date by every move
+    unsigned long long getHash() const;
+    unsigned long long computeHash() const;
+
+    // Same for all positions with the same CanonicalView, and without the
+    // stock position for all splits of the talon between stock and waste.
+    // Only positions with an empty hand are matched.
+    unsigned long long getCanonicalHash(bool withStockPosition) const;
+    void getCanonicalView(CanonicalView* view) const;
+
+    // Stacks numbered as in getStack()
+    void registerMove(int  src, 
+                      int  dst, 
                       int  amount, 
                       bool cardOpened, 
                       bool fromStock);
@@ -129,28 +342,185 @@ public:
     bool undo();
     void fullUndo();
 
+    // Goes back or forward to the position after the given number of moves
+    // of the history: restores the checkpoint below it and redoes at most
+    // GameHistory::CHECKPOINT_INTERVAL-1 moves, whatever the distance. The
+    // first time past the checkpoints of a branch switched to, it redoes
+    // the moves from the last one, taking the others on the way.
+    // False when the index is out of the history or cards are in hand.
+    bool seek(int moveIndex);
+
+    // GameHistory::switchBranch, the position stays. False when there is
+    // no such branch or cards are in hand.
+    bool switchBranch(int n);
+
+    // Called for every move registered and every undo, redo, seek, branch
+    // switch and auto move made through the calls above, once for a seek
+    // however many moves it takes. Not for new deals or positions. NULL_PTR
+    // for none.
+    void setHistoryListener(HistoryListener func, void* arg);
+
+    // The position, the deal and the whole history, listener aside. After
+    // a false load the game has to be dealt again.
+    void save(SnapshotBuffer* buffer) const;
+    bool load(SnapshotBuffer* buffer);
+
     bool gameWon() const;
     bool canAutoPlay() const;
     int countCardsLeft() const;
 
     CardStack* getStack(int n);
+    const CardStack* getStack(int n) const;
+    int getStackIndex(const CardStack* stack) const;
     CardStack* findById(int cardId, int* idx);
 
     void advanceStock();
     void fillHand(CardStack* stack, int idx);
     void releaseHand(CardStack* dest);
     bool canReleaseHand(CardStack* dest) const;
+    unsigned int getHandDestMask() const;
     bool shouldOpenCard() const;
     CardStack* findHandAutoDest();
 
+    // Auto moves finish a game that can't be lost: they aren't in the
+    // history, but the listener hears of them, and a replay plays them
+    // again with findAutoMove, which picks the same one in the same position
     CardStack* findAutoMove(CardStack** destStack, int* srcIdx);
     void doAutoMove(CardStack* srcStack, int srcIdx, CardStack* destStack);
 
+    // Where every card is and which card each suit needs next, kept up to
+    // date by every move. The next card of a finished suit is CARD_ID_NULL.
+    int getCardStack(int cardId) const;
+    int getNextNeededCard(int suit) const;
+
+    // Whether no card left outside the foundations could need the card as
+    // a parent: both opposite colour suits have reached one rank below it
+    bool isSafeToCollect(int cardId) const;
+
+    // Top card of a tableau or the waste that can go to a foundation and is
+    // safe there, checked suit by suit without looking at other cards.
+    // Returns the stack it lies on or NULL_PTR.
+    CardStack* findSafeCollect(CardStack** destStack);
+
+    // Whether cards of a tableau, a foundation or the talon (STACK_IDX_STOCK
+    // stands for both stock and waste) can make progress: go to a foundation,
+    // leave the talon or turn a tableau card, looking one preparing move ahead
+    bool hasProductiveMove(int stackIdx) const;
+
+    // Every move of an opened card (with the cards above it) to a tableau or
+    // a foundation, advancing the stock is left out. Writes at most maxMoves
+    // moves and returns how many were written.
+    int generateMoves(LegalMove* moves, int maxMoves) const;
+
+    // Same as a DestTable mask, for the card at idx of a stack and the cards
+    // above it; zero for closed cards and stacks the hand can't take from
+    unsigned int getDestMask(int stackIdx, int idx) const;
+    void getDestTable(DestTable* table) const;
+
 private:
-    int getNextFoundationCard(int topCardId, int suit = -1) const;
+    unsigned long long hashKey;
+    unsigned long long dealNumber;
+    bool numbered;
+
+    // getStack() of every stack number
+    CardStack* stacks[STACK_COUNT];
+
+    HistoryListener listener;
+    void* listenerArg;
+
+    // Stack number of every card and foundation slot of every suit
+    // (STACK_ID_NULL until its ace is played)
+    signed char cardStacks[CARDS_TOTAL];
+    signed char suitSlots[SUIT_COUNT];
+
+    void moveCards(CardStack* src, CardStack* dst, int amount);
+    void openTop(CardStack* stack);
+    void closeTop(CardStack* stack);
+    void moveStockCursor(int oldWasteSize);
+    unsigned long long linkKeys(const CardStack* stack, int idx, int amount) const;
+    int getLinkBelow(const CardStack* stack, int idx) const;
+    int getLinkAbove(const CardStack* stack, int idx) const;
+    bool redoMove();
+    bool undoMove();
+    bool seekMove(int moveIndex);
+    void notify(HistoryEvent::Type type, const GameMove& move, int arg);
+    void takeSnapshot(GameSnapshot* snapshot) const;
+    void restoreSnapshot(const GameSnapshot& snapshot);
+    void resetHistory();
+    void updateCheckpoint();
+    void indexCards(const CardStack* stack, int idx);
+    void rebuildCardIndex();
+    CardStack* getSuitFoundation(int suit);
+
+    bool foundationAccepts(const GameCard& card) const;
+    bool tableauAccepts(const CardStack& tableau, const GameCard& card) const;
+    bool talonFeeds(const GameCard& card) const;
+    bool runFeeds(const GameCard& card, int skipTableau) const;
 
     void fillStackWithCards(CardStack* stack, const char* cards[], int count, bool opened);
     void initAllStacks();
-    void dealRandomGame();
+    void dealGame(const GameDeal& deal);
     void dealReadyToAuto();
 };
+
+// Tells the player has run out of productive moves (see
+// GameState::hasProductiveMove) without rescanning the game every frame.
+// A position is checked once after it changes, one source stack per step,
+// and a check that doesn't fit in the time given per tick goes on in the
+// next one. Nothing is done while cards are in hand.
+//
+// A check stops at the first source with a productive move, and starts
+// with the stacks the moves since the last one touched, the talon and the
+// source that had one then, which is where one turns up. The others are
+// only gone through to tell a dead end, as what they can do depends on
+// the tops of the stacks moved to and from as well.
+class DeadEndDetector
+{
+public:
+    enum Status
+    {
+        STATUS_UNKNOWN = 0,
+        STATUS_MOVES_LEFT,
+        STATUS_DEAD_END,
+    };
+
+    struct Stats
+    {
+        long long checks;
+        long long steps;
+        double seconds;
+
+        Stats();
+    };
+
+    DeadEndDetector();
+
+    void init(const GameState* aGameState, int maxMicrosPerTick);
+    void update();
+
+    // To be called with the events of GameState::setHistoryListener
+    void addEvent(const HistoryEvent& event);
+
+    Status getStatus() const;
+    const Stats& getStats() const;
+
+private:
+    // Tableaux and foundations by stack index, then the talon
+    static const int SOURCE_COUNT = TABLEAU_COUNT + FOUNDATION_COUNT + 1;
+    static const int SOURCE_TALON = SOURCE_COUNT - 1;
+
+    static int GetSource(int stackIdx);
+    void startCheck();
+
+    const GameState* gameState;
+    double maxSeconds;
+    unsigned long long checkedHash;
+    Status status;
+    Stats stats;
+
+    // Sources touched since the check before, and the order of this one
+    unsigned int touched;
+    int lastProductive;
+    int order[SOURCE_COUNT];
+    int nextSource;
+};
@@ -0,0 +1,444 @@
+#include "optimal.h"
+
+namespace {
+
+const int BUCKET_SIZE = 4;
+
+}  // anonymous namespace
+
+OptimalSolver::Stats::Stats()
+    : nodes(0)
+    , hashHits(0)
+    , iterations(0)
+    , bound(0)
+    , seconds(0)
+    , nodesPerSecond(0)
+{
+}
+
+OptimalSolver::OptimalSolver()
+    : gameState(NULL_PTR)
+    , frames(NULL_PTR)
+    , table(NULL_PTR)
+    , tableMask(0)
+    , iteration(0)
+    , maxNodes(0)
+    , heuristic(HEURISTIC_CARDS_LEFT)
+{
+}
+
+OptimalSolver::~OptimalSolver()
+{
+    delete gameState;
+    delete[] frames;
+    delete[] table;
+}
+
+void OptimalSolver::init(long long aMaxNodes, int hashSizeMb, Heuristic aHeuristic)
+{
+    maxNodes = aMaxNodes;
+    heuristic = aHeuristic;
+
+    unsigned long long count = 1;
+    while (count * 2 * sizeof(Entry) <= (unsigned long long)hashSizeMb * 1024 * 1024) {
+        count *= 2;
+    }
+    if (count < BUCKET_SIZE) {
+        count = BUCKET_SIZE;
+    }
+
+    delete[] table;
+    table = new Entry[count];
+    tableMask = count - 1;
+    clearTable();
+
+    if (gameState == NULL_PTR) {
+        gameState = new GameState();
+    }
+    if (frames == NULL_PTR) {
+        frames = new Frame[MAX_DEPTH];
+    }
+}
+
+OptimalSolver::Result OptimalSolver::solve(const GameState& initial)
+{
+    double start = Platform_GetTime();
+    solution.clear();
+    stats = Stats();
+    gameState->copyPosition(initial);
+
+    Result result = RESULT_UNSOLVABLE;
+    int bound = estimate(*gameState);
+    bool done = gameState->gameWon();
+    if (done) {
+        result = RESULT_OPTIMAL;
+    }
+
+    while (done == false)
+    {
+        // Step #1: depth first search of the positions within the bound,
+        // remembering the lowest cost of the ones beyond it
+
+        stats.iterations++;
+        stats.bound = bound;
+        if (++iteration == INFINITE_BOUND) {
+            clearTable();
+            iteration = 1;
+        }
+        int nextBound = INFINITE_BOUND;
+        int depth = 0;
+        frames[0].cost = 0;
+        generateMoves(frames[0]);
+
+        while (depth >= 0)
+        {
+            Frame& frame = frames[depth];
+            if (frame.next >= frame.count)
+            {
+                depth--;
+                if (depth >= 0) {
+                    undoMove(frames[depth].moves[frames[depth].next-1]);
+                }
+                continue;
+            }
+
+            if (stats.nodes >= maxNodes)
+            {
+                result = RESULT_ABORTED;
+                done = true;
+                break;
+            }
+            stats.nodes++;
+
+            Move& move = frame.moves[frame.next++];
+            int cost = frame.cost + move.advances + 1;
+            doMove(move);
+
+            if (gameState->gameWon())
+            {
+                extractSolution(depth);
+                result = RESULT_OPTIMAL;
+                done = true;
+                break;
+            }
+
+            int total = cost + estimate(*gameState);
+            if (total > bound)
+            {
+                if (total < nextBound) {
+                    nextBound = total;
+                }
+                undoMove(move);
+                continue;
+            }
+
+            if (depth+1 >= MAX_DEPTH || isKnown(gameState->getCanonicalHash(true), cost))
+            {
+                undoMove(move);
+                continue;
+            }
+
+            depth++;
+            frames[depth].cost = cost;
+            generateMoves(frames[depth]);
+        }
+
+        // Step #2: the next iteration searches up to the cheapest position
+        // that was cut off, nothing cut off means no win at all
+
+        if (done == false)
+        {
+            if (nextBound == INFINITE_BOUND) {
+                done = true;
+            }
+            else if (nextBound >= MAX_DEPTH)
+            {
+                result = RESULT_ABORTED;
+                done = true;
+            }
+            bound = nextBound;
+        }
+    }
+
+    stats.seconds = Platform_GetTime() - start;
+    stats.nodesPerSecond = stats.seconds > 0 ? stats.nodes / stats.seconds : 0;
+    return result;
+}
+
+int OptimalSolver::getSolutionLength() const
+{
+    return solution.size();
+}
+
+const SolverMove& OptimalSolver::getSolutionMove(int n) const
+{
+    return solution[n];
+}
+
+const OptimalSolver::Stats& OptimalSolver::getStats() const
+{
+    return stats;
+}
+
+int OptimalSolver::estimate(const GameState& gs) const
+{
+    int h = CARDS_TOTAL + gs.stock.size();
+    for (int i=0; i<FOUNDATION_COUNT; i++) {
+        h -= gs.foundations[i].size();
+    }
+
+    if (heuristic == HEURISTIC_BLOCKERS)
+    {
+        // A card above a lower one of its suit can't go home before it, so
+        // it leaves the tableau by a move to another one. That move may
+        // take every blocker of the tableau along, so it counts once.
+        for (int i=0; i<TABLEAU_COUNT; i++)
+        {
+            const CardStack& t = gs.tableaux[i];
+            int lowest[SUIT_COUNT];
+            for (int s=0; s<SUIT_COUNT; s++) {
+                lowest[s] = CARDS_PER_SUIT;
+            }
+            bool blocked = false;
+            for (int j=0; j<t.size() && blocked == false; j++)
+            {
+                int suit = t[j].getSuit();
+                int value = t[j].getValue();
+                blocked = lowest[suit] < value;
+                if (value < lowest[suit]) {
+                    lowest[suit] = value;
+                }
+            }
+            h += blocked ? 1 : 0;
+        }
+    }
+
+    return h;
+}
+
+void OptimalSolver::clearTable()
+{
+    for (unsigned long long i=0; i<=tableMask; i++)
+    {
+        table[i].key = 0;
+        table[i].iteration = 0;
+    }
+    iteration = 0;
+}
+
+bool OptimalSolver::isKnown(unsigned long long key, int cost)
+{
+    // A position reached before in this iteration at no higher cost had
+    // at least as much of the bound left for its moves
+    Entry* bucket = &table[key & tableMask & ~(unsigned long long)(BUCKET_SIZE-1)];
+    Entry* victim = bucket;
+    for (int i=0; i<BUCKET_SIZE; i++)
+    {
+        Entry& e = bucket[i];
+        if (e.iteration == iteration && e.key == key)
+        {
+            if (e.cost <= cost)
+            {
+                stats.hashHits++;
+                return true;
+            }
+            e.cost = cost;
+            return false;
+        }
+        if (e.iteration != iteration) {
+            victim = &e;
+        }
+    }
+
+    victim->key = key;
+    victim->cost = cost;
+    victim->iteration = iteration;
+    return false;
+}
+
+void OptimalSolver::doMove(Move& move)
+{
+    for (int i=0; i<move.advances; i++) {
+        gameState->advanceStock();
+    }
+
+    CardStack* src = gameState->getStack(move.src);
+    if (move.src == STACK_IDX_WASTE) {
+        move.idx = (signed char)(src->size() - 1);
+    }
+
+    gameState->fillHand(src, move.idx);
+    gameState->releaseHand(gameState->getStack(move.dst));
+}
+
+void OptimalSolver::undoMove(const Move& move)
+{
+    for (int i=0; i<=move.advances; i++) {
+        gameState->undo();
+    }
+}
+
+void OptimalSolver::extractSolution(int depth)
+{
+    for (int d=0; d<=depth; d++)
+    {
+        const Move& move = frames[d].moves[frames[d].next-1];
+        for (int i=0; i<move.advances; i++) {
+            solution.push(SolverMove(STACK_IDX_STOCK, 0, STACK_IDX_WASTE));
+        }
+        solution.push(SolverMove(move.src, move.idx, move.dst));
+    }
+}
+
+bool OptimalSolver::isSafeForFoundation(const GameCard& card) const
+{
+    // Same rule as the solver: nothing left could be placed on the card
+    int value = card.getValue();
+    if (value <= 1) {
+        return true;
+    }
+
+    int opposite = 0;
+    for (int i=0; i<FOUNDATION_COUNT; i++)
+    {
+        const CardStack& f = gameState->foundations[i];
+        if (f.empty() == false && f.top().getColor() != card.getColor() && f.size() >= value) {
+            opposite++;
+        }
+    }
+    return opposite == 2;
+}
+
+void OptimalSolver::addMove(Frame& frame, int src, int idx, int dst, int advances)
+{
+    if (frame.count < MAX_MOVES)
+    {
+        Move& move = frame.moves[frame.count++];
+        move.src = (signed char)src;
+        move.idx = (signed char)idx;
+        move.dst = (signed char)dst;
+        move.advances = (signed char)advances;
+    }
+}
+
+void OptimalSolver::generateMoves(Frame& frame)
+{
+    frame.count = 0;
+    frame.next = 0;
+
+    DestTable destTable;
+    gameState->getDestTable(&destTable);
+
+    // Moves to an empty column all lead to the same position but the column
+    // numbers, so only the first one is tried
+    unsigned int skipped = destTable.emptyTableaux & (destTable.emptyTableaux - 1);
+
+    // Step #1: the talon in the order the solver uses, see
+    // Solver::generateMoves
+
+    const CardStack& stock = gameState->stock;
+    const CardStack& waste = gameState->waste;
+    int talonSize = stock.size() + waste.size();
+    int cursor = waste.size();
+    int talonCards[CARDS_TOTAL];
+    int talonAdvances[CARDS_TOTAL];
+
+    for (int i=0; i<talonSize; i++)
+    {
+        int t = cursor == 0 ? i : (cursor-1+i) % talonSize;
+        talonCards[i] = t < cursor ? waste[t].id : stock[stock.size()-1-(t-cursor)].id;
+        talonAdvances[i] = t >= cursor-1
+            ? t-cursor+1
+            : (talonSize-cursor) + 1 + (t+1);
+    }
+
+    // Step #2: moves to foundations first, they finish the search sooner.
+    // A safe one costs nothing in any solution and makes the others
+    // redundant.
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& t = gameState->tableaux[i];
+        if (t.empty()) {
+            continue;
+        }
+        unsigned int mask = destTable.getMask(t.top().id) & DestTable::FOUNDATION_BITS;
+        if (mask != 0)
+        {
+            bool safe = isSafeForFoundation(t.top());
+            if (safe) {
+                frame.count = 0;
+            }
+            addMove(frame, STACK_IDX_TABLEAU + i, t.size()-1, Utils_LowestBit(mask), 0);
+            if (safe) {
+                return;
+            }
+        }
+    }
+
+    for (int i=0; i<talonSize; i++)
+    {
+        unsigned int mask = destTable.getMask(talonCards[i]) & DestTable::FOUNDATION_BITS;
+        if (mask != 0)
+        {
+            bool safe = talonAdvances[i] == 0 && isSafeForFoundation(GameCard(talonCards[i]));
+            if (safe) {
+                frame.count = 0;
+            }
+            addMove(frame, STACK_IDX_WASTE, 0, Utils_LowestBit(mask), talonAdvances[i]);
+            if (safe) {
+                return;
+            }
+        }
+    }
+
+    // Step #3: tableau moves, every split of a run included
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& src = gameState->tableaux[i];
+        for (int k=src.size()-1; k>=0 && src[k].opened(); k--)
+        {
+            unsigned int mask = destTable.getMask(src[k].id) & DestTable::TABLEAU_BITS & ~skipped;
+            mask &= ~(1u << i);
+            if (k == 0) {
+                mask &= ~destTable.emptyTableaux;
+            }
+            while (mask != 0)
+            {
+                int j = Utils_LowestBit(mask);
+                mask &= mask - 1;
+                addMove(frame, STACK_IDX_TABLEAU + i, k, STACK_IDX_TABLEAU + j, 0);
+            }
+        }
+    }
+
+    for (int i=0; i<talonSize; i++)
+    {
+        unsigned int mask = destTable.getMask(talonCards[i]) & DestTable::TABLEAU_BITS & ~skipped;
+        while (mask != 0)
+        {
+            int j = Utils_LowestBit(mask);
+            mask &= mask - 1;
+            addMove(frame, STACK_IDX_WASTE, 0, STACK_IDX_TABLEAU + j, talonAdvances[i]);
+        }
+    }
+
+    // Step #4: cards taken back from foundations, unless nothing left could
+    // ever be placed on them
+
+    for (int i=0; i<FOUNDATION_COUNT; i++)
+    {
+        const CardStack& f = gameState->foundations[i];
+        if (f.empty() || isSafeForFoundation(f.top())) {
+            continue;
+        }
+        unsigned int mask = destTable.getMask(f.top().id) & DestTable::TABLEAU_BITS & ~skipped;
+        while (mask != 0)
+        {
+            int j = Utils_LowestBit(mask);
+            mask &= mask - 1;
+            addMove(frame, STACK_IDX_FOUNDATION + i, f.size()-1, STACK_IDX_TABLEAU + j, 0);
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "model.h"
+#include "platform.h"
+#include "solver.h"
+
+// Finds a shortest win, counting every hand move and every advanceStock()
+// call. Iterative deepening A*: depth first searches with a growing bound
+// on moves made plus a lower bound of the moves still needed. All memory
+// is allocated by init() and reused by every iteration and every solve().
+class OptimalSolver
+{
+public:
+    enum Result
+    {
+        RESULT_OPTIMAL = 0,
+        RESULT_UNSOLVABLE,
+        RESULT_ABORTED,
+    };
+
+    // Lower bounds of the moves still needed, both admissible
+    enum Heuristic
+    {
+        // Every card off the foundations moves at least once and every
+        // stock card needs an advance
+        HEURISTIC_CARDS_LEFT = 0,
+
+        // Plus one for every tableau with a card lying above a lower card
+        // of its own suit, which has to step aside before going home
+        HEURISTIC_BLOCKERS,
+    };
+
+    struct Stats
+    {
+        long long nodes;
+        long long hashHits;
+        int iterations;
+        int bound;
+        double seconds;
+        double nodesPerSecond;
+
+        Stats();
+    };
+
+    OptimalSolver();
+    ~OptimalSolver();
+
+    void init(long long maxNodes, int hashSizeMb, Heuristic aHeuristic = HEURISTIC_CARDS_LEFT);
+    Result solve(const GameState& gameState);
+
+    int getSolutionLength() const;
+    const SolverMove& getSolutionMove(int n) const;
+    const Stats& getStats() const;
+
+    // Lower bound of the moves needed to win, by the heuristic in use
+    int estimate(const GameState& gameState) const;
+
+private:
+    // Talon plays first advance the stock the given number of times, each
+    // of which counts as a move
+    struct Move
+    {
+        signed char src;
+        signed char idx;
+        signed char dst;
+        signed char advances;
+    };
+
+    // Every move costs at least one, so this is also the longest solution
+    static const int MAX_DEPTH = 512;
+    static const int MAX_MOVES = 256;
+    static const int INFINITE_BOUND = 1 << 30;
+
+    struct Frame
+    {
+        Move moves[MAX_MOVES];
+        int count;
+        int next;
+        int cost;
+    };
+
+    // Cost a position was reached with in the current iteration
+    struct Entry
+    {
+        unsigned long long key;
+        int cost;
+        int iteration;
+    };
+
+    void clearTable();
+    bool isKnown(unsigned long long key, int cost);
+    void doMove(Move& move);
+    void undoMove(const Move& move);
+    void generateMoves(Frame& frame);
+    void addMove(Frame& frame, int src, int idx, int dst, int advances);
+    bool isSafeForFoundation(const GameCard& card) const;
+    void extractSolution(int depth);
+
+    GameState* gameState;
+    Frame* frames;
+    Entry* table;
+    unsigned long long tableMask;
+
+    // Iterations of every solve() so far, entries of earlier ones are free
+    // without clearing the table
+    int iteration;
+    long long maxNodes;
+    Heuristic heuristic;
+
+    FixedVec<SolverMove, Solver::MAX_SOLUTION_LENGTH> solution;
+    Stats stats;
+
+    OptimalSolver(const OptimalSolver&);
+    OptimalSolver& operator=(const OptimalSolver&);
+};
@@ -0,0 +1,426 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "platform.h"
+#include "properties.h"
+
+#include <stdio.h>
+
+namespace {
+
+struct ThreadStart
+{
+    Thread::Func func;
+    void* arg;
+};
+
+#ifdef _WIN32
+DWORD WINAPI threadMain(LPVOID param)
+#else
+void* threadMain(void* param)
+#endif
+{
+    ThreadStart start = *(ThreadStart*)param;
+    delete (ThreadStart*)param;
+    start.func(start.arg);
+    return 0;
+}
+
+#ifndef _WIN32
+struct PosixSignal
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool flag;
+};
+#endif
+
+}  // anonymous namespace
+
+Thread::Thread(): handle(NULL_PTR)
+{
+}
+
+Thread::~Thread()
+{
+    join();
+}
+
+bool Thread::start(Func func, void* arg)
+{
+    if (handle != NULL_PTR) {
+        return false;
+    }
+
+    ThreadStart* start = new ThreadStart();
+    start->func = func;
+    start->arg = arg;
+
+#ifdef _WIN32
+    handle = CreateThread(NULL, 0, threadMain, start, 0, NULL);
+    if (handle == NULL_PTR)
+#else
+    pthread_t* thread = new pthread_t;
+    if (pthread_create(thread, NULL, threadMain, start) == 0) {
+        handle = thread;
+    } else {
+        delete thread;
+    }
+    if (handle == NULL_PTR)
+#endif
+    {
+        delete start;
+        return false;
+    }
+    return true;
+}
+
+void Thread::join()
+{
+    if (handle == NULL_PTR) {
+        return;
+    }
+
+#ifdef _WIN32
+    WaitForSingleObject((HANDLE)handle, INFINITE);
+    CloseHandle((HANDLE)handle);
+#else
+    pthread_join(*(pthread_t*)handle, NULL);
+    delete (pthread_t*)handle;
+#endif
+    handle = NULL_PTR;
+}
+
+bool Thread::started() const
+{
+    return handle != NULL_PTR;
+}
+
+Mutex::Mutex()
+{
+#ifdef _WIN32
+    CRITICAL_SECTION* cs = new CRITICAL_SECTION;
+    InitializeCriticalSection(cs);
+    handle = cs;
+#else
+    pthread_mutex_t* m = new pthread_mutex_t;
+    pthread_mutex_init(m, NULL);
+    handle = m;
+#endif
+}
+
+Mutex::~Mutex()
+{
+#ifdef _WIN32
+    DeleteCriticalSection((CRITICAL_SECTION*)handle);
+    delete (CRITICAL_SECTION*)handle;
+#else
+    pthread_mutex_destroy((pthread_mutex_t*)handle);
+    delete (pthread_mutex_t*)handle;
+#endif
+}
+
+void Mutex::lock()
+{
+#ifdef _WIN32
+    EnterCriticalSection((CRITICAL_SECTION*)handle);
+#else
+    pthread_mutex_lock((pthread_mutex_t*)handle);
+#endif
+}
+
+void Mutex::unlock()
+{
+#ifdef _WIN32
+    LeaveCriticalSection((CRITICAL_SECTION*)handle);
+#else
+    pthread_mutex_unlock((pthread_mutex_t*)handle);
+#endif
+}
+
+Signal::Signal()
+{
+#ifdef _WIN32
+    handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+    PosixSignal* s = new PosixSignal;
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->flag = false;
+    handle = s;
+#endif
+}
+
+Signal::~Signal()
+{
+#ifdef _WIN32
+    CloseHandle((HANDLE)handle);
+#else
+    PosixSignal* s = (PosixSignal*)handle;
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+    delete s;
+#endif
+}
+
+void Signal::set()
+{
+#ifdef _WIN32
+    SetEvent((HANDLE)handle);
+#else
+    PosixSignal* s = (PosixSignal*)handle;
+    pthread_mutex_lock(&s->mutex);
+    s->flag = true;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+#endif
+}
+
+bool Signal::wait(int timeoutMs)
+{
+#ifdef _WIN32
+    return WaitForSingleObject((HANDLE)handle, (DWORD)timeoutMs) == WAIT_OBJECT_0;
+#else
+    PosixSignal* s = (PosixSignal*)handle;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    long long ns = (now.tv_usec + (timeoutMs % 1000) * 1000LL) * 1000LL;
+    struct timespec deadline;
+    deadline.tv_sec = now.tv_sec + timeoutMs / 1000 + (time_t)(ns / 1000000000LL);
+    deadline.tv_nsec = (long)(ns % 1000000000LL);
+
+    pthread_mutex_lock(&s->mutex);
+    while (s->flag == false) {
+        if (pthread_cond_timedwait(&s->cond, &s->mutex, &deadline) != 0) {
+            break;
+        }
+    }
+    bool result = s->flag;
+    s->flag = false;
+    pthread_mutex_unlock(&s->mutex);
+    return result;
+#endif
+}
+
+double Platform_GetTime()
+{
+#ifdef _WIN32
+    static double resolution = 0.0;
+    if (resolution == 0.0)
+    {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        resolution = 1.0 / (double)freq.QuadPart;
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart * resolution;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+unsigned long long Platform_GetUnixTimeMs()
+{
+#ifdef _WIN32
+    // FILETIME counts 100 ns intervals since 1601
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    unsigned long long t = ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (t - 116444736000000000ULL) / 10000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+MappedFile::MappedFile()
+    : fileHandle(NULL_PTR)
+    , mapHandle(NULL_PTR)
+    , data(NULL_PTR)
+    , size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char* path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize) == FALSE || fileSize.QuadPart == 0 || (unsigned long long)fileSize.QuadPart != (SIZE_T)fileSize.QuadPart)
+    {
+        close();
+        return false;
+    }
+
+    size = (unsigned long long)fileSize.QuadPart;
+    mapHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapHandle != NULL_PTR) {
+        data = (const unsigned char*)MapViewOfFile((HANDLE)mapHandle, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0 && (unsigned long long)info.st_size == (size_t)info.st_size)
+    {
+        void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (view != MAP_FAILED)
+        {
+            data = (const unsigned char*)view;
+            size = (unsigned long long)info.st_size;
+        }
+    }
+    // The mapping stays valid without the descriptor
+    ::close(fd);
+#endif
+
+    if (data == NULL_PTR)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (data != NULL_PTR) {
+        UnmapViewOfFile(data);
+    }
+    if (mapHandle != NULL_PTR) {
+        CloseHandle((HANDLE)mapHandle);
+    }
+    if (fileHandle != NULL_PTR) {
+        CloseHandle((HANDLE)fileHandle);
+    }
+#else
+    if (data != NULL_PTR) {
+        munmap((void*)data, (size_t)size);
+    }
+#endif
+    fileHandle = NULL_PTR;
+    mapHandle = NULL_PTR;
+    data = NULL_PTR;
+    size = 0;
+}
+
+const unsigned char* MappedFile::getData() const
+{
+    return data;
+}
+
+unsigned long long MappedFile::getSize() const
+{
+    return size;
+}
+
+long long Platform_AtomicAdd(volatile long long* value, long long delta)
+{
+#ifdef _WIN32
+    LONGLONG old = *value;
+    while (true)
+    {
+        LONGLONG seen = InterlockedCompareExchange64(value, old + delta, old);
+        if (seen == old) {
+            return old + delta;
+        }
+        old = seen;
+    }
+#else
+    return __sync_add_and_fetch(value, delta);
+#endif
+}
+
+bool Platform_AtomicCompareExchange(volatile unsigned long long* value, unsigned long long expected, unsigned long long desired)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchange64((volatile LONGLONG*)value, (LONGLONG)desired, (LONGLONG)expected) == (LONGLONG)expected;
+#else
+    return __sync_bool_compare_and_swap(value, expected, desired);
+#endif
+}
+
+unsigned long long Platform_AtomicLoad(const volatile unsigned long long* value)
+{
+#if defined(_WIN64) || defined(__x86_64__) || defined(__aarch64__)
+    return *value;
+#elif defined(_WIN32)
+    return (unsigned long long)InterlockedCompareExchange64((volatile LONGLONG*)value, 0, 0);
+#else
+    return __sync_val_compare_and_swap((volatile unsigned long long*)value, 0, 0);
+#endif
+}
+
+int Platform_GetCpuCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+void Platform_Sleep(int ms)
+{
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+bool Platform_SyncFile(FILE* file)
+{
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool Platform_ReplaceFile(const char* from, const char* to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdio.h>
+
+// Threads, locks, atomics and timers for code that runs outside of the main loop.
+// Implemented on top of Win32 and pthreads.
+
+class Thread
+{
+public:
+    typedef void (*Func)(void* arg);
+
+    Thread();
+    ~Thread();
+
+    bool start(Func func, void* arg);
+    void join();
+    bool started() const;
+
+private:
+    void* handle;
+
+    Thread(const Thread&);
+    Thread& operator=(const Thread&);
+};
+
+class Mutex
+{
+public:
+    Mutex();
+    ~Mutex();
+
+    void lock();
+    void unlock();
+
+private:
+    void* handle;
+
+    Mutex(const Mutex&);
+    Mutex& operator=(const Mutex&);
+};
+
+class ScopedLock
+{
+public:
+    explicit ScopedLock(Mutex& m): mutex(m)
+    {
+        mutex.lock();
+    }
+
+    ~ScopedLock()
+    {
+        mutex.unlock();
+    }
+
+private:
+    Mutex& mutex;
+
+    ScopedLock(const ScopedLock&);
+    ScopedLock& operator=(const ScopedLock&);
+};
+
+// Auto-reset event: wait() returns once for every set()
+class Signal
+{
+public:
+    Signal();
+    ~Signal();
+
+    void set();
+    bool wait(int timeoutMs);
+
+private:
+    void* handle;
+
+    Signal(const Signal&);
+    Signal& operator=(const Signal&);
+};
+
+// Read-only view of a whole file, pages are read in when first touched.
+// On 32-bit builds the file has to fit into the free address space.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char* path);
+    void close();
+
+    const unsigned char* getData() const;
+    unsigned long long getSize() const;
+
+private:
+    void* fileHandle;
+    void* mapHandle;
+    const unsigned char* data;
+    unsigned long long size;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+// Atomic operations on 64-bit values, all of them are full barriers except
+// the load
+long long Platform_AtomicAdd(volatile long long* value, long long delta);
+bool Platform_AtomicCompareExchange(volatile unsigned long long* value, unsigned long long expected, unsigned long long desired);
+unsigned long long Platform_AtomicLoad(const volatile unsigned long long* value);
+
+double Platform_GetTime();
+// Wall clock time, milliseconds since 1970-01-01 UTC
+unsigned long long Platform_GetUnixTimeMs();
+int Platform_GetCpuCount();
+void Platform_Sleep(int ms);
+
+// Writes what stdio buffered for the file and waits until the disk has it
+bool Platform_SyncFile(FILE* file);
+// Renames a file over another one, the target is either the old file or
+// the new one at every moment
+bool Platform_ReplaceFile(const char* from, const char* to);
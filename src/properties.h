@@ -1,9 +1,31 @@
 #pragma once
 
-#include "generated\resources_gen.h"
-
 static const double FRAME_TIME = 1/60.;
 static const float DRAG_DIST_THRESHOLD_SQR = 64.f;
+static const bool WINNABLE_DEALS_ONLY = true;
+// Cards no other card could need any more go to the foundations by themselves
+static const bool AUTO_COLLECT = true;
+// Moves undone and replaced by others stay in the history as branches
+static const bool KEEP_UNDO_BRANCHES = true;
+// Tier of DifficultyIndex to deal from when DEAL_INDEX_FILE is there, -1 for any deal
+static const int DEAL_TIER = -1;
+static const char DEAL_INDEX_FILE[] = "deals.idx";
+static const int DEAD_END_MICROS_PER_TICK = 200;
+// The game appends every game played here, see replay.h; empty for none
+static const char REPLAY_FILE[] = "replays.rpl";
+// Raw input of the session is recorded here for tools/xenny-run, see
+// inputlog.h; empty for none
+static const char INPUT_LOG_FILE[] = "";
+// The session is kept here and resumed on the next start, see
+// Commander::keepSession; empty for none
+static const char SESSION_FILE[] = "session.dat";
+// Moves made since the session was saved go here, see journal.h; a crash
+// loses at most the last JOURNAL_SYNC_MS of play. Empty for none.
+static const char JOURNAL_FILE[] = "session.jnl";
+static const int JOURNAL_SYNC_MS = 500;
+// The session is saved again and the journal started over after this many
+// records, and at every new deal
+static const int JOURNAL_RECORDS_PER_SAVE = 4096;
 
 static const int NULL_PTR = 0;
 static const int CARD_ID_NULL = -1;
@@ -25,6 +47,13 @@ static const int WASTE_COUNT = 1;
 static const int HAND_COUNT = 1;
 static const int STACK_COUNT = TABLEAU_COUNT + FOUNDATION_COUNT + STOCK_COUNT + WASTE_COUNT + HAND_COUNT;
 
+// Stack numbering used by GameState::getStack()
+static const int STACK_IDX_TABLEAU = 0;
+static const int STACK_IDX_FOUNDATION = STACK_IDX_TABLEAU + TABLEAU_COUNT;
+static const int STACK_IDX_STOCK = STACK_IDX_FOUNDATION + FOUNDATION_COUNT;
+static const int STACK_IDX_WASTE = STACK_IDX_STOCK + STOCK_COUNT;
+static const int STACK_IDX_HAND = STACK_IDX_WASTE + WASTE_COUNT;
+
 static const int BUTTON_STATES = 4;
 static const float BUTTON_TEX_DIMENSIONS[2] = {48.f/2048.f, 48.f/1024.f};
 static const float BUTTON_UNDO_TEX_POS[2] = {0/2048.f, 0/1024.f};
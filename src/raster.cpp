@@ -0,0 +1,452 @@
+#include "raster.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "properties.h"
+#include "utils.h"
+
+// Bilinear weights have 7 bits, so the differences they scale stay within
+// 16-bit lanes
+static const int WEIGHT_BITS = 7;
+static const unsigned int ALPHA_MASK = 0xFF000000u;
+
+// Grows an array to hold at least count elements, contents are dropped
+template <class T>
+static void reserve(T** data, int* capacity, int count)
+{
+    if (count > *capacity)
+    {
+        int newCapacity = *capacity > 0 ? *capacity : 64;
+        while (newCapacity < count) {
+            newCapacity *= 2;
+        }
+        delete[] *data;
+        *data = new T[newCapacity];
+        *capacity = newCapacity;
+    }
+}
+
+// The four texels around a sample, left and right of the top row, then of
+// the bottom one, blended over dst: (src * a + dst * (255 - a)) / 255 with
+// rounding, for every channel alpha included
+#ifdef RASTER_SSE2
+static inline unsigned int blendSample(unsigned int dst,
+                                       unsigned int t00, unsigned int t01,
+                                       unsigned int t10, unsigned int t11,
+                                       int fx, int fy)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)t00), _mm_cvtsi32_si128((int)t01)), zero);
+    __m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)t10), _mm_cvtsi32_si128((int)t11)), zero);
+
+    // Down the columns, then across; lanes 0..3 end up with the sample
+    __m128i column = _mm_add_epi16(top, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(bottom, top), _mm_set1_epi16((short)fy)), WEIGHT_BITS));
+    __m128i right = _mm_srli_si128(column, 8);
+    __m128i src = _mm_add_epi16(column, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(right, column), _mm_set1_epi16((short)fx)), WEIGHT_BITS));
+
+    if ((t00 & t01 & t10 & t11 & ALPHA_MASK) == ALPHA_MASK) {
+        return (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(src, src));
+    }
+
+    __m128i alpha = _mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i back = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)dst), zero);
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(src, alpha), _mm_mullo_epi16(back, _mm_sub_epi16(_mm_set1_epi16(255), alpha)));
+    sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+    sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_srli_epi16(sum, 8)), 8);
+    return (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+}
+#else
+static inline int lerpChannel(int a, int b, int f)
+{
+    return a + (((b - a) * f) >> WEIGHT_BITS);
+}
+
+static inline unsigned int blendSample(unsigned int dst,
+                                       unsigned int t00, unsigned int t01,
+                                       unsigned int t10, unsigned int t11,
+                                       int fx, int fy)
+{
+    int src[4];
+    for (int c=0; c<4; c++)
+    {
+        int shift = c * 8;
+        int left = lerpChannel((t00 >> shift) & 0xFF, (t10 >> shift) & 0xFF, fy);
+        int right = lerpChannel((t01 >> shift) & 0xFF, (t11 >> shift) & 0xFF, fy);
+        src[c] = lerpChannel(left, right, fx);
+    }
+
+    bool opaque = (t00 & t01 & t10 & t11 & ALPHA_MASK) == ALPHA_MASK;
+    unsigned int result = 0;
+    for (int c=0; c<4; c++)
+    {
+        int sum = src[c];
+        if (opaque == false)
+        {
+            sum = src[c] * src[3] + (int)((dst >> (c * 8)) & 0xFF) * (255 - src[3]) + 128;
+            sum = (sum + (sum >> 8)) >> 8;
+        }
+        result |= (unsigned int)sum << (c * 8);
+    }
+    return result;
+}
+#endif
+
+SoftRenderer::SoftRenderer()
+    : textureCount(0)
+    , activeTexture(0)
+    , pixels(NULL_PTR)
+    , width(0)
+    , height(0)
+    , capacity(0)
+    , clearColor(0)
+    , quads(NULL_PTR)
+    , quadCount(0)
+    , quadCapacity(0)
+    , tilesX(0)
+    , tilesY(0)
+    , tileStarts(NULL_PTR)
+    , tileQuads(NULL_PTR)
+    , tileCapacity(0)
+    , tileQuadCapacity(0)
+    , nextTile(0)
+    , workers(NULL_PTR)
+    , workerCount(0)
+    , workersBusy(0)
+    , stopping(false)
+{
+}
+
+SoftRenderer::~SoftRenderer()
+{
+    stop();
+    for (int i=0; i<textureCount; i++) {
+        delete[] textures[i].texels;
+    }
+    delete[] pixels;
+    delete[] quads;
+    delete[] tileStarts;
+    delete[] tileQuads;
+}
+
+void SoftRenderer::start(int threadCount)
+{
+    stop();
+    stopping = false;
+    workers = new Worker[threadCount > 0 ? threadCount : 1];
+    for (int i=0; i<threadCount; i++)
+    {
+        workers[i].renderer = this;
+        if (workers[i].thread.start(workerMain, &workers[i]) == false) {
+            break;
+        }
+        workerCount++;
+    }
+}
+
+void SoftRenderer::stop()
+{
+    stopping = true;
+    for (int i=0; i<workerCount; i++)
+    {
+        workers[i].wakeUp.set();
+        workers[i].thread.join();
+    }
+    delete[] workers;
+    workers = NULL_PTR;
+    workerCount = 0;
+}
+
+int SoftRenderer::addTexture(const unsigned char* texels, int aWidth, int aHeight)
+{
+    if (textureCount == MAX_TEXTURES || aWidth < 1 || aHeight < 1) {
+        return -1;
+    }
+    Texture& texture = textures[textureCount];
+    texture.width = aWidth;
+    texture.height = aHeight;
+    texture.texels = new unsigned int[aWidth * aHeight];
+    memcpy(texture.texels, texels, aWidth * aHeight * 4);
+    return textureCount++;
+}
+
+void SoftRenderer::setTexture(int handle)
+{
+    activeTexture = handle;
+}
+
+void SoftRenderer::clear(int aWidth, int aHeight, int rgb)
+{
+    width = aWidth > 0 ? aWidth : 0;
+    height = aHeight > 0 ? aHeight : 0;
+    reserve(&pixels, &capacity, width * height);
+
+    unsigned char color[4] = {(unsigned char)(rgb >> 16), (unsigned char)(rgb >> 8), (unsigned char)rgb, 0xFF};
+    memcpy(&clearColor, color, sizeof(clearColor));
+    quadCount = 0;
+}
+
+void SoftRenderer::addQuad(float sx, float sy, float sw, float sh, float tx, float ty, float tw, float th)
+{
+    if (activeTexture < 0 || activeTexture >= textureCount) {
+        return;
+    }
+
+    // Step #1: a flip on screen is a flip of the texture, then the pixels
+    // with their centres inside
+
+    if (sw < 0.f)
+    {
+        sx += sw;
+        sw = -sw;
+        tx += tw;
+        tw = -tw;
+    }
+    if (sh < 0.f)
+    {
+        sy += sh;
+        sh = -sh;
+        ty += th;
+        th = -th;
+    }
+
+    Quad quad;
+    quad.x0 = (int)ceil(sx - 0.5);
+    quad.y0 = (int)ceil(sy - 0.5);
+    quad.x1 = (int)ceil(sx + sw - 0.5);
+    quad.y1 = (int)ceil(sy + sh - 0.5);
+    doMax(quad.x0, 0);
+    doMax(quad.y0, 0);
+    if (quad.x1 > width) {
+        quad.x1 = width;
+    }
+    if (quad.y1 > height) {
+        quad.y1 = height;
+    }
+    if (quad.x0 >= quad.x1 || quad.y0 >= quad.y1) {
+        return;
+    }
+
+    // Step #2: the texel under the first centre, texel centres at .5 as
+    // the GPU has them
+
+    const Texture& texture = textures[activeTexture];
+    double du = (double)tw * texture.width / sw;
+    double dv = (double)th * texture.height / sh;
+    double u = ((double)tx + (quad.x0 + 0.5 - sx) / sw * tw) * texture.width - 0.5;
+    double v = ((double)ty + (quad.y0 + 0.5 - sy) / sh * th) * texture.height - 0.5;
+    quad.texture = activeTexture;
+    quad.u0 = (long long)floor(u * TEXEL_ONE + 0.5);
+    quad.v0 = (long long)floor(v * TEXEL_ONE + 0.5);
+    quad.du = (long long)floor(du * TEXEL_ONE + 0.5);
+    quad.dv = (long long)floor(dv * TEXEL_ONE + 0.5);
+
+    if (quadCount == quadCapacity)
+    {
+        int newCapacity = quadCapacity > 0 ? quadCapacity * 2 : 256;
+        Quad* grown = new Quad[newCapacity];
+        if (quadCount > 0) {
+            memcpy(grown, quads, quadCount * sizeof(Quad));
+        }
+        delete[] quads;
+        quads = grown;
+        quadCapacity = newCapacity;
+    }
+    quads[quadCount++] = quad;
+}
+
+void SoftRenderer::finish()
+{
+    // Step #1: quads binned by tile in the order they came, counted first
+    // and then placed, tileStarts ending up one tile behind
+
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    int tileCount = tilesX * tilesY;
+    reserve(&tileStarts, &tileCapacity, tileCount + 1);
+    memset(tileStarts, 0, (tileCount + 1) * sizeof(int));
+
+    for (int i=0; i<quadCount; i++) {
+        for (int ty=quads[i].y0/TILE_SIZE; ty<=(quads[i].y1-1)/TILE_SIZE; ty++) {
+            for (int tx=quads[i].x0/TILE_SIZE; tx<=(quads[i].x1-1)/TILE_SIZE; tx++) {
+                tileStarts[ty*tilesX + tx + 1]++;
+            }
+        }
+    }
+    for (int t=0; t<tileCount; t++) {
+        tileStarts[t+1] += tileStarts[t];
+    }
+    reserve(&tileQuads, &tileQuadCapacity, tileStarts[tileCount]);
+    for (int i=0; i<quadCount; i++) {
+        for (int ty=quads[i].y0/TILE_SIZE; ty<=(quads[i].y1-1)/TILE_SIZE; ty++) {
+            for (int tx=quads[i].x0/TILE_SIZE; tx<=(quads[i].x1-1)/TILE_SIZE; tx++) {
+                tileQuads[tileStarts[ty*tilesX + tx]++] = i;
+            }
+        }
+    }
+    for (int t=tileCount; t>0; t--) {
+        tileStarts[t] = tileStarts[t-1];
+    }
+    tileStarts[0] = 0;
+
+    // Step #2: tiles taken one at a time by every thread; the workers are
+    // waited for before the quads can change again
+
+    nextTile = 0;
+    workersBusy = workerCount;
+    for (int i=0; i<workerCount; i++) {
+        workers[i].wakeUp.set();
+    }
+    shadeTiles();
+    while (Platform_AtomicAdd(&workersBusy, 0) > 0) {
+        frameDone.wait(1);
+    }
+}
+
+const unsigned char* SoftRenderer::getPixels() const
+{
+    return (const unsigned char*)pixels;
+}
+
+int SoftRenderer::getWidth() const
+{
+    return width;
+}
+
+int SoftRenderer::getHeight() const
+{
+    return height;
+}
+
+int SoftRenderer::getQuadCount() const
+{
+    return quadCount;
+}
+
+bool SoftRenderer::savePpm(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL_PTR) {
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    const unsigned char* p = getPixels();
+    bool ok = true;
+    for (int i=0; ok && i<width*height; i++) {
+        ok = fwrite(p + i*4, 1, 3, file) == 3;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+void SoftRenderer::workerMain(void* arg)
+{
+    Worker* worker = (Worker*)arg;
+    worker->renderer->run(worker);
+}
+
+void SoftRenderer::run(Worker* worker)
+{
+    while (true)
+    {
+        if (worker->wakeUp.wait(1000) == false) {
+            continue;
+        }
+        if (stopping) {
+            break;
+        }
+        shadeTiles();
+        Platform_AtomicAdd(&workersBusy, -1);
+        frameDone.set();
+    }
+}
+
+void SoftRenderer::shadeTiles()
+{
+    int tileCount = tilesX * tilesY;
+    for (int tile = (int)Platform_AtomicAdd(&nextTile, 1) - 1; tile < tileCount; tile = (int)Platform_AtomicAdd(&nextTile, 1) - 1) {
+        shadeTile(tile);
+    }
+}
+
+void SoftRenderer::shadeTile(int tile)
+{
+    int x0 = (tile % tilesX) * TILE_SIZE;
+    int y0 = (tile / tilesX) * TILE_SIZE;
+    int x1 = x0 + TILE_SIZE < width ? x0 + TILE_SIZE : width;
+    int y1 = y0 + TILE_SIZE < height ? y0 + TILE_SIZE : height;
+
+    for (int y=y0; y<y1; y++)
+    {
+        unsigned int* row = pixels + y*width;
+        for (int x=x0; x<x1; x++) {
+            row[x] = clearColor;
+        }
+    }
+
+    for (int i=tileStarts[tile]; i<tileStarts[tile+1]; i++)
+    {
+        const Quad& quad = quads[tileQuads[i]];
+        drawQuad(quad,
+            quad.x0 > x0 ? quad.x0 : x0, quad.y0 > y0 ? quad.y0 : y0,
+            quad.x1 < x1 ? quad.x1 : x1, quad.y1 < y1 ? quad.y1 : y1);
+    }
+}
+
+void SoftRenderer::drawQuad(const Quad& quad, int x0, int y0, int x1, int y1)
+{
+    const Texture& texture = textures[quad.texture];
+    int maxX = texture.width - 1;
+    int maxY = texture.height - 1;
+
+    // Step #1: texels and weights of the columns, the same for every row,
+    // clamped to the edges of the texture
+
+    int left[TILE_SIZE];
+    int right[TILE_SIZE];
+    int weightX[TILE_SIZE];
+    for (int x=x0; x<x1; x++)
+    {
+        long long u = quad.u0 + (x - quad.x0) * quad.du;
+        int texel = (int)(u >> TEXEL_BITS);
+        int i = x - x0;
+        left[i] = texel < 0 ? 0 : (texel > maxX ? maxX : texel);
+        right[i] = texel + 1 < 0 ? 0 : (texel + 1 > maxX ? maxX : texel + 1);
+        weightX[i] = (int)(u >> (TEXEL_BITS - WEIGHT_BITS)) & ((1 << WEIGHT_BITS) - 1);
+    }
+
+    // Step #2: row by row
+
+    for (int y=y0; y<y1; y++)
+    {
+        long long v = quad.v0 + (y - quad.y0) * quad.dv;
+        int texel = (int)(v >> TEXEL_BITS);
+        int top = texel < 0 ? 0 : (texel > maxY ? maxY : texel);
+        int bottom = texel + 1 < 0 ? 0 : (texel + 1 > maxY ? maxY : texel + 1);
+        int weightY = (int)(v >> (TEXEL_BITS - WEIGHT_BITS)) & ((1 << WEIGHT_BITS) - 1);
+
+        const unsigned int* topRow = texture.texels + top * texture.width;
+        const unsigned int* bottomRow = texture.texels + bottom * texture.width;
+        unsigned int* row = pixels + y*width;
+        for (int x=x0; x<x1; x++)
+        {
+            int i = x - x0;
+            unsigned int t00 = topRow[left[i]];
+            unsigned int t01 = topRow[right[i]];
+            unsigned int t10 = bottomRow[left[i]];
+            unsigned int t11 = bottomRow[right[i]];
+
+            // Nothing to blend, the pixel stays as it is
+            if (((t00 | t01 | t10 | t11) & ALPHA_MASK) == 0) {
+                continue;
+            }
+            row[x] = blendSample(row[x], t00, t01, t10, t11, weightX[i], weightY);
+        }
+    }
+}
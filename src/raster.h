@@ -0,0 +1,124 @@
+#pragma once
+
+#include "platform.h"
+
+// Draws what the game sends through system.h on the CPU, for golden images
+// and machines with no GPU: axis-aligned quads sampled bilinearly from an
+// RGBA texture, clamped to its edges, and blended over the frame by their
+// alpha the way the window does with glBlendFunc(GL_SRC_ALPHA,
+// GL_ONE_MINUS_SRC_ALPHA). Integer math only, so every machine draws the
+// same pixels, with SSE2 where the compiler has it.
+//
+// The quads of a frame are collected until finish(), then binned into
+// TILE_SIZE squares and the tiles shaded on all threads, every tile by
+// one thread in the order the quads came.
+class SoftRenderer
+{
+public:
+    static const int TILE_SIZE = 64;
+    static const int MAX_TEXTURES = 16;
+
+    SoftRenderer();
+    ~SoftRenderer();
+
+    // Threads besides the one calling finish()
+    void start(int threadCount);
+    void stop();
+
+    // Pixels are four bytes, R G B A, row by row from the top; the
+    // renderer keeps a copy. Returns the handle or -1 when full.
+    int addTexture(const unsigned char* pixels, int width, int height);
+    void setTexture(int handle);
+
+    // Starts a frame of the given size filled with 0xRRGGBB
+    void clear(int width, int height, int rgb);
+
+    // Screen position and size in pixels, texture ones from 0 to 1; a
+    // negative texture size flips the quad
+    void addQuad(float sx, float sy, float sw, float sh, float tx, float ty, float tw, float th);
+
+    // Draws the frame, the pixels stay until the next clear()
+    void finish();
+
+    // Four bytes per pixel as for textures
+    const unsigned char* getPixels() const;
+    int getWidth() const;
+    int getHeight() const;
+    int getQuadCount() const;
+
+    // Binary PPM of the frame, alpha left out
+    bool savePpm(const char* path) const;
+
+private:
+    struct Texture
+    {
+        unsigned int* texels;
+        int width;
+        int height;
+    };
+
+    // A quad in pixels covered: columns x0..x1-1 and rows y0..y1-1 have
+    // their centres inside it; texel coordinates of the first centre and
+    // their steps are in 1/TEXEL_ONE of a texel
+    struct Quad
+    {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+        int texture;
+        long long u0;
+        long long v0;
+        long long du;
+        long long dv;
+    };
+
+    struct Worker
+    {
+        SoftRenderer* renderer;
+        Thread thread;
+        Signal wakeUp;
+    };
+
+    static const int TEXEL_BITS = 16;
+    static const long long TEXEL_ONE = 1LL << TEXEL_BITS;
+
+    static void workerMain(void* arg);
+    void run(Worker* worker);
+    void shadeTiles();
+    void shadeTile(int tile);
+    void drawQuad(const Quad& quad, int x0, int y0, int x1, int y1);
+
+    Texture textures[MAX_TEXTURES];
+    int textureCount;
+    int activeTexture;
+
+    unsigned int* pixels;
+    int width;
+    int height;
+    int capacity;
+    unsigned int clearColor;
+
+    Quad* quads;
+    int quadCount;
+    int quadCapacity;
+
+    // Quads of every tile one after the other, tileStarts[i] being where
+    // the ones of tile i begin
+    int tilesX;
+    int tilesY;
+    int* tileStarts;
+    int* tileQuads;
+    int tileCapacity;
+    int tileQuadCapacity;
+    volatile long long nextTile;
+
+    Worker* workers;
+    int workerCount;
+    volatile long long workersBusy;
+    volatile bool stopping;
+    Signal frameDone;
+
+    SoftRenderer(const SoftRenderer&);
+    SoftRenderer& operator=(const SoftRenderer&);
+};
@@ -0,0 +1,531 @@
+#include "replay.h"
+
+#include <string.h>
+
+#include "platform.h"
+
+static const unsigned char MAGIC[] = {0xFE, 'X', 'N', 'Y', 'R', 'P', 'L'};
+static const int MAGIC_SIZE = 7;
+
+// Header start, version, flags, draw count, redeal limit, a spare byte and
+// the start time; then the deal number or the cards
+static const int HEADER_SIZE = 20;
+static const int FLAG_NUMBERED = 1;
+
+static const int CODE_DRAW = 0xB0;
+static const int CODE_UNDO = 0xD0;
+static const int CODE_REDO = 0xD1;
+static const int CODE_SEEK = 0xD2;
+static const int CODE_BRANCH = 0xD3;
+static const int CODE_AUTO_MOVE = 0xD4;
+static const int CODE_HEADER = 0xFE;
+static const int CODE_END = 0xFF;
+
+static void putU64(unsigned char* p, unsigned long long v)
+{
+    for (int i=0; i<8; i++) {
+        p[i] = (unsigned char)(v >> (8*i));
+    }
+}
+
+static unsigned long long getU64(const unsigned char* p)
+{
+    unsigned long long v = 0;
+    for (int i=0; i<8; i++) {
+        v |= (unsigned long long)p[i] << (8*i);
+    }
+    return v;
+}
+
+static bool applyAutoMove(GameState* gameState)
+{
+    CardStack* dst = NULL_PTR;
+    int srcIdx = -1;
+    CardStack* src = gameState->findAutoMove(&dst, &srcIdx);
+    if (src == NULL_PTR) {
+        return false;
+    }
+    gameState->doAutoMove(src, srcIdx, dst);
+    return true;
+}
+
+ReplayHeader::ReplayHeader()
+    : numbered(false)
+    , dealNumber(0)
+    , drawCount(1)
+    , redealLimit(0)
+    , startTime(0)
+{
+    memset(deal.cardIds, 0, sizeof(deal.cardIds));
+}
+
+ReplayWriter::ReplayWriter()
+    : file(NULL_PTR)
+    , inGame(false)
+    , gameStart(0.0)
+    , gameSize(0)
+    , pendingDraws(0)
+    , bufferCount(0)
+{
+}
+
+ReplayWriter::~ReplayWriter()
+{
+    close();
+}
+
+bool ReplayWriter::open(const char* path)
+{
+    close();
+    file = fopen(path, "ab");
+    return file != NULL_PTR;
+}
+
+void ReplayWriter::close()
+{
+    if (file != NULL_PTR)
+    {
+        endGame();
+        flush();
+        fclose(file);
+        file = NULL_PTR;
+    }
+}
+
+bool ReplayWriter::isOpen() const
+{
+    return file != NULL_PTR;
+}
+
+void ReplayWriter::beginGame(const GameState& gameState)
+{
+    endGame();
+    if (file == NULL_PTR) {
+        return;
+    }
+
+    // Step #1: header, the deal number or else the cards in dealing order,
+    // which the stacks still hold before the first move
+
+    ReplayHeader header;
+    header.numbered = gameState.getDealNumber(&header.dealNumber);
+    header.startTime = Platform_GetUnixTimeMs();
+
+    unsigned char data[HEADER_SIZE + CARDS_TOTAL];
+    memcpy(data, MAGIC, MAGIC_SIZE);
+    data[7] = (unsigned char)ReplayHeader::VERSION;
+    data[8] = (unsigned char)(header.numbered ? FLAG_NUMBERED : 0);
+    data[9] = (unsigned char)header.drawCount;
+    data[10] = (unsigned char)header.redealLimit;
+    data[11] = 0;
+    putU64(data+12, header.startTime);
+
+    int size = HEADER_SIZE;
+    if (header.numbered)
+    {
+        putU64(data+size, header.dealNumber);
+        size += 8;
+    }
+    else
+    {
+        for (int i=0; i<TABLEAU_COUNT; i++) {
+            for (int j=0; j<gameState.tableaux[i].size(); j++) {
+                data[size++] = (unsigned char)gameState.tableaux[i][j].id;
+            }
+        }
+        for (int i=0; i<gameState.stock.size(); i++) {
+            data[size++] = (unsigned char)gameState.stock[i].id;
+        }
+    }
+
+    // Step #2: the steps follow as they are made
+
+    inGame = true;
+    gameStart = Platform_GetTime();
+    gameSize = 0;
+    pendingDraws = 0;
+    for (int i=0; i<size; i++) {
+        putByte(data[i]);
+    }
+}
+
+void ReplayWriter::endGame()
+{
+    if (inGame)
+    {
+        flushDraws();
+        putByte(CODE_END);
+        putVarint((unsigned long long)((Platform_GetTime() - gameStart) * 1000.0));
+        flush();
+        inGame = false;
+    }
+}
+
+void ReplayWriter::OnHistoryEvent(const HistoryEvent& event, void* arg)
+{
+    ReplayWriter* writer = (ReplayWriter*)arg;
+    if (writer->inGame) {
+        writer->addEvent(event);
+    }
+}
+
+void ReplayWriter::addEvent(const HistoryEvent& event)
+{
+    // Stock advances in a row take one byte together
+    if (event.type == HistoryEvent::TYPE_MOVE && event.move.fromStock && event.move.src == STACK_IDX_STOCK)
+    {
+        if (++pendingDraws == MAX_DRAW_RUN) {
+            flushDraws();
+        }
+        return;
+    }
+
+    flushDraws();
+    switch (event.type)
+    {
+    case HistoryEvent::TYPE_MOVE:
+        putByte((event.move.src << 4) | event.move.dst);
+        break;
+    case HistoryEvent::TYPE_UNDO:
+        putByte(CODE_UNDO);
+        break;
+    case HistoryEvent::TYPE_REDO:
+        putByte(CODE_REDO);
+        break;
+    case HistoryEvent::TYPE_SEEK:
+        putByte(CODE_SEEK);
+        putVarint((unsigned long long)event.arg);
+        break;
+    case HistoryEvent::TYPE_BRANCH:
+        putByte(CODE_BRANCH);
+        putVarint((unsigned long long)event.arg);
+        break;
+    case HistoryEvent::TYPE_AUTO_MOVE:
+        putByte(CODE_AUTO_MOVE);
+        break;
+    }
+}
+
+void ReplayWriter::flushDraws()
+{
+    if (pendingDraws > 0)
+    {
+        putByte(CODE_DRAW | (pendingDraws - 1));
+        pendingDraws = 0;
+    }
+}
+
+void ReplayWriter::flush()
+{
+    if (file != NULL_PTR && bufferCount > 0)
+    {
+        fwrite(buffer, 1, bufferCount, file);
+        fflush(file);
+    }
+    bufferCount = 0;
+}
+
+long long ReplayWriter::getGameSize() const
+{
+    return gameSize + (pendingDraws > 0 ? 1 : 0);
+}
+
+void ReplayWriter::putByte(int b)
+{
+    if (bufferCount == BUFFER_SIZE) {
+        flush();
+    }
+    buffer[bufferCount++] = (unsigned char)b;
+    gameSize++;
+}
+
+void ReplayWriter::putVarint(unsigned long long v)
+{
+    while (v >= 0x80)
+    {
+        putByte((int)(v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    putByte((int)v);
+}
+
+ReplayReader::ReplayReader()
+    : file(NULL_PTR)
+    , inReplay(false)
+    , pendingHeader(false)
+    , result(RESULT_OK)
+    , bufferCount(0)
+    , bufferPos(0)
+{
+}
+
+ReplayReader::~ReplayReader()
+{
+    close();
+}
+
+bool ReplayReader::open(const char* path)
+{
+    close();
+    file = fopen(path, "rb");
+    return file != NULL_PTR;
+}
+
+void ReplayReader::close()
+{
+    if (file != NULL_PTR)
+    {
+        fclose(file);
+        file = NULL_PTR;
+    }
+    inReplay = false;
+    pendingHeader = false;
+    bufferCount = bufferPos = 0;
+}
+
+bool ReplayReader::nextReplay(ReplayHeader* header)
+{
+    ReplayStep step;
+    while (inReplay && nextStep(&step))
+        ;
+
+    // Step #1: the header start, which a replay cut short may have taken
+
+    if (pendingHeader == false && getByte() != CODE_HEADER) {
+        return false;
+    }
+    pendingHeader = false;
+
+    unsigned char data[HEADER_SIZE + CARDS_TOTAL];
+    data[0] = CODE_HEADER;
+    for (int i=1; i<HEADER_SIZE; i++)
+    {
+        int b = getByte();
+        if (b < 0) {
+            return false;
+        }
+        data[i] = (unsigned char)b;
+    }
+    if (memcmp(data, MAGIC, MAGIC_SIZE) != 0 || data[7] < 1 || data[7] > ReplayHeader::VERSION) {
+        return false;
+    }
+
+    // Step #2: the fields and the deal
+
+    *header = ReplayHeader();
+    header->numbered = (data[8] & FLAG_NUMBERED) != 0;
+    header->drawCount = data[9];
+    header->redealLimit = data[10];
+    header->startTime = getU64(data+12);
+
+    int dealSize = header->numbered ? 8 : CARDS_TOTAL;
+    for (int i=0; i<dealSize; i++)
+    {
+        int b = getByte();
+        if (b < 0) {
+            return false;
+        }
+        data[HEADER_SIZE+i] = (unsigned char)b;
+    }
+
+    if (header->numbered) {
+        header->dealNumber = getU64(data+HEADER_SIZE);
+    }
+    else
+    {
+        unsigned long long seen = 0;
+        for (int i=0; i<CARDS_TOTAL; i++)
+        {
+            int id = data[HEADER_SIZE+i];
+            if (id >= CARDS_TOTAL || (seen >> id) & 1) {
+                return false;
+            }
+            seen |= 1ULL << id;
+            header->deal.cardIds[i] = (unsigned char)id;
+        }
+    }
+
+    inReplay = true;
+    result = RESULT_CUT_SHORT;
+    return true;
+}
+
+bool ReplayReader::nextStep(ReplayStep* step)
+{
+    if (inReplay == false) {
+        return false;
+    }
+
+    int b = getByte();
+    bool ok = b >= 0;
+    step->src = STACK_ID_NULL;
+    step->dst = STACK_ID_NULL;
+    step->arg = 0;
+
+    if (b == CODE_END)
+    {
+        step->type = ReplayStep::TYPE_END;
+        ok = getVarint(&step->arg);
+        if (ok)
+        {
+            inReplay = false;
+            result = RESULT_OK;
+            return true;
+        }
+    }
+    else if (b == CODE_HEADER)
+    {
+        pendingHeader = true;
+        ok = false;
+    }
+    else if (b == CODE_UNDO || b == CODE_REDO)
+    {
+        step->type = b == CODE_UNDO ? ReplayStep::TYPE_UNDO : ReplayStep::TYPE_REDO;
+    }
+    else if (b == CODE_SEEK || b == CODE_BRANCH)
+    {
+        step->type = b == CODE_SEEK ? ReplayStep::TYPE_SEEK : ReplayStep::TYPE_BRANCH;
+        ok = getVarint(&step->arg);
+    }
+    else if (b == CODE_AUTO_MOVE)
+    {
+        step->type = ReplayStep::TYPE_AUTO_MOVE;
+    }
+    else if ((b & 0xF0) == CODE_DRAW)
+    {
+        step->type = ReplayStep::TYPE_DRAW;
+        step->arg = (b & 0x0F) + 1;
+    }
+    else if (ok)
+    {
+        step->type = ReplayStep::TYPE_MOVE;
+        step->src = b >> 4;
+        step->dst = b & 0x0F;
+        if (step->src >= STACK_IDX_HAND || step->dst >= STACK_IDX_HAND || step->src == step->dst)
+        {
+            result = RESULT_BAD_FORMAT;
+            ok = false;
+        }
+    }
+
+    if (ok == false) {
+        inReplay = false;
+    }
+    return ok;
+}
+
+ReplayReader::Result ReplayReader::getResult() const
+{
+    return result;
+}
+
+void ReplayReader::StartGame(const ReplayHeader& header, GameState* gameState)
+{
+    gameState->history.setKeepBranches(true);
+    if (header.numbered) {
+        gameState->init(header.dealNumber);
+    } else {
+        gameState->init(header.deal);
+    }
+}
+
+bool ReplayReader::ApplyStep(const ReplayStep& step, GameState* gameState)
+{
+    switch (step.type)
+    {
+    case ReplayStep::TYPE_MOVE:
+        break;
+    case ReplayStep::TYPE_DRAW:
+        for (unsigned long long i=0; i<step.arg; i++)
+        {
+            if (gameState->stock.empty()) {
+                return false;
+            }
+            gameState->advanceStock();
+        }
+        return true;
+    case ReplayStep::TYPE_UNDO:
+        return gameState->undo();
+    case ReplayStep::TYPE_REDO:
+        return gameState->redo();
+    case ReplayStep::TYPE_SEEK:
+        return step.arg <= (unsigned long long)gameState->history.getMoveCount() && gameState->seek((int)step.arg);
+    case ReplayStep::TYPE_BRANCH:
+        return step.arg < (unsigned long long)gameState->history.getBranchCount() && gameState->switchBranch((int)step.arg);
+    case ReplayStep::TYPE_AUTO_MOVE:
+        return applyAutoMove(gameState);
+    default:
+        return true;
+    }
+
+    // The waste turned over, or the one run of the source stack the
+    // destination takes
+    if (step.src == STACK_IDX_WASTE && step.dst == STACK_IDX_STOCK)
+    {
+        if (gameState->stock.empty() == false || gameState->waste.empty()) {
+            return false;
+        }
+        gameState->advanceStock();
+        return true;
+    }
+
+    const CardStack* src = gameState->getStack(step.src);
+    for (int idx=src->size()-1; idx>=0 && (*src)[idx].opened(); idx--)
+    {
+        if (gameState->getDestMask(step.src, idx) & (1u << step.dst))
+        {
+            gameState->fillHand(gameState->getStack(step.src), idx);
+            gameState->releaseHand(gameState->getStack(step.dst));
+            return true;
+        }
+    }
+    return false;
+}
+
+ReplayReader::Result ReplayReader::playReplay(GameState* gameState, bool* won, int* steps)
+{
+    *steps = 0;
+    ReplayStep step;
+    while (nextStep(&step))
+    {
+        if (ApplyStep(step, gameState) == false)
+        {
+            inReplay = false;
+            result = RESULT_ILLEGAL_STEP;
+            break;
+        }
+        (*steps)++;
+    }
+    *won = gameState->gameWon();
+    return result;
+}
+
+int ReplayReader::getByte()
+{
+    if (bufferPos == bufferCount)
+    {
+        bufferCount = file != NULL_PTR ? (int)fread(buffer, 1, BUFFER_SIZE, file) : 0;
+        bufferPos = 0;
+        if (bufferCount == 0) {
+            return -1;
+        }
+    }
+    return buffer[bufferPos++];
+}
+
+bool ReplayReader::getVarint(unsigned long long* v)
+{
+    *v = 0;
+    for (int shift=0; shift<64; shift+=7)
+    {
+        int b = getByte();
+        if (b < 0) {
+            return false;
+        }
+        *v |= (unsigned long long)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
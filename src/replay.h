@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "model.h"
+
+// Games as they were played, for support and for checking results. Any
+// number of replays can follow each other in one file, each one a header
+// and a stream of steps, most of them one byte:
+//
+//   0xFE "XNYRPL" version   header start, see ReplayHeader
+//   src << 4 | dst          hand move between stacks numbered as in
+//                           GameState::getStack(), the cards it takes
+//                           follow from the position; waste to stock is
+//                           the stock turned over
+//   0xB0 | (n-1)            n stock advances in a row, 1..16
+//   0xD0, 0xD1              undo, redo
+//   0xD2 varint, 0xD3 varint
+//                           GameState::seek, GameState::switchBranch
+//   0xD4                    auto move, the one GameState::findAutoMove
+//                           picks, since version 2
+//   0xFF varint             end of the game, milliseconds it took
+//
+// Varints are 7 bits per byte, low bits first. A replay cut short by a
+// crash ends where the next header starts.
+struct ReplayHeader
+{
+    static const int VERSION = 2;
+
+    // Deal by number, or by its cards when numbered is false
+    bool numbered;
+    unsigned long long dealNumber;
+    GameDeal deal;
+
+    // Cards turned by a stock advance and times the waste can be turned
+    // over, zero for no limit
+    int drawCount;
+    int redealLimit;
+
+    // Milliseconds since 1970-01-01 UTC
+    unsigned long long startTime;
+
+    ReplayHeader();
+};
+
+struct ReplayStep
+{
+    enum Type
+    {
+        TYPE_MOVE = 0,
+        TYPE_DRAW,
+        TYPE_UNDO,
+        TYPE_REDO,
+        TYPE_SEEK,
+        TYPE_BRANCH,
+        TYPE_AUTO_MOVE,
+        TYPE_END,
+    };
+
+    Type type;
+
+    // Stacks of TYPE_MOVE
+    int src;
+    int dst;
+
+    // Advances of TYPE_DRAW, move index of TYPE_SEEK, branch of
+    // TYPE_BRANCH and milliseconds of TYPE_END
+    unsigned long long arg;
+};
+
+// Appends the replay of every game started with beginGame() to a file, step
+// by step as the GameState reports them (see OnHistoryEvent). Steps are
+// buffered and written in blocks, and at the end of every game.
+class ReplayWriter
+{
+public:
+    ReplayWriter();
+    ~ReplayWriter();
+
+    bool open(const char* path);
+    void close();
+    bool isOpen() const;
+
+    // Ends the game before, if any, and starts one from the position of
+    // gameState, which has to be a deal no move was made on yet
+    void beginGame(const GameState& gameState);
+    void endGame();
+
+    // Passed to GameState::setHistoryListener with the writer as arg
+    static void OnHistoryEvent(const HistoryEvent& event, void* arg);
+
+    void flush();
+
+    // Bytes of the current game written so far, header included
+    long long getGameSize() const;
+
+private:
+    static const int BUFFER_SIZE = 4096;
+    static const int MAX_DRAW_RUN = 16;
+
+    void addEvent(const HistoryEvent& event);
+    void flushDraws();
+    void putByte(int b);
+    void putVarint(unsigned long long v);
+
+    FILE* file;
+    bool inGame;
+    double gameStart;
+    long long gameSize;
+    int pendingDraws;
+
+    unsigned char buffer[BUFFER_SIZE];
+    int bufferCount;
+
+    ReplayWriter(const ReplayWriter&);
+    ReplayWriter& operator=(const ReplayWriter&);
+};
+
+// Reads the replays of a file one step at a time without loading it
+class ReplayReader
+{
+public:
+    enum Result
+    {
+        RESULT_OK = 0,
+        RESULT_CUT_SHORT,
+        RESULT_ILLEGAL_STEP,
+        RESULT_BAD_FORMAT,
+    };
+
+    ReplayReader();
+    ~ReplayReader();
+
+    bool open(const char* path);
+    void close();
+
+    // Moves on to the next replay of the file, skipping what is left of
+    // the current one; false at the end of the file or on a broken header
+    bool nextReplay(ReplayHeader* header);
+
+    // Next step of the current replay, false after TYPE_END or when the
+    // replay was cut short or is broken, see getResult
+    bool nextStep(ReplayStep* step);
+
+    // How the current replay ended: RESULT_CUT_SHORT until TYPE_END is read
+    Result getResult() const;
+
+    // Deals the game of a header, with branches kept
+    static void StartGame(const ReplayHeader& header, GameState* gameState);
+
+    // Makes a step on gameState the way the player made it, false when it
+    // isn't legal there
+    static bool ApplyStep(const ReplayStep& step, GameState* gameState);
+
+    // Plays the rest of the current replay on a GameState dealt by
+    // StartGame; won is set when the game ended won
+    Result playReplay(GameState* gameState, bool* won, int* steps);
+
+private:
+    static const int BUFFER_SIZE = 4096;
+
+    int getByte();
+    bool getVarint(unsigned long long* v);
+
+    FILE* file;
+    bool inReplay;
+    bool pendingHeader;
+    Result result;
+
+    unsigned char buffer[BUFFER_SIZE];
+    int bufferCount;
+    int bufferPos;
+
+    ReplayReader(const ReplayReader&);
+    ReplayReader& operator=(const ReplayReader&);
+};
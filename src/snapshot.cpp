@@ -0,0 +1,208 @@
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "platform.h"
+
+// FNV-1a
+static unsigned long long hashBytes(const unsigned char* bytes, int count)
+{
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+    for (int i=0; i<count; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+SnapshotBuffer::SnapshotBuffer()
+    : data(NULL_PTR)
+    , size(0)
+    , capacity(0)
+    , readPos(0)
+    , isFailed(false)
+{
+}
+
+SnapshotBuffer::~SnapshotBuffer()
+{
+    delete[] data;
+}
+
+void SnapshotBuffer::clear()
+{
+    size = 0;
+    readPos = 0;
+    isFailed = false;
+}
+
+void SnapshotBuffer::rewind()
+{
+    readPos = 0;
+    isFailed = false;
+}
+
+void SnapshotBuffer::putInt(int v)
+{
+    memcpy(grow(sizeof(v)), &v, sizeof(v));
+}
+
+void SnapshotBuffer::putU64(unsigned long long v)
+{
+    memcpy(grow(sizeof(v)), &v, sizeof(v));
+}
+
+void SnapshotBuffer::putFloat(float v)
+{
+    memcpy(grow(sizeof(v)), &v, sizeof(v));
+}
+
+void SnapshotBuffer::putBytes(const void* bytes, int count)
+{
+    memcpy(grow(count), bytes, count);
+}
+
+int SnapshotBuffer::getInt()
+{
+    int v = 0;
+    getBytes(&v, sizeof(v));
+    return v;
+}
+
+unsigned long long SnapshotBuffer::getU64()
+{
+    unsigned long long v = 0;
+    getBytes(&v, sizeof(v));
+    return v;
+}
+
+float SnapshotBuffer::getFloat()
+{
+    float v = 0.f;
+    getBytes(&v, sizeof(v));
+    return v;
+}
+
+void SnapshotBuffer::getBytes(void* bytes, int count)
+{
+    const unsigned char* p = take(count);
+    if (p != NULL_PTR) {
+        memcpy(bytes, p, count);
+    } else {
+        memset(bytes, 0, count);
+    }
+}
+
+void SnapshotBuffer::fail()
+{
+    isFailed = true;
+}
+
+bool SnapshotBuffer::failed() const
+{
+    return isFailed;
+}
+
+void SnapshotBuffer::putChecksum()
+{
+    unsigned char* end = grow(sizeof(unsigned long long));
+    unsigned long long checksum = hashBytes(data, (int)(end - data));
+    memcpy(end, &checksum, sizeof(checksum));
+}
+
+bool SnapshotBuffer::checksumMatches() const
+{
+    int count = size - (int)sizeof(unsigned long long);
+    if (count < 0) {
+        return false;
+    }
+    unsigned long long checksum = 0;
+    memcpy(&checksum, data + count, sizeof(checksum));
+    return hashBytes(data, count) == checksum;
+}
+
+const unsigned char* SnapshotBuffer::getData() const
+{
+    return data;
+}
+
+int SnapshotBuffer::getSize() const
+{
+    return size;
+}
+
+bool SnapshotBuffer::saveFile(const char* path) const
+{
+    char tmpPath[1024];
+    int length = (int)strlen(path);
+    if (length + 5 > (int)sizeof(tmpPath)) {
+        return false;
+    }
+    memcpy(tmpPath, path, length);
+    memcpy(tmpPath + length, ".tmp", 5);
+
+    FILE* file = fopen(tmpPath, "wb");
+    if (file == NULL_PTR) {
+        return false;
+    }
+    bool ok = (int)fwrite(data, 1, size, file) == size && Platform_SyncFile(file);
+    ok = fclose(file) == 0 && ok;
+    if (ok == false)
+    {
+        remove(tmpPath);
+        return false;
+    }
+    return Platform_ReplaceFile(tmpPath, path);
+}
+
+bool SnapshotBuffer::loadFile(const char* path)
+{
+    clear();
+    FILE* file = fopen(path, "rb");
+    if (file == NULL_PTR) {
+        return false;
+    }
+
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long length = ok ? ftell(file) : -1;
+    ok = length >= 0 && length <= 0x7FFFFFFF && fseek(file, 0, SEEK_SET) == 0;
+    if (ok) {
+        ok = (long)fread(grow((int)length), 1, length, file) == length;
+    }
+    fclose(file);
+    return ok;
+}
+
+unsigned char* SnapshotBuffer::grow(int count)
+{
+    int start = count >= ALIGNMENT ? (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1) : size;
+    if (start + count > capacity)
+    {
+        int newCapacity = capacity == 0 ? 4096 : capacity;
+        while (start + count > newCapacity) {
+            newCapacity *= 2;
+        }
+        unsigned char* grown = new unsigned char[newCapacity];
+        if (size > 0) {
+            memcpy(grown, data, size);
+        }
+        delete[] data;
+        data = grown;
+        capacity = newCapacity;
+    }
+    memset(data + size, 0, start - size);
+    size = start + count;
+    return data + start;
+}
+
+const unsigned char* SnapshotBuffer::take(int count)
+{
+    int start = count >= ALIGNMENT ? (readPos + ALIGNMENT - 1) & ~(ALIGNMENT - 1) : readPos;
+    if (isFailed || count < 0 || start + count > size)
+    {
+        isFailed = true;
+        return NULL_PTR;
+    }
+    readPos = start + count;
+    return data + start;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "properties.h"
+#include "utils.h"
+
+// Bytes of a saved game session, see Commander::saveSession. Every part of
+// the game puts its state in one after the other and gets it back in the
+// same order. Stacks are saved by number and animations by offset, never
+// by address, so a session can be loaded into other objects or another
+// process; numbers are in the byte order of the machine that saved them.
+//
+// Reading past the end or a failed check (see fail()) makes every get()
+// after it return zeros, callers check failed() once at the end.
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer();
+    ~SnapshotBuffer();
+
+    // Empties the buffer for saving, memory is kept
+    void clear();
+    // Starts reading over from the first byte
+    void rewind();
+
+    void putInt(int v);
+    void putU64(unsigned long long v);
+    void putFloat(float v);
+    void putBytes(const void* data, int size);
+
+    int getInt();
+    unsigned long long getU64();
+    float getFloat();
+    void getBytes(void* data, int size);
+
+    // Elements as they are in memory, for plain structs only
+    template <class Element, int ChunkBits>
+    void putVec(const ChunkedVec<Element, ChunkBits>& vec)
+    {
+        putInt(vec.size());
+        vec.read(0, vec.size(), (Element*)grow(vec.size() * (int)sizeof(Element)));
+    }
+
+    // False when the count is above maxCount or the bytes run out
+    template <class Element, int ChunkBits>
+    bool getVec(ChunkedVec<Element, ChunkBits>* vec, int maxCount)
+    {
+        int count = getInt();
+        const unsigned char* data = take(count >= 0 && count <= maxCount ? count * (int)sizeof(Element) : -1);
+        vec->clear();
+        if (data == NULL_PTR) {
+            return false;
+        }
+        vec->append((const Element*)data, count);
+        return true;
+    }
+
+    void fail();
+    bool failed() const;
+
+    // A hash of every byte before it, put last; a file with a bit changed
+    // anywhere is turned down as a whole instead of trusted in part
+    void putChecksum();
+    bool checksumMatches() const;
+
+    const unsigned char* getData() const;
+    int getSize() const;
+
+    // Written next to the file and renamed over it once it is on disk, so
+    // a crash leaves either the old file or the new one
+    bool saveFile(const char* path) const;
+    bool loadFile(const char* path);
+
+private:
+    // Blocks of bytes start at multiples of 8, so structs can be read in
+    // place
+    static const int ALIGNMENT = 8;
+
+    unsigned char* grow(int size);
+    const unsigned char* take(int size);
+
+    unsigned char* data;
+    int size;
+    int capacity;
+    int readPos;
+    bool isFailed;
+
+    SnapshotBuffer(const SnapshotBuffer&);
+    SnapshotBuffer& operator=(const SnapshotBuffer&);
+};
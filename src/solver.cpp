@@ -0,0 +1,710 @@
+#include <stddef.h>
+
+#include "solver.h"
+
+namespace {
+
+const int BUCKET_SIZE = 4;
+const int GENERATION_BITS = 8;
+const unsigned long long GENERATION_MASK = (1ULL << GENERATION_BITS) - 1;
+
+}  // anonymous namespace
+
+Solver::PositionSet::PositionSet(): entries(NULL_PTR), mask(0), generation(0)
+{
+}
+
+Solver::PositionSet::~PositionSet()
+{
+    delete[] entries;
+}
+
+void Solver::PositionSet::init(int sizeMb)
+{
+    unsigned long long count = 1024;
+    while (count*2*sizeof(unsigned long long) <= (unsigned long long)sizeMb << 20) {
+        count *= 2;
+    }
+
+    delete[] entries;
+    entries = new unsigned long long[(size_t)count];
+    mask = count - 1;
+    generation = GENERATION_MASK;
+    nextGeneration();
+}
+
+void Solver::PositionSet::nextGeneration()
+{
+    generation = (generation + 1) & GENERATION_MASK;
+    if (generation == 0)
+    {
+        for (unsigned long long i=0; i<=mask; i++) {
+            entries[i] = 0;
+        }
+        generation = 1;
+    }
+}
+
+unsigned long long* Solver::PositionSet::getBucket(unsigned long long key) const
+{
+    // From the bits above the generation, or the buckets of one search
+    // would be a small part of the table
+    return &entries[(key >> GENERATION_BITS) & mask & ~(unsigned long long)(BUCKET_SIZE-1)];
+}
+
+bool Solver::PositionSet::contains(unsigned long long key) const
+{
+    const unsigned long long* bucket = getBucket(key);
+    key = (key & ~GENERATION_MASK) | generation;
+    for (int i=0; i<BUCKET_SIZE; i++) {
+        if (Platform_AtomicLoad(&bucket[i]) == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Solver::PositionSet::insert(unsigned long long key)
+{
+    // Returns true when the key is there already. Entries are replaced
+    // atomically, so another thread may only take a slot away before it
+    // is written.
+    unsigned long long* bucket = getBucket(key);
+    key = (key & ~GENERATION_MASK) | generation;
+
+    for (int i=0; i<BUCKET_SIZE; i++)
+    {
+        unsigned long long entry = Platform_AtomicLoad(&bucket[i]);
+        if (entry == key) {
+            return true;
+        }
+        if ((entry & GENERATION_MASK) != generation)
+        {
+            if (Platform_AtomicCompareExchange(&bucket[i], entry, key)) {
+                return false;
+            }
+            if (Platform_AtomicLoad(&bucket[i]) == key) {
+                return true;
+            }
+        }
+    }
+
+    // Bucket is full, evict one of the entries - worst case is that some
+    // position will be searched once again
+    unsigned long long* victim = &bucket[(key >> 60) & (BUCKET_SIZE-1)];
+    Platform_AtomicCompareExchange(victim, Platform_AtomicLoad(victim), key);
+    return false;
+}
+
+SolverMove::SolverMove(): src(STACK_ID_NULL), idx(0), dst(STACK_ID_NULL)
+{
+}
+
+SolverMove::SolverMove(int src, int idx, int dst)
+    : src((signed char)src), idx((signed char)idx), dst((signed char)dst)
+{
+}
+
+bool SolverMove::isAdvance() const
+{
+    return src == STACK_IDX_STOCK;
+}
+
+void SolverMove::apply(GameState& gameState) const
+{
+    if (isAdvance()) {
+        gameState.advanceStock();
+    }
+    else
+    {
+        gameState.fillHand(gameState.getStack(src), idx);
+        gameState.releaseHand(gameState.getStack(dst));
+    }
+}
+
+Solver::Stats::Stats(): nodes(0), hashHits(0), hashStores(0), maxDepth(0)
+{
+}
+
+Solver::Solver()
+    : gameState(NULL_PTR)
+    , frames(NULL_PTR)
+    , maxNodes(0)
+    , nodeLimit(0)
+    , truncated(false)
+    , main(this)
+    , helpers(NULL_PTR)
+    , helperThreads(NULL_PTR)
+    , helperCount(0)
+    , helperPosition(NULL_PTR)
+    , helperResult(RESULT_ABORTED)
+    , orderState(0)
+    , allSplits(false)
+    , sharedNodes(0)
+    , stopping(false)
+    , cancelled(false)
+{
+}
+
+Solver::~Solver()
+{
+    delete[] helperThreads;
+    delete[] helpers;
+    delete gameState;
+    delete[] frames;
+}
+
+void Solver::init(long long aMaxNodes, int hashSizeMb, int threadCount)
+{
+    maxNodes = aMaxNodes;
+
+    delete[] helperThreads;
+    delete[] helpers;
+    helperThreads = NULL_PTR;
+    helpers = NULL_PTR;
+    helperCount = threadCount > 1 ? threadCount-1 : 0;
+    if (helperCount > 0)
+    {
+        helpers = new Solver[helperCount];
+        helperThreads = new Thread[helperCount];
+        for (int i=0; i<helperCount; i++)
+        {
+            helpers[i].main = this;
+            helpers[i].gameState = new GameState();
+            helpers[i].frames = new Frame[MAX_DEPTH];
+            helpers[i].visited.init(hashSizeMb);
+        }
+        deadEnds.init(hashSizeMb);
+    }
+
+    visited.init(hashSizeMb);
+
+    if (gameState == NULL_PTR) {
+        gameState = new GameState();
+    }
+    if (frames == NULL_PTR) {
+        frames = new Frame[MAX_DEPTH];
+    }
+}
+
+Solver::Result Solver::solve(const GameState& initial)
+{
+    // Step #1: sequence splits that free no card for a foundation are left
+    // out, which finds most wins much sooner
+
+    allSplits = false;
+    Result result = solvePass(initial);
+    if (result != RESULT_UNSOLVABLE) {
+        return result;
+    }
+
+    // Step #2: no win without them is no proof that there is none, so the
+    // search is done again with every split on what is left of the budget
+
+    Stats pruned = stats;
+    long long budget = maxNodes;
+    allSplits = true;
+    maxNodes = budget - pruned.nodes;
+    result = solvePass(initial);
+    maxNodes = budget;
+
+    stats.nodes += pruned.nodes;
+    stats.hashHits += pruned.hashHits;
+    stats.hashStores += pruned.hashStores;
+    doMax(stats.maxDepth, pruned.maxDepth);
+    return result;
+}
+
+Solver::Result Solver::solvePass(const GameState& initial)
+{
+    sharedNodes = 0;
+    stopping = false;
+    if (helperCount == 0) {
+        return search(initial);
+    }
+
+    // Step #1: helpers search on their own threads until someone finds a
+    // solution. A position goes to the shared dead ends once a thread has
+    // tried every move from it, positions in progress are searched by
+    // everyone who gets there.
+
+    deadEnds.nextGeneration();
+    helperPosition = &initial;
+    for (int i=0; i<helperCount; i++)
+    {
+        helpers[i].orderState = i+1;
+        helperThreads[i].start(helperMain, &helpers[i]);
+    }
+
+    Result result = search(initial);
+    if (result == RESULT_SOLVED) {
+        stopping = true;
+    }
+    for (int i=0; i<helperCount; i++) {
+        helperThreads[i].join();
+    }
+
+    // Step #2: collect the results
+
+    for (int i=0; i<helperCount; i++)
+    {
+        const Solver& helper = helpers[i];
+        if (result != RESULT_SOLVED && helper.helperResult == RESULT_SOLVED)
+        {
+            solution.clear();
+            for (int j=0; j<helper.solution.size(); j++) {
+                solution.push(helper.solution[j]);
+            }
+            result = RESULT_SOLVED;
+        }
+        else if (result == RESULT_UNSOLVABLE && helper.helperResult == RESULT_ABORTED) {
+            result = RESULT_ABORTED;
+        }
+
+        stats.nodes += helper.stats.nodes;
+        stats.hashHits += helper.stats.hashHits;
+        stats.hashStores += helper.stats.hashStores;
+        doMax(stats.maxDepth, helper.stats.maxDepth);
+    }
+
+    return result;
+}
+
+void Solver::helperMain(void* arg)
+{
+    Solver* helper = (Solver*)arg;
+    helper->helperResult = helper->search(*helper->main->helperPosition);
+    if (helper->helperResult == RESULT_SOLVED) {
+        helper->main->stopping = true;
+    }
+}
+
+Solver::Result Solver::search(const GameState& initial)
+{
+    stats = Stats();
+    solution.clear();
+    truncated = false;
+    nodeLimit = 0;
+    visited.nextGeneration();
+
+    gameState->copyPosition(initial);
+    if (gameState->gameWon()) {
+        return RESULT_SOLVED;
+    }
+
+    int depth = 0;
+    frames[0].key = gameState->getCanonicalHash(false);
+    isKnown(frames[0].key);
+    generateMoves(frames[0]);
+    shuffleMoves(frames[0]);
+
+    while (true)
+    {
+        Frame& frame = frames[depth];
+        if (frame.next >= frame.count)
+        {
+            if (main->helperCount > 0 && truncated == false) {
+                main->deadEnds.insert(frame.key);
+            }
+            if (depth == 0) {
+                break;
+            }
+            depth--;
+            undoMove(frames[depth].moves[frames[depth].next-1]);
+            continue;
+        }
+
+        if (stats.nodes >= nodeLimit && reserveNodes() == false) {
+            return RESULT_ABORTED;
+        }
+
+        Move& move = frame.moves[frame.next++];
+        doMove(move);
+        stats.nodes++;
+
+        if (gameState->gameWon())
+        {
+            extractSolution(depth);
+            return RESULT_SOLVED;
+        }
+
+        unsigned long long key = gameState->getCanonicalHash(false);
+        if (isKnown(key))
+        {
+            stats.hashHits++;
+            undoMove(move);
+            continue;
+        }
+
+        if (depth+1 >= MAX_DEPTH)
+        {
+            truncated = true;
+            undoMove(move);
+            continue;
+        }
+
+        depth++;
+        doMax(stats.maxDepth, depth);
+        frames[depth].key = key;
+        generateMoves(frames[depth]);
+        shuffleMoves(frames[depth]);
+    }
+
+    return truncated ? RESULT_ABORTED : RESULT_UNSOLVABLE;
+}
+
+bool Solver::reserveNodes()
+{
+    // The budget is taken in chunks, which is also when a search notices
+    // that it was cancelled or that another thread has found a solution
+    if (main->stopping || main->cancelled) {
+        return false;
+    }
+
+    if (main->helperCount == 0)
+    {
+        if (nodeLimit >= maxNodes) {
+            return false;
+        }
+        nodeLimit = nodeLimit + NODE_CHUNK < maxNodes ? nodeLimit + NODE_CHUNK : maxNodes;
+        return true;
+    }
+
+    long long used = Platform_AtomicAdd(&main->sharedNodes, NODE_CHUNK) - NODE_CHUNK;
+    if (used >= main->maxNodes) {
+        return false;
+    }
+
+    nodeLimit += NODE_CHUNK;
+    return true;
+}
+
+void Solver::shuffleMoves(Frame& frame)
+{
+    if (orderState == 0) {
+        return;
+    }
+
+    for (int i=frame.count-1; i>0; i--)
+    {
+        int j = (int)(Utils_SplitMix64(&orderState) % (unsigned long long)(i+1));
+        Move tmp = frame.moves[i];
+        frame.moves[i] = frame.moves[j];
+        frame.moves[j] = tmp;
+    }
+}
+
+void Solver::setCancelled(bool aCancelled)
+{
+    cancelled = aCancelled;
+}
+
+int Solver::getSolutionLength() const
+{
+    return solution.size();
+}
+
+const SolverMove& Solver::getSolutionMove(int n) const
+{
+    return solution[n];
+}
+
+const Solver::Stats& Solver::getStats() const
+{
+    return stats;
+}
+
+void Solver::doMove(Move& move)
+{
+    for (int i=0; i<move.advances; i++) {
+        gameState->advanceStock();
+    }
+
+    CardStack* src = gameState->getStack(move.src);
+    if (move.src == STACK_IDX_WASTE) {
+        move.idx = (signed char)(src->size() - 1);
+    }
+
+    gameState->fillHand(src, move.idx);
+    gameState->releaseHand(gameState->getStack(move.dst));
+}
+
+void Solver::undoMove(const Move& move)
+{
+    for (int i=0; i<=move.advances; i++) {
+        gameState->undo();
+    }
+}
+
+void Solver::extractSolution(int depth)
+{
+    for (int d=0; d<=depth; d++)
+    {
+        const Move& move = frames[d].moves[frames[d].next-1];
+        for (int i=0; i<move.advances; i++) {
+            solution.push(SolverMove(STACK_IDX_STOCK, 0, STACK_IDX_WASTE));
+        }
+        solution.push(SolverMove(move.src, move.idx, move.dst));
+    }
+}
+
+bool Solver::isKnown(unsigned long long key)
+{
+    if (visited.insert(key)) {
+        return true;
+    }
+    if (main->helperCount > 0 && main->deadEnds.contains(key)) {
+        return true;
+    }
+
+    stats.hashStores++;
+    return false;
+}
+
+int Solver::findFoundationDest(const GameCard& card) const
+{
+    unsigned int mask = destTable.getMask(card.id) & DestTable::FOUNDATION_BITS;
+    return mask != 0 ? Utils_LowestBit(mask) : STACK_ID_NULL;
+}
+
+bool Solver::tableauAccepts(int n, const GameCard& card) const
+{
+    return ((destTable.accepts[n] >> card.id) & 1) != 0;
+}
+
+bool Solver::isSafeForFoundation(const GameCard& card) const
+{
+    // A card is safe to put away when no card that could be placed on it
+    // is left outside of the foundations. Aces never need a parent, so
+    // twos are always safe too.
+    int value = card.getValue();
+    if (value <= 1) {
+        return true;
+    }
+
+    for (int s=0; s<SUIT_COUNT; s++) {
+        if (GameCard(GameCard::GetAceId(s)).getColor() != card.getColor() && foundationCount[s] < value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Solver::isCardAvailable(int cardId) const
+{
+    int stack = cardStack[cardId];
+    if (stack == STACK_IDX_STOCK || stack == STACK_IDX_WASTE) {
+        return true;
+    }
+
+    const CardStack* cs = gameState->getStack(stack);
+    if (stack >= STACK_IDX_FOUNDATION) {
+        return cardIdx[cardId] == cs->size() - 1;
+    }
+    return (*cs)[cardIdx[cardId]].opened();
+}
+
+bool Solver::hasAvailableChild(const GameCard& card) const
+{
+    if (card.getValue() == 0) {
+        return false;
+    }
+    for (int s=0; s<SUIT_COUNT; s++)
+    {
+        GameCard child(GameCard::GetAceId(s) + card.getValue() - 1);
+        if (child.getColor() != card.getColor() && isCardAvailable(child.id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Solver::addMove(Frame& frame, int src, int idx, int dst, int advances)
+{
+    if (frame.count < MAX_MOVES)
+    {
+        Move& move = frame.moves[frame.count++];
+        move.src = (signed char)src;
+        move.idx = (signed char)idx;
+        move.dst = (signed char)dst;
+        move.advances = (signed char)advances;
+    }
+}
+
+void Solver::generateMoves(Frame& frame)
+{
+    frame.count = 0;
+    frame.next = 0;
+    gameState->getDestTable(&destTable);
+
+    for (int s=0; s<SUIT_COUNT; s++) {
+        foundationCount[s] = 0;
+    }
+    for (int i=0; i<STACK_IDX_HAND; i++)
+    {
+        const CardStack* cs = gameState->getStack(i);
+        for (int j=0; j<cs->size(); j++)
+        {
+            cardStack[(*cs)[j].id] = (signed char)i;
+            cardIdx[(*cs)[j].id] = (signed char)j;
+        }
+        if (i >= STACK_IDX_FOUNDATION && i < STACK_IDX_STOCK && cs->empty() == false) {
+            foundationCount[cs->top().getSuit()] = cs->size();
+        }
+    }
+
+    const CardStack& stock = gameState->stock;
+    const CardStack& waste = gameState->waste;
+
+    // Talon is waste bottom-up followed by stock top-down, the order is
+    // preserved when the stock gets recycled. Cursor points to the card that
+    // would be drawn next.
+    int talonSize = stock.size() + waste.size();
+    int cursor = waste.size();
+    int talonCards[CARDS_TOTAL];
+    int talonAdvances[CARDS_TOTAL];
+
+    for (int i=0; i<talonSize; i++)
+    {
+        int t = cursor == 0 ? i : (cursor-1+i) % talonSize;
+        talonCards[i] = t < cursor ? waste[t].id : stock[stock.size()-1-(t-cursor)].id;
+        talonAdvances[i] = t >= cursor-1 
+            ? t-cursor+1 
+            : (talonSize-cursor) + 1 + (t+1);
+    }
+
+    int firstEmptyTableau = STACK_ID_NULL;
+    for (int i=0; i<TABLEAU_COUNT; i++) {
+        if (gameState->tableaux[i].empty())
+        {
+            firstEmptyTableau = i;
+            break;
+        }
+    }
+
+    // Step #1: moves to foundations, a safe one makes all others redundant
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& t = gameState->tableaux[i];
+        if (t.empty() == false)
+        {
+            int dst = findFoundationDest(t.top());
+            if (dst != STACK_ID_NULL)
+            {
+                if (isSafeForFoundation(t.top()))
+                {
+                    frame.count = 0;
+                    addMove(frame, STACK_IDX_TABLEAU + i, t.size()-1, dst, 0);
+                    return;
+                }
+                addMove(frame, STACK_IDX_TABLEAU + i, t.size()-1, dst, 0);
+            }
+        }
+    }
+
+    for (int i=0; i<talonSize; i++)
+    {
+        int dst = findFoundationDest(GameCard(talonCards[i]));
+        if (dst != STACK_ID_NULL)
+        {
+            if (talonAdvances[i] == 0 && isSafeForFoundation(GameCard(talonCards[i])))
+            {
+                frame.count = 0;
+                addMove(frame, STACK_IDX_WASTE, 0, dst, 0);
+                return;
+            }
+            addMove(frame, STACK_IDX_WASTE, 0, dst, talonAdvances[i]);
+        }
+    }
+
+    // Step #2: tableau to tableau moves
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& src = gameState->tableaux[i];
+        int firstOpen = 0;
+        while (firstOpen < src.size() && src[firstOpen].opened() == false) {
+            firstOpen++;
+        }
+
+        for (int k=firstOpen; k<src.size(); k++)
+        {
+            // Breaking a sequence pays off soonest when the card under it
+            // can go to a foundation right away, other splits come last
+            if (k > firstOpen && findFoundationDest(src[k-1]) == STACK_ID_NULL) {
+                continue;
+            }
+            addTableauMoves(frame, i, k, firstEmptyTableau);
+        }
+    }
+
+    // Step #3: talon to tableau moves
+
+    for (int i=0; i<talonSize; i++) {
+        for (int j=0; j<TABLEAU_COUNT; j++)
+        {
+            GameCard card(talonCards[i]);
+            if (tableauAccepts(j, card) && (gameState->tableaux[j].empty() == false || j == firstEmptyTableau)) {
+                addMove(frame, STACK_IDX_WASTE, 0, STACK_IDX_TABLEAU + j, talonAdvances[i]);
+            }
+        }
+    }
+
+    // Step #4: taking cards back from foundations, only to put something on
+    // them and never for safe ones
+
+    for (int i=0; i<FOUNDATION_COUNT; i++)
+    {
+        const CardStack& f = gameState->foundations[i];
+        if (f.empty() || isSafeForFoundation(f.top())) {
+            continue;
+        }
+        if (hasAvailableChild(f.top()) == false) {
+            continue;
+        }
+        for (int j=0; j<TABLEAU_COUNT; j++)
+        {
+            if (tableauAccepts(j, f.top()) && (gameState->tableaux[j].empty() == false || j == firstEmptyTableau)) {
+                addMove(frame, STACK_IDX_FOUNDATION + i, f.size()-1, STACK_IDX_TABLEAU + j, 0);
+            }
+        }
+    }
+
+    // Step #5: the rest of the sequence splits, they free a card for
+    // another tableau or a card to take back from a foundation
+
+    if (main->allSplits == false) {
+        return;
+    }
+
+    for (int i=0; i<TABLEAU_COUNT; i++)
+    {
+        const CardStack& src = gameState->tableaux[i];
+        int firstOpen = 0;
+        while (firstOpen < src.size() && src[firstOpen].opened() == false) {
+            firstOpen++;
+        }
+
+        for (int k=firstOpen+1; k<src.size(); k++) {
+            if (findFoundationDest(src[k-1]) == STACK_ID_NULL) {
+                addTableauMoves(frame, i, k, firstEmptyTableau);
+            }
+        }
+    }
+}
+
+void Solver::addTableauMoves(Frame& frame, int src, int idx, int firstEmptyTableau)
+{
+    const CardStack& stack = gameState->tableaux[src];
+    for (int j=0; j<TABLEAU_COUNT; j++)
+    {
+        if (j == src || tableauAccepts(j, stack[idx]) == false) {
+            continue;
+        }
+        if (gameState->tableaux[j].empty() && (idx == 0 || j != firstEmptyTableau)) {
+            continue;
+        }
+        addMove(frame, STACK_IDX_TABLEAU + src, idx, STACK_IDX_TABLEAU + j, 0);
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "model.h"
+#include "platform.h"
+
+struct SolverMove
+{
+    // Stack indices as used by GameState::getStack(), idx is the position of
+    // the first moved card in the source stack. A move with the stock as a
+    // source is a single advanceStock() call.
+    signed char src;
+    signed char idx;
+    signed char dst;
+
+    SolverMove();
+    SolverMove(int src, int idx, int dst);
+
+    bool isAdvance() const;
+    void apply(GameState& gameState) const;
+};
+
+class Solver
+{
+public:
+    enum Result
+    {
+        RESULT_SOLVED = 0,
+        RESULT_UNSOLVABLE,
+        RESULT_ABORTED,
+    };
+
+    struct Stats
+    {
+        long long nodes;
+        long long hashHits;
+        long long hashStores;
+        int maxDepth;
+
+        Stats();
+    };
+
+    // Plays a search goes down at most, a deeper position aborts it
+    static const int MAX_DEPTH = 1024;
+
+    // Longest solution a search can find, stock advances included: each
+    // play may come after a turn of the whole talon
+    static const int MAX_SOLUTION_LENGTH = MAX_DEPTH * (CARDS_TOTAL - TABLEAU_COUNT*(TABLEAU_COUNT+1)/2 + 1);
+
+    Solver();
+    ~Solver();
+
+    // Search stops with RESULT_ABORTED after maxNodes positions. Extra
+    // threads search the same position in their own move order and share
+    // the node budget and a table of positions proven to be dead ends.
+    // Every thread has its own table of hashSizeMb, and so does the shared
+    // one.
+    void init(long long maxNodes, int hashSizeMb, int threadCount = 1);
+    Result solve(const GameState& gameState);
+
+    // Can be called from any thread: makes the search in progress and all
+    // later ones return RESULT_ABORTED soon, until reset
+    void setCancelled(bool cancelled);
+
+    int getSolutionLength() const;
+    const SolverMove& getSolutionMove(int n) const;
+    const Stats& getStats() const;
+
+private:
+    // Talon plays (src == waste) first advance the stock the given number
+    // of times, so that every talon card is reachable in a single move
+    struct Move
+    {
+        signed char src;
+        signed char idx;
+        signed char dst;
+        signed char advances;
+    };
+
+    static const int MAX_MOVES = 256;
+    static const int NODE_CHUNK = 4096;
+
+    struct Frame
+    {
+        Move moves[MAX_MOVES];
+        int count;
+        int next;
+        unsigned long long key;
+    };
+
+    // Set of position keys which can be shared by threads. Low bits of an
+    // entry keep the number of the search that stored it, so the set doesn't
+    // need to be cleared before every search.
+    class PositionSet
+    {
+    public:
+        PositionSet();
+        ~PositionSet();
+
+        void init(int sizeMb);
+        void nextGeneration();
+        bool contains(unsigned long long key) const;
+        bool insert(unsigned long long key);
+
+    private:
+        unsigned long long* getBucket(unsigned long long key) const;
+
+        unsigned long long* entries;
+        unsigned long long mask;
+        unsigned long long generation;
+
+        PositionSet(const PositionSet&);
+        PositionSet& operator=(const PositionSet&);
+    };
+
+    static void helperMain(void* arg);
+    Result solvePass(const GameState& initial);
+    Result search(const GameState& initial);
+    bool reserveNodes();
+    void shuffleMoves(Frame& frame);
+
+    void doMove(Move& move);
+    void undoMove(const Move& move);
+    void generateMoves(Frame& frame);
+    void addMove(Frame& frame, int src, int idx, int dst, int advances);
+    void addTableauMoves(Frame& frame, int src, int idx, int firstEmptyTableau);
+    void extractSolution(int depth);
+
+    bool isKnown(unsigned long long key);
+
+    int findFoundationDest(const GameCard& card) const;
+    bool tableauAccepts(int n, const GameCard& card) const;
+    bool isSafeForFoundation(const GameCard& card) const;
+    bool isCardAvailable(int cardId) const;
+    bool hasAvailableChild(const GameCard& card) const;
+
+    GameState* gameState;
+    Frame* frames;
+    PositionSet visited;
+    long long maxNodes;
+    long long nodeLimit;
+    bool truncated;
+
+    // Parallel search: helpers share the dead ends and the budget of the
+    // main solver, which is the solver itself when searching alone
+    PositionSet deadEnds;
+    Solver* main;
+    Solver* helpers;
+    Thread* helperThreads;
+    int helperCount;
+    const GameState* helperPosition;
+    Result helperResult;
+    unsigned long long orderState;
+    bool allSplits;
+    volatile long long sharedNodes;
+    volatile bool stopping;
+    volatile bool cancelled;
+
+    DestTable destTable;
+    int foundationCount[SUIT_COUNT];
+    signed char cardStack[CARDS_TOTAL];
+    signed char cardIdx[CARDS_TOTAL];
+
+    FixedVec<SolverMove, MAX_SOLUTION_LENGTH> solution;
+    Stats stats;
+
+    Solver(const Solver&);
+    Solver& operator=(const Solver&);
+};
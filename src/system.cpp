@@ -13,6 +13,7 @@
 #include "system.h"
 #include "xenny.h"
 #include "properties.h"
+#include "generated\resources_gen.h"
 
 // TODO: add support for multiple monitors
 // * check if maximizing works on both monitors correctly
@@ -844,6 +845,7 @@ int Sys_GetMouseButtonState(SysAPI* sys)
         VK_RBUTTON,  (int)MOUSE_BUTTON_RIGHT,
         VK_XBUTTON1, (int)MOUSE_BUTTON_BACK,
         VK_XBUTTON2, (int)MOUSE_BUTTON_FWRD,
+        VK_MBUTTON,  (int)MOUSE_BUTTON_MIDDLE,
     };
 
     POINT cursorPos;
@@ -852,7 +854,7 @@ int Sys_GetMouseButtonState(SysAPI* sys)
         return result;
     }
 
-    for (int i=0; i<sizeof(KEY_MAPPING); i++) {
+    for (int i=0; i<sizeof(KEY_MAPPING)/sizeof(KEY_MAPPING[0]); i++) {
         result |= (GetAsyncKeyState(KEY_MAPPING[i]) & (int)0x80000000) 
             ? KEY_MAPPING[i+1] : 0;
         i++;
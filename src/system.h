@@ -22,6 +22,7 @@ enum MouseButtonState
     MOUSE_BUTTON_RIGHT = 2,
     MOUSE_BUTTON_BACK  = 4,
     MOUSE_BUTTON_FWRD  = 8,
+    MOUSE_BUTTON_MIDDLE = 16,
 };
 
 int  Sys_GetMouseButtonState(SysAPI* sys);
@@ -0,0 +1,361 @@
+// system.h with no window and no GPU, for Linux build and benchmark
+// machines: the game runs for a number of ticks at a fixed or unlimited
+// rate. The mouse stays idle or plays a script, an input log or generated
+// play (see inputgen.h). Quads are counted, or drawn on the CPU by
+// SoftRenderer (see raster.h) when asked to.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "inputgen.h"
+#include "inputlog.h"
+#include "platform.h"
+#include "properties.h"
+#include "raster.h"
+#include "system.h"
+#include "utils.h"
+#include "xenny.h"
+
+#define STBI_HEADER_FILE_ONLY
+#include "stb_image.c"
+
+static const char USAGE[] =
+    "Usage: xenny-headless [options]\n"
+    "\n"
+    "Runs the game with no display through GameAPI_Init(), GameAPI_Update()\n"
+    "and GameAPI_Render(), and reports the time both of them take. The game\n"
+    "reads and writes its files (session, journal, replays) as it would\n"
+    "next to the window; SIGINT and SIGTERM close it the way the window does.\n"
+    "\n"
+    "Options:\n"
+    "  -w <width>   screen width (default 1280)\n"
+    "  -h <height>  screen height (default 720)\n"
+    "  -t <ticks>   ticks to run, 0 until a signal comes or the input ends\n"
+    "               (default 600)\n"
+    "  -r <rate>    ticks per second, 0 for as fast as it goes (default 60)\n"
+    "  -C <dir>     directory to run in, for the files of the game\n"
+    "  -d           draw the frames on the CPU and report the time it takes\n"
+    "  -j <threads> threads drawing besides the main one (default CPUs - 1)\n"
+    "  -o <file>    save the last frame drawn as a binary PPM, implies -d\n"
+    "  -i <file>    mouse from an input log (INPUT_LOG_FILE), the run ends with it\n"
+    "  -g <seed>    mouse from drag and drop play generated from the seed\n"
+    "  -n <count>   gestures of generated play before a new deal (default 60)\n";
+
+// More ticks behind than this and the loop starts over from now instead of
+// catching up, like the window drops updates
+static const int MAX_LATE_TICKS = 3;
+
+struct SysAPI
+{
+    int width;
+    int height;
+
+    const unsigned char* textureData;
+    int textureLen;
+    int textureCount;
+    int activeTexture;
+
+    long long quads;
+    long long clears;
+
+    // Set when the frames are drawn
+    SoftRenderer* renderer;
+
+    // Set when the mouse plays a script, frame being the tick's
+    InputSource input;
+    void* inputArg;
+    InputFrame frame;
+
+    SysAPI()
+        : width(0)
+        , height(0)
+        , textureData(NULL_PTR)
+        , textureLen(0)
+        , textureCount(0)
+        , activeTexture(0)
+        , quads(0)
+        , clears(0)
+        , renderer(NULL_PTR)
+        , input(NULL_PTR)
+        , inputArg(NULL_PTR)
+    {
+    }
+};
+
+namespace {
+
+volatile sig_atomic_t closeRequested = 0;
+
+void onSignal(int)
+{
+    closeRequested = 1;
+}
+
+struct RunStats
+{
+    long long ticks;
+    double seconds;
+    double updateSeconds;
+    double renderSeconds;
+    double rasterSeconds;
+    double worstUpdate;
+    double worstRender;
+    double worstRaster;
+    long long lateTicks;
+
+    RunStats()
+        : ticks(0)
+        , seconds(0.0)
+        , updateSeconds(0.0)
+        , renderSeconds(0.0)
+        , rasterSeconds(0.0)
+        , worstUpdate(0.0)
+        , worstRender(0.0)
+        , worstRaster(0.0)
+        , lateTicks(0)
+    {
+    }
+};
+
+void runTick(GameAPI* game, SysAPI* sys, RunStats* stats)
+{
+    double start = Platform_GetTime();
+    GameAPI_Update(game);
+    double updated = Platform_GetTime();
+    GameAPI_Render(game);
+    double rendered = Platform_GetTime();
+    if (sys->renderer != NULL_PTR) {
+        sys->renderer->finish();
+    }
+    double rastered = Platform_GetTime();
+
+    stats->updateSeconds += updated - start;
+    stats->renderSeconds += rendered - updated;
+    stats->rasterSeconds += rastered - rendered;
+    doMax(stats->worstUpdate, updated - start);
+    doMax(stats->worstRender, rendered - updated);
+    doMax(stats->worstRaster, rastered - rendered);
+    stats->ticks++;
+}
+
+}  // anonymous namespace
+
+// Handles from 0 in the order of loading, as the window has them
+int Sys_LoadTexture(SysAPI* sys, const unsigned char* data, int len)
+{
+    sys->textureData = data;
+    sys->textureLen = len;
+    if (sys->renderer != NULL_PTR)
+    {
+        int width = 0;
+        int height = 0;
+        unsigned char* pixels = stbi_load_from_memory(data, len, &width, &height, NULL_PTR, 4);
+        if (pixels == NULL_PTR || sys->renderer->addTexture(pixels, width, height) < 0)
+        {
+            fprintf(stderr, "can't decode texture %d\n", sys->textureCount);
+            exit(EXIT_FAILURE);
+        }
+        stbi_image_free(pixels);
+    }
+    return sys->textureCount++;
+}
+
+void Sys_SetTexture(SysAPI* sys, int hTexture)
+{
+    sys->activeTexture = hTexture;
+    if (sys->renderer != NULL_PTR) {
+        sys->renderer->setTexture(hTexture);
+    }
+}
+
+void Sys_ClearScreen(SysAPI* sys, int rgb)
+{
+    sys->clears++;
+    if (sys->renderer != NULL_PTR) {
+        sys->renderer->clear(sys->width, sys->height, rgb);
+    }
+}
+
+void Sys_Render(SysAPI* sys,
+                float sx, float sy,
+                float sw, float sh,
+                float tx, float ty,
+                float tw, float th)
+{
+    sys->quads++;
+    if (sys->renderer != NULL_PTR) {
+        sys->renderer->addQuad(sx, sy, sw, sh, tx, ty, tw, th);
+    }
+}
+
+int Sys_GetMouseButtonState(SysAPI* sys)
+{
+    return sys->frame.buttons;
+}
+
+void Sys_GetMousePos(SysAPI* sys, int* x, int* y)
+{
+    *x = sys->frame.x;
+    *y = sys->frame.y;
+}
+
+int main(int argc, char** argv)
+{
+    SysAPI sys;
+    sys.width = 1280;
+    sys.height = 720;
+    long long tickLimit = 600;
+    int rate = 60;
+    bool draw = false;
+    int threads = Platform_GetCpuCount() - 1;
+    const char* framePath = NULL_PTR;
+    const char* inputPath = NULL_PTR;
+    bool generate = false;
+    unsigned long long seed = 0;
+    int gesturesPerDeal = 60;
+
+    for (int i=1; i<argc; i++)
+    {
+        bool hasValue = i+1 < argc;
+        if (strcmp(argv[i], "-w") == 0 && hasValue) {
+            sys.width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0 && hasValue) {
+            sys.height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && hasValue) {
+            tickLimit = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && hasValue) {
+            rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            draw = true;
+        } else if (strcmp(argv[i], "-j") == 0 && hasValue) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+            framePath = argv[++i];
+            draw = true;
+        } else if (strcmp(argv[i], "-i") == 0 && hasValue) {
+            inputPath = argv[++i];
+        } else if (strcmp(argv[i], "-g") == 0 && hasValue) {
+            seed = strtoull(argv[++i], NULL_PTR, 0);
+            generate = true;
+        } else if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            gesturesPerDeal = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-C") == 0 && hasValue) {
+            if (chdir(argv[++i]) != 0)
+            {
+                fprintf(stderr, "can't change to %s\n", argv[i]);
+                return 1;
+            }
+        } else {
+            fputs(USAGE, stderr);
+            return 2;
+        }
+    }
+    if (sys.width < 1 || sys.height < 1 || tickLimit < 0 || rate < 0 || threads < 0 || gesturesPerDeal < 0
+        || (inputPath != NULL_PTR && generate))
+    {
+        fputs(USAGE, stderr);
+        return 2;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    // Step #1: the game as the window sets it up, the mouse from the script
+    // if there is one
+
+    InputLogReader inputLog;
+    if (inputPath != NULL_PTR)
+    {
+        if (inputLog.open(inputPath) == false)
+        {
+            fprintf(stderr, "can't read %s\n", inputPath);
+            return 1;
+        }
+        sys.input = InputLogReader::NextFrame;
+        sys.inputArg = &inputLog;
+    }
+
+    double frameTime = rate > 0 ? 1.0 / rate : FRAME_TIME;
+    InputGenerator generator;
+    if (generate)
+    {
+        generator.init(seed, sys.width, sys.height, (int)(1.0 / frameTime + 0.5), gesturesPerDeal);
+        sys.input = InputGenerator::NextFrame;
+        sys.inputArg = &generator;
+    }
+
+    SoftRenderer renderer;
+    if (draw)
+    {
+        renderer.start(threads);
+        sys.renderer = &renderer;
+    }
+
+    GameAPI* game = GameAPI_Create();
+    GameAPI_Init(game, &sys, sys.width, sys.height, (float)frameTime);
+
+    // Step #2: a tick is an update and a frame; at a fixed rate every one
+    // has its time and the loop sleeps until it comes
+
+    RunStats stats;
+    double start = Platform_GetTime();
+    double nextTick = start;
+    bool inputEnded = false;
+    while (GameAPI_Finished(game) == 0)
+    {
+        if (closeRequested || inputEnded || (tickLimit > 0 && stats.ticks >= tickLimit))
+        {
+            GameAPI_OnClosing(game);
+            continue;
+        }
+
+        if (rate > 0)
+        {
+            double now = Platform_GetTime();
+            if (now < nextTick)
+            {
+                Platform_Sleep((int)((nextTick - now) * 1000.0));
+                continue;
+            }
+            if (now - nextTick > MAX_LATE_TICKS * frameTime)
+            {
+                stats.lateTicks++;
+                nextTick = now;
+            }
+            nextTick += frameTime;
+        }
+        if (sys.input != NULL_PTR && sys.input(&sys.frame, sys.inputArg) == false)
+        {
+            inputEnded = true;
+            continue;
+        }
+        runTick(game, &sys, &stats);
+    }
+    stats.seconds = Platform_GetTime() - start;
+    GameAPI_Release(game);
+
+    long long ticks = stats.ticks > 0 ? stats.ticks : 1;
+    printf("%lld ticks in %.2f s at %dx%d, %s\n", stats.ticks, stats.seconds, sys.width, sys.height,
+        rate > 0 ? "fixed rate" : "unlimited rate");
+    printf("  %10.0f ticks/s  %lld times late\n", stats.ticks / stats.seconds, stats.lateTicks);
+    printf("  update %8.2f us  worst %.1f us\n", stats.updateSeconds * 1e6 / ticks, stats.worstUpdate * 1e6);
+    printf("  render %8.2f us  worst %.1f us  %.1f quads per frame\n", stats.renderSeconds * 1e6 / ticks, stats.worstRender * 1e6,
+        (double)sys.quads / ticks);
+    if (draw) {
+        printf("  raster %8.2f us  worst %.1f us  %d threads\n", stats.rasterSeconds * 1e6 / ticks, stats.worstRaster * 1e6, threads + 1);
+    }
+    if (generate) {
+        printf("  input  %lld gestures  %lld deals asked for\n", generator.getGestureCount(), generator.getDealCount());
+    }
+    renderer.stop();
+
+    if (framePath != NULL_PTR && renderer.savePpm(framePath) == false)
+    {
+        fprintf(stderr, "can't write %s\n", framePath);
+        return 1;
+    }
+    return 0;
+}
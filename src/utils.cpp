@@ -1,5 +1,4 @@
-﻿#include <algorithm>
-#include <math.h>
+﻿#include <math.h>
 
 #include "utils.h"
 
@@ -13,11 +12,31 @@ float Utils_Sin(float arg)
     return sinf(arg);
 }
 
-void Utils_CreateRandomPermutation(int* begin, int count)
+void Utils_CreateSeededPermutation(int* begin, int count, unsigned long long seed)
 {
     for (int i=0; i<count; i++)
     {
         begin[i] = i;
     }
-    std::random_shuffle(begin, begin+count);
+
+    // Fisher-Yates shuffle driven by SplitMix64, so that the same seed gives
+    // the same permutation with every compiler
+    unsigned long long state = seed;
+    for (int i=count-1; i>0; i--)
+    {
+        unsigned long long z = Utils_SplitMix64(&state);
+        int j = (int)(((z >> 32) * (unsigned long long)(i+1)) >> 32);
+        int tmp = begin[i];
+        begin[i] = begin[j];
+        begin[j] = tmp;
+    }
+}
+
+int Utils_LowestBit(unsigned int mask)
+{
+    static const int DEBRUIJN_POSITIONS[32] = {
+        0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+        31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9,
+    };
+    return DEBRUIJN_POSITIONS[((mask & (0u - mask)) * 0x077CB531u) >> 27];
 }
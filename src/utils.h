@@ -73,6 +73,105 @@ private:
     int count;
 };
 
+// Grows without a limit by adding chunks of 1 << ChunkBits elements, which
+// never move once allocated. Chunks stay allocated when the vector shrinks.
+template <class Element, int ChunkBits>
+class ChunkedVec
+{
+public:
+    ChunkedVec(): chunks(0), chunkCount(0), chunkCapacity(0), count(0)
+    {
+    }
+
+    ~ChunkedVec()
+    {
+        for (int i=0; i<chunkCount; i++) {
+            delete[] chunks[i];
+        }
+        delete[] chunks;
+    }
+
+    int size() const
+    {
+        return count;
+    }
+
+    void clear()
+    {
+        count = 0;
+    }
+
+    // Drops the elements from newCount on, newCount must not exceed size()
+    void truncate(int newCount)
+    {
+        count = newCount;
+    }
+
+    void push(const Element& e)
+    {
+        int chunk = count >> ChunkBits;
+        if (chunk == chunkCount)
+        {
+            if (chunkCount == chunkCapacity)
+            {
+                chunkCapacity = chunkCapacity == 0 ? 4 : chunkCapacity * 2;
+                Element** grown = new Element*[chunkCapacity];
+                for (int i=0; i<chunkCount; i++) {
+                    grown[i] = chunks[i];
+                }
+                delete[] chunks;
+                chunks = grown;
+            }
+            chunks[chunkCount++] = new Element[1 << ChunkBits];
+        }
+        chunks[chunk][count & ((1 << ChunkBits) - 1)] = e;
+        count++;
+    }
+
+    Element& operator[](int idx)
+    {
+        return chunks[idx >> ChunkBits][idx & ((1 << ChunkBits) - 1)];
+    }
+
+    const Element& operator[](int idx) const
+    {
+        return chunks[idx >> ChunkBits][idx & ((1 << ChunkBits) - 1)];
+    }
+
+    // Copies count elements from first on to out, a chunk at a time
+    void read(int first, int count, Element* out) const
+    {
+        while (count > 0)
+        {
+            int offset = first & ((1 << ChunkBits) - 1);
+            int n = (1 << ChunkBits) - offset < count ? (1 << ChunkBits) - offset : count;
+            const Element* chunk = chunks[first >> ChunkBits] + offset;
+            for (int i=0; i<n; i++) {
+                out[i] = chunk[i];
+            }
+            out += n;
+            first += n;
+            count -= n;
+        }
+    }
+
+    void append(const Element* in, int count)
+    {
+        for (int i=0; i<count; i++) {
+            push(in[i]);
+        }
+    }
+
+private:
+    Element** chunks;
+    int chunkCount;
+    int chunkCapacity;
+    int count;
+
+    ChunkedVec(const ChunkedVec&);
+    ChunkedVec& operator=(const ChunkedVec&);
+};
+
 template <class T>
 inline T max(const T& a, const T& b)
 {
@@ -92,4 +191,16 @@ inline void doFlip(bool& a)
 float Utils_Round(float arg);
 float Utils_Sin(float arg);
 
-void Utils_CreateRandomPermutation(int* begin, int count);
+// Inline, bulk deal generation makes tens of calls per deal
+inline unsigned long long Utils_SplitMix64(unsigned long long* state)
+{
+    *state += 0x9E3779B97F4A7C15ULL;
+    unsigned long long z = *state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+void Utils_CreateSeededPermutation(int* begin, int count, unsigned long long seed);
+
+// Index of the lowest set bit, mask must not be zero
+int Utils_LowestBit(unsigned int mask);
@@ -1,5 +1,7 @@
 #include "controller.h"
+#include "inputlog.h"
 #include "xenny.h"
+#include "generated/resources_gen.h"
 
 class CardGfxData
 {
@@ -105,29 +107,54 @@ public:
         Sys_LoadTexture(sys, MAIN_TEXTURE, MAIN_TEXTURE_SIZE);
         cardGfxData.init();
         input.init(sys);
-        
+
+        DealQueue* queue = NULL_PTR;
+        if (WINNABLE_DEALS_ONLY) 
+        {
+            if (DEAL_TIER >= 0 && dealIndex.open(DEAL_INDEX_FILE)) {
+                dealQueue.useIndex(&dealIndex, DEAL_TIER);
+            }
+            dealQueue.start();
+            queue = &dealQueue;
+        }
+        hintEngine.start();
+
         delete gameState;
         gameState = new GameState();
         gameState->init();
 
         delete commander;
         commander = new Commander();
-        commander->init(gameState);
+        if (REPLAY_FILE[0] != 0) {
+            commander->recordReplays(REPLAY_FILE);
+        }
+        if (INPUT_LOG_FILE[0] != 0 && inputLog.open(INPUT_LOG_FILE)) {
+            commander->setDealSource(RecordDeal, this);
+        }
+        commander->init(gameState, queue, &hintEngine);
+        if (SESSION_FILE[0] != 0) {
+            commander->keepSession(SESSION_FILE, JOURNAL_FILE);
+        }
     }
 
     void resize(int width, int height)
     {
+        inputLog.addSize(width, height);
         commander->resize(width, height);
     }
 
     void handleControls()
     {
         input.update();
+        inputLog.addFrame(InputFrame((int)input.x, (int)input.y, input.getButtons()));
         commander->handleInput(input);
     }
 
     void forceClose()
     {
+        if (gameFinished == false) {
+            commander->storeSession();
+        }
         gameFinished = true;
     }
 
@@ -158,6 +185,15 @@ public:
     }
 
 private:
+    // Deals the same way the Commander would, and records them
+    static unsigned long long RecordDeal(void* arg)
+    {
+        GameAPI* game = (GameAPI*)arg;
+        unsigned long long number = WINNABLE_DEALS_ONLY ? game->dealQueue.next() : GameDeal::RandomNumber();
+        game->inputLog.addDeal(number);
+        return number;
+    }
+
     void renderRect(Rect screen, Rect tex) const
     {
         Sys_Render(sys, 
@@ -248,6 +284,10 @@ private:
     CardGfxData cardGfxData;
 
     Input input;
+    InputLogWriter inputLog;
+    DifficultyIndex dealIndex;
+    DealQueue dealQueue;
+    HintEngine hintEngine;
     GameState* gameState;
     Commander* commander;
 };
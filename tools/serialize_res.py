@@ -1,3 +1,5 @@
+from __future__ import print_function
+
 import os
 import shutil
 import sys
@@ -23,10 +25,10 @@ def clean_up():
     file_path = os.path.join(GEN_DIR, entry)
     try:
       if os.path.isfile(file_path):
-        print "Removing %s..." % file_path
+        print("Removing %s..." % file_path)
         os.unlink(file_path)
-    except Exception, e:
-      print e
+    except Exception as e:
+      print(e)
       sys.exit("Sorry, some exception!");
 
 def generate_master_header(sizes):
@@ -42,23 +44,23 @@ def generate_master_header(sizes):
     content += ["static const unsigned int  %s = %d;\n" % (k + SIZE_SUFFIX, v)]
 
   file_path = os.path.join(GEN_DIR, MASTER_HEADER)
-  print "Generating %s..." % file_path;
+  print("Generating %s..." % file_path)
   with open(file_path, "w") as f:
     f.writelines(content)
 
 def generate_embedded_resources():
   sizes = {}    
-  for k, v in BINARY.items() + STRINGS.items():
+  for k, v in list(BINARY.items()) + list(STRINGS.items()):
     file_path = os.path.join(RES_DIR, k)
-    print "Generating %s..." % file_path;
+    print("Generating %s..." % file_path)
 
     if not os.path.isfile(file_path):
       sys.exit("Sorry, %s is not a file!" % file_path)
-    bin_content = open(file_path, "rb").read()
+    bin_content = bytearray(open(file_path, "rb").read())
     if k in BINARY:
       sizes[v] = len(bin_content)
     else:
-      bin_content += '\0'
+      bin_content += bytearray(1)
 
     content = []
     content += ["// Generated file, do not modify!\n", "\n", "extern const unsigned char %s[] = {\n" % v]
@@ -67,7 +69,7 @@ def generate_embedded_resources():
       if i > 0 and i % 16 == 0:
         content += [line + "\n"]
         line = "    "
-      line += "0x%02X, " % ord(b)
+      line += "0x%02X, " % b
     content += [line+"\n", "};\n"]
 
     res_file_path = os.path.join(GEN_DIR, k + ".c")
@@ -77,6 +79,9 @@ def generate_embedded_resources():
   generate_master_header(sizes)
 
 if __name__ == "__main__":
+  # Another output directory can be given, e.g. for out-of-tree builds
+  if len(sys.argv) > 1:
+    GEN_DIR = sys.argv[1]
   if not os.path.exists(GEN_DIR):
     os.mkdir(GEN_DIR)
   clean_up()
@@ -0,0 +1,646 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "model.h"
+#include "journal.h"
+#include "platform.h"
+#include "replay.h"
+
+static const char USAGE[] =
+    "Usage: xenny-bench [options] [test]\n"
+    "\n"
+    "Measures the speed of the game model on positions reached by random play\n"
+    "from seeded deals. Tests:\n"
+    "  movegen     GameState::generateMoves() and getDestMask()\n"
+    "  symmetry    positions a few moves away told apart by getHash() and by\n"
+    "              getCanonicalHash(), and the speed of both\n"
+    "  deals       GameDeal::FromSeedRange() on all threads, FromSeed() for\n"
+    "              comparison\n"
+    "  replay      random games with undo, redo, seeks and branch switches\n"
+    "              written by ReplayWriter, read back and played again\n"
+    "  session     GameState::save() and load() after every random step,\n"
+    "              checkpoints included\n"
+    "  journal     MoveJournal records of random play, their cost per step,\n"
+    "              recovery onto the saved session and a torn last record\n"
+    "Without a test name all of them are run.\n"
+    "\n"
+    "Options:\n"
+    "  -n <count>  number of positions or replayed games (default 4096)\n"
+    "  -r <count>  repetitions per position (default 64)\n"
+    "  -j <count>  threads for deals (default: one per core)\n";
+
+static const int MAX_POSITIONS = 1 << 16;
+static const int MAX_MOVES = 256;
+static const int SYMMETRY_DEPTH = 3;
+static const int MAX_REACHED = 1 << 20;
+static const int DEAL_CHUNK = 1 << 16;
+static const int DEAL_CHUNKS = 256;
+static const int REPLAY_STEPS = 200;
+static const char REPLAY_BENCH_FILE[] = "xenny-bench.rpl";
+static const int JOURNAL_SESSIONS = 4;
+static const int JOURNAL_STEPS = 1 << 14;
+static const char JOURNAL_BENCH_SESSION[] = "xenny-bench.dat";
+static const char JOURNAL_BENCH_FILE[] = "xenny-bench.jnl";
+static const int SESSION_GAMES = 300;
+static const int SESSION_STEPS = 400;
+
+// Plays random legal moves from consecutive seeds and keeps every position
+static int collectPositions(PackedGameState* positions, int count)
+{
+    GameState* gameState = new GameState();
+    unsigned long long random = 1;
+    unsigned long long seed = 1;
+    int collected = 0;
+
+    while (collected < count)
+    {
+        gameState->init(GameDeal::FromSeed(seed++));
+        for (int step=0; step<200 && collected < count; step++)
+        {
+            gameState->pack(&positions[collected++]);
+
+            LegalMove moves[MAX_MOVES];
+            int moveCount = gameState->generateMoves(moves, MAX_MOVES);
+            int pick = (int)(Utils_SplitMix64(&random) % (unsigned long long)(moveCount + 1));
+            if (pick == moveCount)
+            {
+                gameState->advanceStock();
+                continue;
+            }
+            gameState->fillHand(gameState->getStack(moves[pick].src), moves[pick].idx);
+            gameState->releaseHand(gameState->getStack(moves[pick].dst));
+        }
+    }
+
+    delete gameState;
+    return collected;
+}
+
+static void benchMoveGen(const PackedGameState* positions, int count, int repeat)
+{
+    GameState* gameState = new GameState();
+    double genSeconds = 0.0;
+    double maskSeconds = 0.0;
+    long long moveTotal = 0;
+    long long sourceTotal = 0;
+    unsigned int checksum = 0;
+
+    for (int i=0; i<count; i++)
+    {
+        gameState->unpack(positions[i]);
+
+        LegalMove moves[MAX_MOVES];
+        double start = Platform_GetTime();
+        for (int r=0; r<repeat; r++)
+        {
+            int moveCount = gameState->generateMoves(moves, MAX_MOVES);
+            moveTotal += moveCount;
+            checksum += moveCount;
+        }
+        genSeconds += Platform_GetTime() - start;
+
+        start = Platform_GetTime();
+        for (int r=0; r<repeat; r++) {
+            for (int s=0; s<STACK_IDX_HAND; s++)
+            {
+                const CardStack* cs = gameState->getStack(s);
+                for (int k=cs->size()-1; k>=0 && (*cs)[k].opened(); k--)
+                {
+                    checksum ^= gameState->getDestMask(s, k);
+                    sourceTotal++;
+                }
+            }
+        }
+        maskSeconds += Platform_GetTime() - start;
+    }
+
+    double calls = (double)count * repeat;
+    printf("movegen: %d positions x %d, %.1f moves per position\n", count, repeat, moveTotal / calls);
+    printf("  generateMoves  %8.2f M positions/s  %8.2f M moves/s\n", calls / genSeconds / 1e6, moveTotal / genSeconds / 1e6);
+    printf("  getDestMask    %8.2f M sources/s  (checksum %08x)\n", sourceTotal / maskSeconds / 1e6, checksum);
+
+    delete gameState;
+}
+
+// Every position up to the given number of moves or stock advances away
+static void collectReached(GameState* gameState, int depth, unsigned long long* exact, unsigned long long* canonical, int* count)
+{
+    if (*count >= MAX_REACHED) {
+        return;
+    }
+    exact[*count] = gameState->getHash();
+    canonical[*count] = gameState->getCanonicalHash(true);
+    (*count)++;
+    if (depth == 0) {
+        return;
+    }
+
+    LegalMove moves[MAX_MOVES];
+    int moveCount = gameState->generateMoves(moves, MAX_MOVES);
+    for (int i=0; i<moveCount; i++)
+    {
+        gameState->fillHand(gameState->getStack(moves[i].src), moves[i].idx);
+        gameState->releaseHand(gameState->getStack(moves[i].dst));
+        collectReached(gameState, depth-1, exact, canonical, count);
+        gameState->undo();
+    }
+    if (gameState->stock.size() + gameState->waste.size() > 0)
+    {
+        gameState->advanceStock();
+        collectReached(gameState, depth-1, exact, canonical, count);
+        gameState->undo();
+    }
+}
+
+static int countDistinct(unsigned long long* keys, int count)
+{
+    std::sort(keys, keys + count);
+    return (int)(std::unique(keys, keys + count) - keys);
+}
+
+static void benchSymmetry(const PackedGameState* positions, int count, int repeat)
+{
+    GameState* gameState = new GameState();
+    unsigned long long* exact = new unsigned long long[MAX_REACHED];
+    unsigned long long* canonical = new unsigned long long[MAX_REACHED];
+    long long reachedTotal = 0;
+    long long exactTotal = 0;
+    long long canonicalTotal = 0;
+    double exactSeconds = 0.0;
+    double canonicalSeconds = 0.0;
+    unsigned long long checksum = 0;
+
+    for (int i=0; i<count; i++)
+    {
+        gameState->unpack(positions[i]);
+
+        int reached = 0;
+        collectReached(gameState, SYMMETRY_DEPTH, exact, canonical, &reached);
+        reachedTotal += reached;
+        exactTotal += countDistinct(exact, reached);
+        canonicalTotal += countDistinct(canonical, reached);
+
+        double start = Platform_GetTime();
+        for (int r=0; r<repeat; r++) {
+            checksum += gameState->computeHash();
+        }
+        exactSeconds += Platform_GetTime() - start;
+
+        start = Platform_GetTime();
+        for (int r=0; r<repeat; r++) {
+            checksum += gameState->getCanonicalHash(r & 1);
+        }
+        canonicalSeconds += Platform_GetTime() - start;
+    }
+
+    double calls = (double)count * repeat;
+    printf("symmetry: %d positions, %lld reached within %d moves\n", count, reachedTotal, SYMMETRY_DEPTH);
+    printf("  distinct by getHash           %10lld\n", exactTotal);
+    printf("  distinct by getCanonicalHash  %10lld  (%.1f%% fewer)\n", canonicalTotal, 100.0 * (exactTotal - canonicalTotal) / exactTotal);
+    printf("  computeHash       %8.2f M positions/s\n", calls / exactSeconds / 1e6);
+    printf("  getCanonicalHash  %8.2f M positions/s  (checksum %08x)\n", calls / canonicalSeconds / 1e6, (unsigned int)checksum);
+
+    delete[] canonical;
+    delete[] exact;
+    delete gameState;
+}
+
+struct DealWorker
+{
+    Thread thread;
+    unsigned char* buffer;
+    int firstChunk;
+    int chunkStep;
+};
+
+static void dealWorkerMain(void* arg)
+{
+    // Every thread reuses one chunk sized buffer, as an analysis would
+    DealWorker* worker = (DealWorker*)arg;
+    for (int c=worker->firstChunk; c<DEAL_CHUNKS; c+=worker->chunkStep) {
+        GameDeal::FromSeedRange((unsigned long long)c * DEAL_CHUNK, DEAL_CHUNK, worker->buffer);
+    }
+}
+
+static void benchDeals(int threadCount)
+{
+    // Step #1: bulk deals on all threads
+
+    DealWorker* workers = new DealWorker[threadCount];
+    for (int i=0; i<threadCount; i++)
+    {
+        workers[i].buffer = new unsigned char[DEAL_CHUNK * CARDS_TOTAL];
+        workers[i].firstChunk = i;
+        workers[i].chunkStep = threadCount;
+    }
+
+    double start = Platform_GetTime();
+    for (int i=1; i<threadCount; i++) {
+        workers[i].thread.start(dealWorkerMain, &workers[i]);
+    }
+    dealWorkerMain(&workers[0]);
+    for (int i=1; i<threadCount; i++) {
+        workers[i].thread.join();
+    }
+    double bulkSeconds = Platform_GetTime() - start;
+
+    // Step #2: one deal at a time, checking that both agree
+
+    unsigned char* buffer = workers[0].buffer;
+    GameDeal::FromSeedRange(0, DEAL_CHUNK, buffer);
+    int mismatches = 0;
+    start = Platform_GetTime();
+    for (int i=0; i<DEAL_CHUNK; i++)
+    {
+        GameDeal deal = GameDeal::FromSeed(i);
+        mismatches += memcmp(deal.cardIds, buffer + i*CARDS_TOTAL, CARDS_TOTAL) != 0 ? 1 : 0;
+    }
+    double singleSeconds = Platform_GetTime() - start;
+
+    // Both shuffle the same way, so they are also checked against the
+    // permutation deal numbers are defined by
+    for (int i=0; i<DEAL_CHUNK; i++)
+    {
+        int cardIdx[CARDS_TOTAL];
+        Utils_CreateSeededPermutation(cardIdx, CARDS_TOTAL, i);
+        for (int j=0; j<CARDS_TOTAL; j++) {
+            if (buffer[i*CARDS_TOTAL + j] != cardIdx[j])
+            {
+                mismatches++;
+                break;
+            }
+        }
+    }
+
+    double total = (double)DEAL_CHUNK * DEAL_CHUNKS;
+    printf("deals: %.0f deals on %d threads\n", total, threadCount);
+    printf("  FromSeedRange  %8.2f M deals/s  %6.1f ns per deal and thread\n", total / bulkSeconds / 1e6, bulkSeconds * threadCount * 1e9 / total);
+    printf("  FromSeed       %8.2f M deals/s  %6.1f ns per deal  (%d mismatches)\n", DEAL_CHUNK / singleSeconds / 1e6, singleSeconds * 1e9 / DEAL_CHUNK, mismatches);
+
+    for (int i=0; i<threadCount; i++) {
+        delete[] workers[i].buffer;
+    }
+    delete[] workers;
+}
+
+// One random step as a player could make it; undo and redo now and then,
+// rarer seeks and branch switches
+static void playRandomStep(GameState* gameState, unsigned long long* random)
+{
+    unsigned long long roll = Utils_SplitMix64(random);
+    int kind = (int)(roll % 100);
+    roll /= 100;
+
+    if (kind < 6 && gameState->undo()) {
+        return;
+    }
+    if (kind < 9 && gameState->redo()) {
+        return;
+    }
+    if (kind == 9)
+    {
+        gameState->seek((int)(roll % (unsigned long long)(gameState->history.getMoveCount() + 1)));
+        return;
+    }
+    if (kind == 10 && gameState->history.getBranchCount() > 1)
+    {
+        gameState->switchBranch((int)(roll % (unsigned long long)gameState->history.getBranchCount()));
+        return;
+    }
+
+    LegalMove moves[MAX_MOVES];
+    int moveCount = gameState->generateMoves(moves, MAX_MOVES);
+    int pick = (int)(roll % (unsigned long long)(moveCount + 1));
+    if (pick == moveCount) {
+        gameState->advanceStock();
+    }
+    else
+    {
+        gameState->fillHand(gameState->getStack(moves[pick].src), moves[pick].idx);
+        gameState->releaseHand(gameState->getStack(moves[pick].dst));
+    }
+}
+
+static void benchReplay(int gameCount)
+{
+    // Step #1: random games, half of them by deal number, recorded as the
+    // game records them and remembered by the hash they ended on
+
+    GameState* gameState = new GameState();
+    gameState->history.setKeepBranches(true);
+    unsigned long long* endHashes = new unsigned long long[gameCount];
+    unsigned long long random = 1;
+    remove(REPLAY_BENCH_FILE);
+
+    ReplayWriter* writer = new ReplayWriter();
+    if (writer->open(REPLAY_BENCH_FILE) == false)
+    {
+        printf("replay: can't write %s\n", REPLAY_BENCH_FILE);
+        delete writer;
+        delete[] endHashes;
+        delete gameState;
+        return;
+    }
+    gameState->setHistoryListener(ReplayWriter::OnHistoryEvent, writer);
+
+    double playSeconds = 0.0;
+    long long bytes = 0;
+    long long maxBytes = 0;
+    double start = Platform_GetTime();
+    for (int g=0; g<gameCount; g++)
+    {
+        if (g % 2 == 0) {
+            gameState->init((unsigned long long)g);
+        } else {
+            gameState->init(GameDeal::FromSeed(g));
+        }
+        writer->beginGame(*gameState);
+        for (int step=0; step<REPLAY_STEPS; step++) {
+            playRandomStep(gameState, &random);
+        }
+        endHashes[g] = gameState->getHash();
+        bytes += writer->getGameSize();
+        doMax(maxBytes, writer->getGameSize());
+    }
+    writer->close();
+    playSeconds = Platform_GetTime() - start;
+    delete writer;
+
+    // Step #2: every replay read back and played on a fresh state
+
+    ReplayReader* reader = new ReplayReader();
+    reader->open(REPLAY_BENCH_FILE);
+    gameState->setHistoryListener(NULL_PTR, NULL_PTR);
+
+    int replayed = 0;
+    int mismatches = 0;
+    long long stepTotal = 0;
+    ReplayHeader header;
+    start = Platform_GetTime();
+    while (replayed < gameCount && reader->nextReplay(&header))
+    {
+        ReplayReader::StartGame(header, gameState);
+        bool won = false;
+        int steps = 0;
+        ReplayReader::Result result = reader->playReplay(gameState, &won, &steps);
+        mismatches += result != ReplayReader::RESULT_OK || gameState->getHash() != endHashes[replayed] ? 1 : 0;
+        stepTotal += steps;
+        replayed++;
+    }
+    double replaySeconds = Platform_GetTime() - start;
+    mismatches += gameCount - replayed;
+    delete reader;
+    remove(REPLAY_BENCH_FILE);
+
+    printf("replay: %d games of %d random steps\n", gameCount, REPLAY_STEPS);
+    printf("  size           %8.1f bytes per game  %lld at most  %.2f bytes per step\n", (double)bytes / gameCount, maxBytes, (double)bytes / stepTotal);
+    printf("  record+play    %8.0f games/s\n", gameCount / playSeconds);
+    printf("  read+replay    %8.0f games/s  %8.2f M steps/s  (%d mismatches)\n", replayed / replaySeconds, stepTotal / replaySeconds / 1e6, mismatches);
+
+    delete[] endHashes;
+    delete gameState;
+}
+
+// Saves the state, loads it into loaded and checks that both are at the
+// same position, with the same history behind it
+static bool roundTrip(const GameState& gameState, GameState* loaded, SnapshotBuffer* buffer)
+{
+    buffer->clear();
+    gameState.save(buffer);
+    buffer->rewind();
+    if (loaded->load(buffer) == false) {
+        return false;
+    }
+
+    int position = gameState.history.getPosition();
+    bool ok = loaded->getHash() == gameState.getHash()
+        && loaded->history.getPosition() == position
+        && loaded->history.getMoveCount() == gameState.history.getMoveCount();
+
+    // The checkpoints have to take the loaded state there and back
+    ok = ok && loaded->seek(0) && loaded->seek(loaded->history.getMoveCount()) && loaded->seek(position);
+    return ok && loaded->getHash() == gameState.getHash();
+}
+
+static void benchSession()
+{
+    GameState* gameState = new GameState();
+    GameState* loaded = new GameState();
+    SnapshotBuffer buffer;
+    int failures = 0;
+    long long bytes = 0;
+    long long saves = 0;
+    double start = Platform_GetTime();
+
+    // Step #1: past a checkpoint, most of the way back and a move from
+    // there, which leaves the checkpoint behind
+
+    for (int keep=0; keep<2; keep++)
+    {
+        gameState->history.setKeepBranches(keep != 0);
+        gameState->init(1ULL);
+        for (int i=0; i<70; i++) {
+            gameState->advanceStock();
+        }
+        for (int i=0; i<66; i++) {
+            gameState->undo();
+        }
+        gameState->advanceStock();
+        failures += roundTrip(*gameState, loaded, &buffer) ? 0 : 1;
+    }
+
+    // Step #2: random games with undo, redo, seeks and branch switches,
+    // saved and loaded after every step
+
+    unsigned long long random = 1;
+    for (int g=0; g<SESSION_GAMES; g++)
+    {
+        gameState->history.setKeepBranches(g % 2 == 0);
+        gameState->init((unsigned long long)g);
+        for (int step=0; step<SESSION_STEPS; step++)
+        {
+            playRandomStep(gameState, &random);
+            failures += roundTrip(*gameState, loaded, &buffer) ? 0 : 1;
+            bytes += buffer.getSize();
+            saves++;
+        }
+    }
+    double seconds = Platform_GetTime() - start;
+
+    printf("session: %d games of %d random steps, saved and loaded after each\n", SESSION_GAMES, SESSION_STEPS);
+    printf("  round trip     %8.1f us per save and load  %.0f bytes on average  (%d failures)\n",
+        seconds * 1e6 / saves, (double)bytes / saves, failures);
+
+    delete loaded;
+    delete gameState;
+}
+
+static void benchJournal()
+{
+    GameState* gameState = new GameState();
+    GameState* recovered = new GameState();
+    gameState->history.setKeepBranches(true);
+    SnapshotBuffer session;
+    MoveJournal* journal = new MoveJournal();
+
+    double plainSeconds = 0.0;
+    double journalSeconds = 0.0;
+    double closeSeconds = 0.0;
+    double recoverSeconds = 0.0;
+    double worstRecover = 0.0;
+    long long recordTotal = 0;
+    long long bytes = 0;
+    int mismatches = 0;
+    int tornMismatches = 0;
+
+    for (int s=0; s<JOURNAL_SESSIONS; s++)
+    {
+        // Step #1: the same random steps without a journal and with one
+        // after the saved deal, the difference is what the records cost;
+        // the journal is updated as often as a game ticks between moves
+
+        unsigned long long random = s + 1;
+        gameState->setHistoryListener(NULL_PTR, NULL_PTR);
+        gameState->init((unsigned long long)s);
+        double start = Platform_GetTime();
+        for (int step=0; step<JOURNAL_STEPS; step++) {
+            playRandomStep(gameState, &random);
+        }
+        plainSeconds += Platform_GetTime() - start;
+        unsigned long long endHash = gameState->getHash();
+
+        random = s + 1;
+        gameState->init((unsigned long long)s);
+        session.clear();
+        gameState->save(&session);
+        unsigned long long checksum = MoveJournal::Checksum(session);
+        if (session.saveFile(JOURNAL_BENCH_SESSION) == false || journal->open(JOURNAL_BENCH_FILE, checksum, JOURNAL_SYNC_MS) == false)
+        {
+            printf("journal: can't write %s\n", JOURNAL_BENCH_FILE);
+            break;
+        }
+        gameState->setHistoryListener(MoveJournal::OnHistoryEvent, journal);
+        start = Platform_GetTime();
+        for (int step=0; step<JOURNAL_STEPS; step++)
+        {
+            playRandomStep(gameState, &random);
+            if (step % 16 == 0) {
+                journal->update();
+            }
+        }
+        journalSeconds += Platform_GetTime() - start;
+        int records = journal->getRecordCount();
+        recordTotal += records;
+
+        start = Platform_GetTime();
+        journal->close();
+        closeSeconds += Platform_GetTime() - start;
+
+        // Step #2: the saved state with every record made on it again
+
+        start = Platform_GetTime();
+        int recoveredRecords = 0;
+        bool ok = session.loadFile(JOURNAL_BENCH_SESSION);
+        ok = ok && recovered->load(&session);
+        ok = ok && MoveJournal::Recover(JOURNAL_BENCH_FILE, checksum, recovered, &recoveredRecords);
+        double seconds = Platform_GetTime() - start;
+        recoverSeconds += seconds;
+        doMax(worstRecover, seconds);
+        mismatches += ok == false || recoveredRecords != records || recovered->getHash() != endHash
+            || recovered->history.getPosition() != gameState->history.getPosition()
+            || recovered->history.getMoveCount() != gameState->history.getMoveCount() ? 1 : 0;
+
+        // Step #3: the last record cut short, as a crash in the middle of a
+        // write leaves it; all the others have to come back
+
+        SnapshotBuffer data;
+        data.loadFile(JOURNAL_BENCH_FILE);
+        bytes += data.getSize();
+        FILE* file = fopen(JOURNAL_BENCH_FILE, "wb");
+        if (file != NULL_PTR)
+        {
+            fwrite(data.getData(), 1, data.getSize() - 1, file);
+            fclose(file);
+        }
+        session.rewind();
+        ok = recovered->load(&session) && MoveJournal::Recover(JOURNAL_BENCH_FILE, checksum, recovered, &recoveredRecords);
+        tornMismatches += ok == false || recoveredRecords != records - 1 ? 1 : 0;
+    }
+    remove(JOURNAL_BENCH_SESSION);
+    remove(JOURNAL_BENCH_FILE);
+
+    double recordCost = (journalSeconds - plainSeconds) / recordTotal;
+    printf("journal: %d sessions of %d random steps, %.0f records each\n", JOURNAL_SESSIONS, JOURNAL_STEPS, (double)recordTotal / JOURNAL_SESSIONS);
+    printf("  size           %8.2f bytes per record\n", (double)bytes / recordTotal);
+    printf("  play           %8.1f ns per step without journal, +%.1f ns per record with it\n", plainSeconds * 1e9 / (JOURNAL_SESSIONS * JOURNAL_STEPS), recordCost * 1e9);
+    printf("  close          %8.2f ms per session (last sync)\n", closeSeconds * 1e3 / JOURNAL_SESSIONS);
+    printf("  recover        %8.2f ms per session  worst %.2f ms  %.2f M records/s  (%d mismatches)\n",
+        recoverSeconds * 1e3 / JOURNAL_SESSIONS, worstRecover * 1e3, recordTotal / recoverSeconds / 1e6, mismatches);
+    printf("  torn tail      %8d mismatches\n", tornMismatches);
+
+    delete journal;
+    delete recovered;
+    delete gameState;
+}
+
+int main(int argc, char** argv)
+{
+    int positionCount = 4096;
+    int repeat = 64;
+    int threadCount = Platform_GetCpuCount();
+    const char* test = NULL_PTR;
+
+    for (int i=1; i<argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i+1 < argc) {
+            positionCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i+1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && test == NULL_PTR) {
+            test = argv[i];
+        } else {
+            fputs(USAGE, stderr);
+            return 2;
+        }
+    }
+
+    bool known = test == NULL_PTR || strcmp(test, "movegen") == 0 || strcmp(test, "symmetry") == 0 || strcmp(test, "deals") == 0 || strcmp(test, "replay") == 0 || strcmp(test, "session") == 0 || strcmp(test, "journal") == 0;
+    if (known == false || positionCount < 1 || positionCount > MAX_POSITIONS || repeat < 1 || threadCount < 1)
+    {
+        fputs(USAGE, stderr);
+        return 2;
+    }
+
+    // Deals and replays need no positions, collecting them takes a while
+    PackedGameState* positions = new PackedGameState[positionCount];
+    if (test == NULL_PTR || strcmp(test, "movegen") == 0 || strcmp(test, "symmetry") == 0) {
+        positionCount = collectPositions(positions, positionCount);
+    }
+
+    if (test == NULL_PTR || strcmp(test, "movegen") == 0) {
+        benchMoveGen(positions, positionCount, repeat);
+    }
+    if (test == NULL_PTR || strcmp(test, "symmetry") == 0) {
+        benchSymmetry(positions, positionCount, repeat);
+    }
+    if (test == NULL_PTR || strcmp(test, "deals") == 0) {
+        benchDeals(threadCount);
+    }
+    if (test == NULL_PTR || strcmp(test, "replay") == 0) {
+        benchReplay(positionCount);
+    }
+    if (test == NULL_PTR || strcmp(test, "session") == 0) {
+        benchSession();
+    }
+    if (test == NULL_PTR || strcmp(test, "journal") == 0) {
+        benchJournal();
+    }
+
+    delete[] positions;
+    return 0;
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "controller.h"
+#include "inputlog.h"
+#include "platform.h"
+
+static const char USAGE[] =
+    "Usage: xenny-run [options] <input-log>\n"
+    "\n"
+    "Plays an input log recorded by the game (see INPUT_LOG_FILE) through\n"
+    "Input::update(), Commander::handleInput() and Commander::update() with no\n"
+    "window, as fast as it goes, and reports ticks per second and the slowest\n"
+    "tick. The digest of the final position and card layout is the same for\n"
+    "every run of the same log, to check changes against.\n"
+    "\n"
+    "Options:\n"
+    "  -r <count>  runs of the log (default 1)\n"
+    "  -s          save the session after every tick and go on with it loaded\n"
+    "              into another Commander, timing both; the digest must not\n"
+    "              change\n";
+
+// What the Input of the game polls, fed from the log
+struct SysAPI
+{
+    InputFrame frame;
+};
+
+int Sys_GetMouseButtonState(SysAPI* sys)
+{
+    return sys->frame.buttons;
+}
+
+void Sys_GetMousePos(SysAPI* sys, int* x, int* y)
+{
+    *x = sys->frame.x;
+    *y = sys->frame.y;
+}
+
+struct RunStats
+{
+    long long ticks;
+    int deals;
+    int divergences;
+    double seconds;
+    double worstTick;
+    long long worstTickIdx;
+    unsigned long long digest;
+
+    int failedLoads;
+    int sessionBytes;
+    double saveSeconds;
+    double loadSeconds;
+    double worstSave;
+    double worstLoad;
+
+    RunStats()
+        : ticks(0)
+        , deals(0)
+        , divergences(0)
+        , seconds(0.0)
+        , worstTick(0.0)
+        , worstTickIdx(0)
+        , digest(0)
+        , failedLoads(0)
+        , sessionBytes(0)
+        , saveSeconds(0.0)
+        , loadSeconds(0.0)
+        , worstSave(0.0)
+        , worstLoad(0.0)
+    {
+    }
+};
+
+struct DealFeed
+{
+    InputLogReader* reader;
+    RunStats* stats;
+};
+
+// Deals of the log in order; one the log doesn't have means the run went
+// another way than the recording, it gets a fixed number to stay repeatable
+static unsigned long long nextDeal(void* arg)
+{
+    DealFeed* feed = (DealFeed*)arg;
+    unsigned long long number = 0;
+    if (feed->reader->nextDeal(&number) == false) {
+        feed->stats->divergences++;
+    }
+    feed->stats->deals++;
+    return number;
+}
+
+static unsigned long long noDeal(void* arg)
+{
+    return 0;
+}
+
+static unsigned long long mixDigest(unsigned long long digest, unsigned long long value)
+{
+    return (digest ^ value) * 0x100000001B3ULL;
+}
+
+static unsigned long long floatBits(float f)
+{
+    unsigned int bits = 0;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static unsigned long long computeDigest(const GameState& gameState, Commander& commander)
+{
+    unsigned long long digest = mixDigest(0xCBF29CE484222325ULL, gameState.getHash());
+    for (int i=0; i<CARDS_TOTAL; i++)
+    {
+        const CardDesc& cd = commander.gameLayout.getOrderedCard(i);
+        digest = mixDigest(digest, (unsigned long long)cd.id << 1 | (cd.opened ? 1 : 0));
+        digest = mixDigest(digest, floatBits(cd.screenRect.x) << 32 | floatBits(cd.screenRect.y));
+    }
+    return digest;
+}
+
+static bool runLog(const char* path, bool moveSessions, RunStats* stats)
+{
+    InputLogReader reader;
+    if (reader.open(path) == false) {
+        return false;
+    }
+
+    // Step #1: the game as GameAPI sets it up, with no deal queue, no
+    // hints and the deals of the log
+
+    SysAPI sys;
+    Input input;
+    input.init(&sys);
+    GameState* gameState = new GameState();
+    Commander* commander = new Commander();
+    DealFeed feed;
+    feed.reader = &reader;
+    feed.stats = stats;
+    commander->setDealSource(nextDeal, &feed);
+    commander->init(gameState, NULL_PTR, NULL_PTR);
+
+    // The session goes back and forth between two of them
+    GameState* spareState = NULL_PTR;
+    Commander* spare = NULL_PTR;
+    SnapshotBuffer session;
+    if (moveSessions)
+    {
+        spareState = new GameState();
+        spare = new Commander();
+        spare->setDealSource(noDeal, NULL_PTR);
+        spare->init(spareState, NULL_PTR, NULL_PTR);
+        spare->setDealSource(nextDeal, &feed);
+    }
+
+    // Step #2: tick by tick, resizes in between as the window loop does
+
+    InputLogReader::Entry entry;
+    double start = Platform_GetTime();
+    while (reader.next(&entry))
+    {
+        if (entry.type == InputLogReader::Entry::TYPE_SIZE)
+        {
+            commander->resize(entry.width, entry.height);
+            continue;
+        }
+        if (entry.type == InputLogReader::Entry::TYPE_DEAL)
+        {
+            stats->divergences++;
+            continue;
+        }
+
+        double tickStart = Platform_GetTime();
+        sys.frame = entry.frame;
+        input.update();
+        commander->handleInput(input);
+        commander->update();
+        double tick = Platform_GetTime() - tickStart;
+
+        if (tick > stats->worstTick)
+        {
+            stats->worstTick = tick;
+            stats->worstTickIdx = stats->ticks;
+        }
+        stats->ticks++;
+
+        if (spare != NULL_PTR)
+        {
+            double saveStart = Platform_GetTime();
+            commander->saveSession(&session);
+            double loadStart = Platform_GetTime();
+            stats->failedLoads += spare->loadSession(&session) ? 0 : 1;
+            double loadEnd = Platform_GetTime();
+
+            stats->saveSeconds += loadStart - saveStart;
+            stats->loadSeconds += loadEnd - loadStart;
+            doMax(stats->worstSave, loadStart - saveStart);
+            doMax(stats->worstLoad, loadEnd - loadStart);
+            doMax(stats->sessionBytes, session.getSize());
+
+            Commander* swapCommander = commander;
+            commander = spare;
+            spare = swapCommander;
+            GameState* swapState = gameState;
+            gameState = spareState;
+            spareState = swapState;
+        }
+    }
+    stats->seconds = Platform_GetTime() - start - stats->saveSeconds - stats->loadSeconds;
+    stats->digest = computeDigest(*gameState, *commander);
+
+    delete spare;
+    delete spareState;
+    delete commander;
+    delete gameState;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int runs = 1;
+    bool moveSessions = false;
+    const char* path = NULL_PTR;
+
+    for (int i=1; i<argc; i++)
+    {
+        if (strcmp(argv[i], "-r") == 0 && i+1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            moveSessions = true;
+        } else if (argv[i][0] != '-' && path == NULL_PTR) {
+            path = argv[i];
+        } else {
+            fputs(USAGE, stderr);
+            return 2;
+        }
+    }
+    if (path == NULL_PTR || runs < 1)
+    {
+        fputs(USAGE, stderr);
+        return 2;
+    }
+
+    bool repeatable = true;
+    unsigned long long firstDigest = 0;
+    for (int r=0; r<runs; r++)
+    {
+        RunStats stats;
+        if (runLog(path, moveSessions, &stats) == false)
+        {
+            fprintf(stderr, "can't read %s\n", path);
+            return 1;
+        }
+        if (r == 0) {
+            firstDigest = stats.digest;
+        }
+        repeatable = repeatable && stats.digest == firstDigest;
+
+        printf("run %d: %lld ticks, %d deals, %d divergences\n", r+1, stats.ticks, stats.deals, stats.divergences);
+        printf("  %10.0f ticks/s  %8.2f us per tick  worst %.1f us at tick %lld\n",
+            stats.ticks / stats.seconds, stats.seconds * 1e6 / stats.ticks, stats.worstTick * 1e6, stats.worstTickIdx);
+        if (moveSessions)
+        {
+            printf("  session %d bytes at most, %d failed loads\n", stats.sessionBytes, stats.failedLoads);
+            printf("  save %8.2f us  worst %.1f us\n", stats.saveSeconds * 1e6 / stats.ticks, stats.worstSave * 1e6);
+            printf("  load %8.2f us  worst %.1f us\n", stats.loadSeconds * 1e6 / stats.ticks, stats.worstLoad * 1e6);
+        }
+        printf("  digest %016llx\n", stats.digest);
+    }
+
+    if (repeatable == false)
+    {
+        printf("digests differ between runs\n");
+        return 1;
+    }
+    return 0;
+}
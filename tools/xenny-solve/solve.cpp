@@ -0,0 +1,525 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "batch.h"
+#include "difficulty.h"
+#include "estimator.h"
+#include "optimal.h"
+#include "solver.h"
+
+static const char USAGE[] =
+    "Usage: xenny-solve [options] [deal-file]\n"
+    "\n"
+    "Solves Klondike deals (1 card draw, unlimited redeals). Each line of the\n"
+    "deal file holds 52 card codes in dealing order: tableaux row by row, then\n"
+    "the stock from bottom to top, e.g. \"9H 0S kD ...\", or a seed number. Without\n"
+    "a file a random deal is solved.\n"
+    "\n"
+    "Options:\n"
+    "  -n <count>  node budget per deal (default 10000000)\n"
+    "  -m <mb>     transposition table size in megabytes (default 64)\n"
+    "  -t <count>  threads per deal (default 1)\n"
+    "  -v          print solutions\n"
+    "  -s <seed>   solve the deal of the given seed\n"
+    "\n"
+    "Batch analysis:\n"
+    "  -b <first> <last> <file>\n"
+    "              solve the deals of a seed range on all cores and store the\n"
+    "              results in a binary file; an interrupted run continues\n"
+    "              where it stopped when started again with the same file\n"
+    "  -j <count>  number of threads for -b and -e (default: one per core)\n"
+    "  -c <file>   print the results of a batch file as CSV\n"
+    "  -x <file> <index>\n"
+    "              sort the solved seeds of a batch file into difficulty tiers\n"
+    "              (0 easy .. 3 expert) and write them to an index file\n"
+    "  -k <index> <tier>\n"
+    "              pick a random seed of a tier from an index file\n"
+    "\n"
+    "Win chance:\n"
+    "  -e <margin> instead of solving, estimate the chance to win without\n"
+    "              knowing the closed cards to +-margin (e.g. 0.01)\n"
+    "  -l <secs>   time limit per deal for -e (default 10)\n"
+    "\n"
+    "Shortest solutions:\n"
+    "  -o <moves>  play the given number of moves of the solution found first,\n"
+    "              then search for the shortest win from there; whole deals\n"
+    "              (0) usually run out of nodes\n"
+    "  -h <0|1>    lower bound for -o: 0 cards left, 1 cards left and\n"
+    "              tableaux with blocked cards (default 0)\n"
+    "\n"
+    "Benchmark:\n"
+    "  -p <count>  solve all deals of the file with 1, 2, 4... up to the given\n"
+    "              number of threads and print the speedup, see hard-deals.txt\n";
+
+static void cardName(int id, char* name)
+{
+    static const char VALUES[] = "A234567890JQK";
+    static const char SUITS[] = "DHSC";
+    name[0] = VALUES[id % CARDS_PER_SUIT];
+    name[1] = SUITS[id / CARDS_PER_SUIT];
+    name[2] = 0;
+}
+
+static bool parseDeal(const char* line, GameDeal* deal)
+{
+    bool used[CARDS_TOTAL] = {false};
+    int count = 0;
+
+    const char* p = line;
+    while (*p)
+    {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        if (*p == 0 || *p == '\n' || *p == '\r') {
+            break;
+        }
+        if (p[1] == 0 || count == CARDS_TOTAL) {
+            return false;
+        }
+
+        int id = GameCard::CodeToId(p);
+        char name[3];
+        cardName(id, name);
+        if (used[id] || (name[0] != p[0] && name[0] != p[0]-'a'+'A') || (name[1] != p[1] && name[1] != p[1]-'a'+'A')) {
+            return false;
+        }
+
+        used[id] = true;
+        deal->cardIds[count++] = (unsigned char)id;
+        p += 2;
+    }
+
+    return count == CARDS_TOTAL;
+}
+
+static bool parseLine(const char* line, GameDeal* deal)
+{
+    const char* p = line;
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    if (p != line && (*p == 0 || *p == '\n' || *p == '\r' || *p == ' '))
+    {
+        *deal = GameDeal::FromSeed(strtoull(line, NULL_PTR, 10));
+        return true;
+    }
+    return parseDeal(line, deal);
+}
+
+static void printMove(const GameState& gameState, const SolverMove& move)
+{
+    static const char* STACK_NAMES[] = {
+        "T1", "T2", "T3", "T4", "T5", "T6", "T7", "F1", "F2", "F3", "F4", "stock", "waste",
+    };
+
+    if (move.isAdvance())
+    {
+        printf("  stock\n");
+        return;
+    }
+
+    char name[3];
+    cardName((*gameState.getStack(move.src))[move.idx].id, name);
+    printf("  %s %s -> %s\n", name, STACK_NAMES[move.src], STACK_NAMES[move.dst]);
+}
+
+static bool solveDeal(Solver& solver, GameState& gameState, bool verbose)
+{
+    clock_t start = clock();
+    Solver::Result result = solver.solve(gameState);
+    double ms = (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+
+    const Solver::Stats& stats = solver.getStats();
+    static const char* RESULT_NAMES[] = {"solved", "unsolvable", "aborted"};
+    printf("%s: %d moves, %lld nodes, %lld hash hits, %.2f ms\n",
+        RESULT_NAMES[result],
+        solver.getSolutionLength(),
+        stats.nodes,
+        stats.hashHits,
+        ms);
+
+    if (result == Solver::RESULT_SOLVED)
+    {
+        for (int i=0; i<solver.getSolutionLength(); i++)
+        {
+            if (verbose) {
+                printMove(gameState, solver.getSolutionMove(i));
+            }
+            solver.getSolutionMove(i).apply(gameState);
+        }
+        if (gameState.gameWon() == false)
+        {
+            printf("error: solution does not win the game\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool estimateDeal(WinEstimator& estimator, const GameState& gameState, double margin, double seconds)
+{
+    WinEstimator::Estimate estimate = estimator.estimate(gameState, margin, seconds);
+    printf("win chance %.2f%% (95%%: %.2f%%..%.2f%%%s), %lld rollouts, %.0f rollouts/s, %.2f s\n",
+        estimate.probability * 100,
+        estimate.low * 100,
+        estimate.high * 100,
+        estimate.accurate ? "" : ", out of time",
+        estimate.rollouts,
+        estimate.rolloutsPerSecond,
+        estimate.seconds);
+    return true;
+}
+
+static bool solveOptimal(Solver& solver, OptimalSolver& optimal, GameState& gameState, int skipMoves, bool verbose)
+{
+    // Step #1: the position after the first moves of a regular solution
+
+    if (solver.solve(gameState) != Solver::RESULT_SOLVED)
+    {
+        printf("skipped: no solution to start from\n");
+        return true;
+    }
+
+    int skipped = 0;
+    while (skipped < skipMoves && skipped < solver.getSolutionLength()) {
+        solver.getSolutionMove(skipped++).apply(gameState);
+    }
+
+    // Step #2: the shortest win from there
+
+    OptimalSolver::Result result = optimal.solve(gameState);
+    const OptimalSolver::Stats& stats = optimal.getStats();
+    static const char* RESULT_NAMES[] = {"optimal", "unsolvable", "aborted"};
+    printf("%s: %d moves after %d (solver: %d), %d iterations, bound %d, %lld nodes, %.0f nodes/s, %.2f s\n",
+        RESULT_NAMES[result],
+        optimal.getSolutionLength(),
+        skipped,
+        solver.getSolutionLength() - skipped,
+        stats.iterations,
+        stats.bound,
+        stats.nodes,
+        stats.nodesPerSecond,
+        stats.seconds);
+
+    if (result == OptimalSolver::RESULT_OPTIMAL)
+    {
+        for (int i=0; i<optimal.getSolutionLength(); i++)
+        {
+            if (verbose) {
+                printMove(gameState, optimal.getSolutionMove(i));
+            }
+            optimal.getSolutionMove(i).apply(gameState);
+        }
+        if (gameState.gameWon() == false)
+        {
+            printf("error: solution does not win the game\n");
+            return false;
+        }
+        if (optimal.getSolutionLength() > solver.getSolutionLength() - skipped)
+        {
+            printf("error: solution is longer than the solver's\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int runBatch(const char* file, unsigned long long firstSeed, unsigned long long lastSeed, long long maxNodes, int hashSizeMb, int threadCount)
+{
+    BatchAnalysis batch;
+    batch.init(maxNodes, hashSizeMb, threadCount);
+    if (batch.open(file, firstSeed, lastSeed) == false)
+    {
+        fprintf(stderr, "Cannot open %s for seeds %llu..%llu\n", file, firstSeed, lastSeed);
+        return 1;
+    }
+
+    batch.run(true);
+
+    BatchAnalysis::Stats stats = batch.getStats();
+    printf("%lld/%lld seeds: %lld solved, %lld unsolvable, %lld aborted, %lld steals, %.2f s\n",
+        stats.done,
+        stats.total,
+        stats.solved,
+        stats.unsolvable,
+        stats.aborted,
+        stats.steals,
+        stats.seconds);
+    return stats.done == stats.total ? 0 : 1;
+}
+
+static int exportIndex(const char* file, const char* indexFile)
+{
+    unsigned long long counts[DifficultyIndex::TIER_COUNT];
+    if (BatchAnalysis::ExportIndex(file, indexFile, counts) == false)
+    {
+        fprintf(stderr, "Cannot write %s from %s\n", indexFile, file);
+        return 1;
+    }
+    printf("%llu easy, %llu medium, %llu hard, %llu expert\n", counts[0], counts[1], counts[2], counts[3]);
+    return 0;
+}
+
+static int pickSeed(const char* indexFile, int tier)
+{
+    static const int LOOKUPS = 1000000;
+
+    DifficultyIndex index;
+    double start = Platform_GetTime();
+    if (index.open(indexFile) == false)
+    {
+        fprintf(stderr, "Cannot open %s\n", indexFile);
+        return 1;
+    }
+    double openSeconds = Platform_GetTime() - start;
+
+    unsigned long long random = (unsigned long long)time(NULL_PTR);
+    unsigned long long count = index.getCount(tier);
+    DifficultyIndex::Entry entry;
+    if (count == 0 || index.getEntry(tier, Utils_SplitMix64(&random) % count, &entry) == false)
+    {
+        fprintf(stderr, "No seeds of tier %d\n", tier);
+        return 1;
+    }
+    printf("seed %llu: %d moves, %u nodes, tier %d of %llu seeds\n", entry.seed, entry.moves, entry.nodes, tier, count);
+
+    unsigned long long seed = 0;
+    unsigned long long checksum = 0;
+    start = Platform_GetTime();
+    for (int i=0; i<LOOKUPS; i++)
+    {
+        index.pickSeed(tier, &random, &seed);
+        checksum += seed;
+    }
+    double seconds = Platform_GetTime() - start;
+    printf("open %.3f ms, %.1f ns per lookup (%llu)\n", openSeconds * 1000, seconds * 1e9 / LOOKUPS, checksum % 10);
+    return 0;
+}
+
+static int nextThreadCount(int threads, int maxThreads)
+{
+    if (threads < maxThreads && threads*2 > maxThreads) {
+        return maxThreads;
+    }
+    return threads*2;
+}
+
+static int runBenchmark(const char* file, long long maxNodes, int hashSizeMb, int maxThreads)
+{
+    static const int MAX_DEALS = 1000;
+    static GameDeal deals[MAX_DEALS];
+    int dealCount = 0;
+
+    FILE* f = fopen(file, "r");
+    if (f == NULL_PTR)
+    {
+        fprintf(stderr, "Cannot open %s\n", file);
+        return 1;
+    }
+
+    char line[1024];
+    while (dealCount < MAX_DEALS && fgets(line, sizeof(line), f))
+    {
+        if (line[0] != '#' && line[0] != '\n' && line[0] != '\r' && parseLine(line, &deals[dealCount])) {
+            dealCount++;
+        }
+    }
+    fclose(f);
+
+    printf("%d deals, %lld nodes and %d MB per table\n", dealCount, maxNodes, hashSizeMb);
+    printf("threads  seconds  speedup  solved  unsolvable  aborted\n");
+
+    GameState* gameState = new GameState();
+    double baseSeconds = 0.0;
+    for (int threads=1; threads<=maxThreads; threads = nextThreadCount(threads, maxThreads))
+    {
+        Solver solver;
+        solver.init(maxNodes, hashSizeMb, threads);
+
+        int results[3] = {0, 0, 0};
+        double start = Platform_GetTime();
+        for (int i=0; i<dealCount; i++)
+        {
+            gameState->init(deals[i]);
+            results[solver.solve(*gameState)]++;
+        }
+        double seconds = Platform_GetTime() - start;
+        if (threads == 1) {
+            baseSeconds = seconds;
+        }
+
+        printf("%7d  %7.2f  %7.2f  %6d  %10d  %7d\n",
+            threads,
+            seconds,
+            baseSeconds / seconds,
+            results[Solver::RESULT_SOLVED],
+            results[Solver::RESULT_UNSOLVABLE],
+            results[Solver::RESULT_ABORTED]);
+        fflush(stdout);
+    }
+
+    delete gameState;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    long long maxNodes = 10000000;
+    int hashSizeMb = 64;
+    bool verbose = false;
+    const char* dealFile = NULL_PTR;
+    const char* seed = NULL_PTR;
+    const char* batchFile = NULL_PTR;
+    unsigned long long firstSeed = 0;
+    unsigned long long lastSeed = 0;
+    int threadCount = 0;
+    int solveThreads = 1;
+    int benchThreads = 0;
+    double margin = 0;
+    double timeLimit = 10;
+    int skipMoves = -1;
+    OptimalSolver::Heuristic heuristic = OptimalSolver::HEURISTIC_CARDS_LEFT;
+
+    for (int i=1; i<argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i+1 < argc) {
+            maxNodes = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i+1 < argc) {
+            hashSizeMb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i+1 < argc) {
+            solveThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0 && i+1 < argc) {
+            benchThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "-s") == 0 && i+1 < argc) {
+            seed = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i+3 < argc) {
+            firstSeed = strtoull(argv[++i], NULL_PTR, 10);
+            lastSeed = strtoull(argv[++i], NULL_PTR, 10);
+            batchFile = argv[++i];
+        } else if (strcmp(argv[i], "-e") == 0 && i+1 < argc) {
+            margin = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i+1 < argc) {
+            timeLimit = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i+1 < argc) {
+            skipMoves = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0 && i+1 < argc) {
+            heuristic = atoi(argv[++i]) == 0 ? OptimalSolver::HEURISTIC_CARDS_LEFT : OptimalSolver::HEURISTIC_BLOCKERS;
+        } else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0 && i+2 < argc) {
+            const char* file = argv[++i];
+            return exportIndex(file, argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i+2 < argc) {
+            const char* indexFile = argv[++i];
+            return pickSeed(indexFile, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-c") == 0 && i+1 < argc) {
+            const char* csvFile = argv[++i];
+            if (BatchAnalysis::ExportCsv(csvFile, stdout) == false)
+            {
+                fprintf(stderr, "Cannot read %s\n", csvFile);
+                return 1;
+            }
+            return 0;
+        } else if ((argv[i][0] != '-' || argv[i][1] == 0) && dealFile == NULL_PTR) {
+            dealFile = argv[i];
+        } else {
+            fputs(USAGE, stderr);
+            return 2;
+        }
+    }
+
+    if (batchFile != NULL_PTR) {
+        return runBatch(batchFile, firstSeed, lastSeed, maxNodes, hashSizeMb, threadCount);
+    }
+
+    if (benchThreads > 0)
+    {
+        if (dealFile == NULL_PTR)
+        {
+            fputs(USAGE, stderr);
+            return 2;
+        }
+        return runBenchmark(dealFile, maxNodes, hashSizeMb, benchThreads);
+    }
+
+    WinEstimator estimator;
+    Solver solver;
+    OptimalSolver optimal;
+    if (margin > 0) {
+        estimator.init(threadCount);
+    } else {
+        solver.init(maxNodes, hashSizeMb, solveThreads);
+    }
+    if (skipMoves >= 0) {
+        optimal.init(maxNodes, hashSizeMb, heuristic);
+    }
+    GameState* gameState = new GameState();
+    bool ok = true;
+
+    if (seed != NULL_PTR)
+    {
+        gameState->init(strtoull(seed, NULL_PTR, 10));
+        ok = margin > 0 
+            ? estimateDeal(estimator, *gameState, margin, timeLimit) 
+            : skipMoves >= 0
+            ? solveOptimal(solver, optimal, *gameState, skipMoves, verbose)
+            : solveDeal(solver, *gameState, verbose);
+    }
+    else if (dealFile == NULL_PTR)
+    {
+        gameState->init();
+        ok = margin > 0 
+            ? estimateDeal(estimator, *gameState, margin, timeLimit) 
+            : skipMoves >= 0
+            ? solveOptimal(solver, optimal, *gameState, skipMoves, verbose)
+            : solveDeal(solver, *gameState, verbose);
+    }
+    else
+    {
+        FILE* f = strcmp(dealFile, "-") == 0 ? stdin : fopen(dealFile, "r");
+        if (f == NULL_PTR)
+        {
+            fprintf(stderr, "Cannot open %s\n", dealFile);
+            return 1;
+        }
+
+        char line[1024];
+        int lineNo = 0;
+        while (fgets(line, sizeof(line), f))
+        {
+            lineNo++;
+            if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+                continue;
+            }
+
+            GameDeal deal;
+            if (parseLine(line, &deal) == false)
+            {
+                fprintf(stderr, "%s:%d: not a valid deal\n", dealFile, lineNo);
+                ok = false;
+                continue;
+            }
+
+            gameState->init(deal);
+            ok = (margin > 0 
+                ? estimateDeal(estimator, *gameState, margin, timeLimit) 
+                : skipMoves >= 0
+                ? solveOptimal(solver, optimal, *gameState, skipMoves, verbose)
+                : solveDeal(solver, *gameState, verbose)) && ok;
+        }
+
+        if (f != stdin) {
+            fclose(f);
+        }
+    }
+
+    delete gameState;
+    return ok ? 0 : 1;
+}